@@ -0,0 +1,141 @@
+#include "bench.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <sys/resource.h>
+
+static const char* BENCH_HEADER =
+    "scene,width,height,triangles,draws,frames,seconds,fps,"
+    "record_p50_ms,record_p95_ms,submit_p50_ms,submit_p95_ms,"
+    "reset_p50_ms,reset_p95_ms,gpu_p50_ms,"
+    "peak_rss_kib,peak_gpu_bytes";
+static const size_t BENCH_COLUMNS = 17;
+
+void appendBenchResult(const std::string& path, const BenchResult& result) {
+    bool needsHeader;
+    {
+        std::ifstream existing(path);
+        needsHeader = !existing || existing.peek() == std::ifstream::traits_type::eof();
+    }
+
+    std::ofstream file(path, std::ios::app);
+    if(!file) {
+        throw std::runtime_error("failed to open " + path);
+    }
+    if(needsHeader) {
+        file << BENCH_HEADER << "\n";
+    }
+    file << result.scene << ','
+         << result.width << ','
+         << result.height << ','
+         << result.triangles << ','
+         << result.draws << ','
+         << result.frames << ','
+         << result.seconds << ','
+         << result.fps << ','
+         << result.recordP50Ms << ','
+         << result.recordP95Ms << ','
+         << result.submitP50Ms << ','
+         << result.submitP95Ms << ','
+         << result.resetP50Ms << ','
+         << result.resetP95Ms << ','
+         << result.gpuP50Ms << ','
+         << result.peakResidentKiB << ','
+         << result.peakGpuBytes << "\n";
+}
+
+std::optional<BenchResult> findBenchResult(
+    const std::string& path,
+    const std::string& scene
+) {
+    std::ifstream file(path);
+    if(!file) {
+        return std::nullopt;
+    }
+
+    std::optional<BenchResult> found;
+    std::string line;
+    while(std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::stringstream row(line);
+        std::string field;
+        while(std::getline(row, field, ',')) {
+            fields.push_back(field);
+        }
+        // Skips the header and anything written by another version
+        if(fields.size() != BENCH_COLUMNS || fields[0] != scene) {
+            continue;
+        }
+
+        try {
+            BenchResult result;
+            result.scene = fields[0];
+            result.width = std::stoul(fields[1]);
+            result.height = std::stoul(fields[2]);
+            result.triangles = std::stoul(fields[3]);
+            result.draws = std::stoul(fields[4]);
+            result.frames = std::stoull(fields[5]);
+            result.seconds = std::stod(fields[6]);
+            result.fps = std::stod(fields[7]);
+            result.recordP50Ms = std::stod(fields[8]);
+            result.recordP95Ms = std::stod(fields[9]);
+            result.submitP50Ms = std::stod(fields[10]);
+            result.submitP95Ms = std::stod(fields[11]);
+            result.resetP50Ms = std::stod(fields[12]);
+            result.resetP95Ms = std::stod(fields[13]);
+            result.gpuP50Ms = std::stod(fields[14]);
+            result.peakResidentKiB = std::stoull(fields[15]);
+            result.peakGpuBytes = std::stoull(fields[16]);
+            found = result;
+        } catch(const std::exception&) {
+            throw std::runtime_error("malformed benchmark row in " + path);
+        }
+    }
+    return found;
+}
+
+// Relative change of current over baseline, positive when current is larger
+static double relativeChange(double current, double baseline) {
+    return baseline == 0.0 ? 0.0 : (current - baseline) / baseline;
+}
+
+bool compareBenchResult(
+    const BenchResult& current,
+    const BenchResult& baseline,
+    double tolerance,
+    std::ostream& out
+) {
+    bool ok = true;
+    // higherIsBetter flips which direction counts as a regression
+    auto check = [&](const char* name, double now, double before, bool higherIsBetter) {
+        double change = relativeChange(now, before);
+        bool regressed = higherIsBetter ? change < -tolerance : change > tolerance;
+        out << "  " << name << ": " << before << " -> " << now << " ("
+            << (change >= 0 ? "+" : "") << change * 100.0 << "%)"
+            << (regressed ? " REGRESSED" : "") << "\n";
+        ok = ok && !regressed;
+    };
+
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+    out << std::fixed << std::setprecision(3);
+
+    out << "baseline comparison for " << current.scene << ":\n";
+    check("fps", current.fps, baseline.fps, true);
+    check("record p50 ms", current.recordP50Ms, baseline.recordP50Ms, false);
+    check("peak rss KiB", current.peakResidentKiB, baseline.peakResidentKiB, false);
+    check("peak gpu bytes", current.peakGpuBytes, baseline.peakGpuBytes, false);
+
+    out.copyfmt(flags);
+    return ok;
+}
+
+uint64_t peakResidentKiB() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // Linux reports kilobytes (macOS would report bytes)
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
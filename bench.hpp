@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+/*
+    One benchmark run. Stored as a CSV row so results from many runs and
+    machines can be appended to one file and diffed or plotted.
+*/
+struct BenchResult {
+    // Identifies the scene, e.g. t100000_d1000_800x600
+    std::string scene;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t triangles = 0;
+    uint32_t draws = 0;
+    uint64_t frames = 0;
+    double seconds = 0.0;
+    double fps = 0.0;
+    double recordP50Ms = 0.0;
+    double recordP95Ms = 0.0;
+    double submitP50Ms = 0.0;
+    double submitP95Ms = 0.0;
+    // Making the frame's command buffers recordable again, pool or buffer
+    // reset (see CommandReset)
+    double resetP50Ms = 0.0;
+    double resetP95Ms = 0.0;
+    double gpuP50Ms = 0.0;
+    uint64_t peakResidentKiB = 0;
+    uint64_t peakGpuBytes = 0;
+};
+
+// Appends result, writing the header first if the file is new or empty
+void appendBenchResult(const std::string& path, const BenchResult& result);
+
+// The last row for scene in the file, if the file and such a row exist
+std::optional<BenchResult> findBenchResult(
+    const std::string& path,
+    const std::string& scene
+);
+
+/*
+    Prints current against baseline. Returns false if the run regressed by
+    more than tolerance (0.15 = 15%): lower fps, or higher record time or
+    peak memory.
+*/
+bool compareBenchResult(
+    const BenchResult& current,
+    const BenchResult& baseline,
+    double tolerance,
+    std::ostream& out
+);
+
+// High water mark of this process's resident memory
+uint64_t peakResidentKiB();
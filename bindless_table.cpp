@@ -0,0 +1,144 @@
+#include "bindless_table.hpp"
+
+#include <array>
+#include <stdexcept>
+
+BindlessTable::BindlessTable(
+    VkDevice device,
+    uint32_t maxBuffers,
+    uint32_t maxImages
+) : device(device), maxBuffers(maxBuffers), maxImages(maxImages) {
+    // Block textures: repeated across greedy quads, and kept crisp
+    VkSamplerCreateInfo samplerInfo {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .maxLod = VK_LOD_CLAMP_NONE
+    };
+    if(vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless sampler!");
+    }
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {{
+        {
+            .binding = BUFFER_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = maxBuffers,
+            .stageFlags = stages
+        },
+        {
+            .binding = IMAGE_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+            .descriptorCount = maxImages,
+            .stageFlags = stages
+        },
+        {
+            .binding = SAMPLER_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = stages,
+            .pImmutableSamplers = &sampler
+        }
+    }};
+    VkDescriptorBindingFlags arrayFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+        | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT
+        | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+    std::array<VkDescriptorBindingFlags, 3> bindingFlags = {{ arrayFlags, arrayFlags, 0 }};
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+        .pBindingFlags = bindingFlags.data()
+    };
+    VkDescriptorSetLayoutCreateInfo layoutInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &bindingFlagsInfo,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data()
+    };
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {{
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxBuffers },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, maxImages },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 1 }
+    }};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data()
+    };
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout
+    };
+    if(vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+}
+
+BindlessTable::~BindlessTable() {
+    // Frees the set
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
+}
+
+uint32_t BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    if(bufferCount == maxBuffers) {
+        throw std::runtime_error("bindless buffer table is full");
+    }
+    VkDescriptorBufferInfo bufferInfo {
+        .buffer = buffer,
+        .offset = offset,
+        .range = range
+    };
+    VkWriteDescriptorSet write {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = descriptorSet,
+        .dstBinding = BUFFER_BINDING,
+        .dstArrayElement = bufferCount,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &bufferInfo
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    return bufferCount++;
+}
+
+uint32_t BindlessTable::addImage(VkImageView view) {
+    if(imageCount == maxImages) {
+        throw std::runtime_error("bindless image table is full");
+    }
+    VkDescriptorImageInfo imageInfo {
+        .sampler = VK_NULL_HANDLE,
+        .imageView = view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+    VkWriteDescriptorSet write {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = descriptorSet,
+        .dstBinding = IMAGE_BINDING,
+        .dstArrayElement = imageCount,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        .pImageInfo = &imageInfo
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    return imageCount++;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/*
+    One descriptor set holding every buffer and texture the shaders look up
+    by index (VK_EXT_descriptor_indexing):
+    - binding 0: storage buffers, readonly buffer ... buffers[];
+    - binding 1: sampled images, texture2D textures[];
+    - binding 2: one immutable sampler shared by all of them.
+
+    The set is bound once per pass and never changes, so draws need no
+    descriptor binds of their own; a draw's material ID picks its data.
+
+    The arrays are UPDATE_AFTER_BIND and PARTIALLY_BOUND: entries are only
+    written as resources are added, and may be written while command
+    buffers using the set are pending (UPDATE_UNUSED_WHILE_PENDING), as long
+    as those command buffers do not use the new entries. Entries are never
+    removed.
+*/
+class BindlessTable {
+public:
+    static constexpr uint32_t BUFFER_BINDING = 0;
+    static constexpr uint32_t IMAGE_BINDING = 1;
+    static constexpr uint32_t SAMPLER_BINDING = 2;
+
+    // Capacities must be within the device's update-after-bind limits
+    BindlessTable(VkDevice device, uint32_t maxBuffers, uint32_t maxImages);
+    // The device must be idle
+    ~BindlessTable();
+
+    BindlessTable(const BindlessTable&) = delete;
+    BindlessTable& operator=(const BindlessTable&) = delete;
+
+    VkDescriptorSetLayout setLayout() const {
+        return layout;
+    }
+    VkDescriptorSet set() const {
+        return descriptorSet;
+    }
+
+    // The index the shaders find it at. Throws when the table is full.
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+    // Sampled in SHADER_READ_ONLY_OPTIMAL
+    uint32_t addImage(VkImageView view);
+
+private:
+    VkDevice device;
+    uint32_t maxBuffers;
+    uint32_t maxImages;
+    uint32_t bufferCount = 0;
+    uint32_t imageCount = 0;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+};
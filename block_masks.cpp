@@ -0,0 +1,251 @@
+#include "block_masks.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLOCK_MASKS_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+    Each level comes as a pair of kernels:
+    - solid rows: one bit per non-air block for `count` rows of CHUNK_SIZE
+      consecutive bytes;
+    - faces: the AND-NOTs of every row of the chunk against its six
+      neighbours.
+    The SIMD versions are compiled for their instruction set with target
+    attributes, so the rest of the build stays baseline and picks a kernel
+    at runtime.
+*/
+
+static_assert(CHUNK_SIZE == 32, "kernels process a row as 32 bytes");
+
+// Chunk blocks of a row, without the border bits
+constexpr uint64_t INNER_BITS = 0xffffffffULL << 1;
+
+static void solidRowsScalar(const BlockId* blocks, int count, uint32_t* bits) {
+    for(int row = 0; row < count; row++) {
+        uint32_t mask = 0;
+        for(int x = 0; x < CHUNK_SIZE; x++) {
+            mask |= uint32_t(blocks[x] != BLOCK_AIR) << x;
+        }
+        bits[row] = mask;
+        blocks += CHUNK_SIZE;
+    }
+}
+
+static void faceRowsScalar(const SolidMasks& solid, FaceMasks& faces) {
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            uint64_t s = solid.rows[y + 1][z + 1];
+            uint64_t inner = s & INNER_BITS;
+            faces.rows[static_cast<int>(Face::PosX)][y][z] = (inner & ~(s >> 1)) >> 1;
+            faces.rows[static_cast<int>(Face::NegX)][y][z] = (inner & ~(s << 1)) >> 1;
+            faces.rows[static_cast<int>(Face::PosY)][y][z] = (inner & ~solid.rows[y + 2][z + 1]) >> 1;
+            faces.rows[static_cast<int>(Face::NegY)][y][z] = (inner & ~solid.rows[y][z + 1]) >> 1;
+            faces.rows[static_cast<int>(Face::PosZ)][y][z] = (inner & ~solid.rows[y + 1][z + 2]) >> 1;
+            faces.rows[static_cast<int>(Face::NegZ)][y][z] = (inner & ~solid.rows[y + 1][z]) >> 1;
+        }
+    }
+}
+
+#ifdef BLOCK_MASKS_X86
+
+// Compare 16 bytes to zero and gather their top bits: 16 air flags at once
+__attribute__((target("sse2")))
+static void solidRowsSse2(const BlockId* blocks, int count, uint32_t* bits) {
+    const __m128i zero = _mm_setzero_si128();
+    for(int row = 0; row < count; row++) {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16));
+        uint32_t air = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, zero)))
+            | static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero))) << 16;
+        bits[row] = ~air;
+        blocks += CHUNK_SIZE;
+    }
+}
+
+__attribute__((target("sse2")))
+static inline __m128i loadSse2(const uint64_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// Two rows (consecutive z) per iteration
+__attribute__((target("sse2")))
+static void faceRowsSse2(const SolidMasks& solid, FaceMasks& faces) {
+    const __m128i innerBits = _mm_set1_epi64x(static_cast<long long>(INNER_BITS));
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z += 2) {
+            __m128i s = loadSse2(&solid.rows[y + 1][z + 1]);
+            __m128i inner = _mm_and_si128(s, innerBits);
+            __m128i hidden[6] = {
+                _mm_srli_epi64(s, 1),
+                _mm_slli_epi64(s, 1),
+                loadSse2(&solid.rows[y + 2][z + 1]),
+                loadSse2(&solid.rows[y][z + 1]),
+                loadSse2(&solid.rows[y + 1][z + 2]),
+                loadSse2(&solid.rows[y + 1][z])
+            };
+            for(int f = 0; f < 6; f++) {
+                _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(&faces.rows[f][y][z]),
+                    _mm_srli_epi64(_mm_andnot_si128(hidden[f], inner), 1)
+                );
+            }
+        }
+    }
+}
+
+// A whole row in one compare
+__attribute__((target("avx2")))
+static void solidRowsAvx2(const BlockId* blocks, int count, uint32_t* bits) {
+    const __m256i zero = _mm256_setzero_si256();
+    for(int row = 0; row < count; row++) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks));
+        bits[row] = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)));
+        blocks += CHUNK_SIZE;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i loadAvx2(const uint64_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+// Four rows per iteration
+__attribute__((target("avx2")))
+static void faceRowsAvx2(const SolidMasks& solid, FaceMasks& faces) {
+    const __m256i innerBits = _mm256_set1_epi64x(static_cast<long long>(INNER_BITS));
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z += 4) {
+            __m256i s = loadAvx2(&solid.rows[y + 1][z + 1]);
+            __m256i inner = _mm256_and_si256(s, innerBits);
+            __m256i hidden[6] = {
+                _mm256_srli_epi64(s, 1),
+                _mm256_slli_epi64(s, 1),
+                loadAvx2(&solid.rows[y + 2][z + 1]),
+                loadAvx2(&solid.rows[y][z + 1]),
+                loadAvx2(&solid.rows[y + 1][z + 2]),
+                loadAvx2(&solid.rows[y + 1][z])
+            };
+            for(int f = 0; f < 6; f++) {
+                _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(&faces.rows[f][y][z]),
+                    _mm256_srli_epi64(_mm256_andnot_si256(hidden[f], inner), 1)
+                );
+            }
+        }
+    }
+}
+
+#endif
+
+SimdLevel detectSimdLevel() {
+#ifdef BLOCK_MASKS_X86
+    static const SimdLevel level = []() {
+        if(__builtin_cpu_supports("avx2")) {
+            return SimdLevel::Avx2;
+        }
+        if(__builtin_cpu_supports("sse2")) {
+            return SimdLevel::Sse2;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel defaultSimdLevel() {
+    return std::min(detectSimdLevel(), SimdLevel::Sse2);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch(level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::Sse2: return "sse2";
+        case SimdLevel::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+static void solidRows(const BlockId* blocks, int count, uint32_t* bits, SimdLevel level) {
+    switch(level) {
+#ifdef BLOCK_MASKS_X86
+        case SimdLevel::Avx2:
+            solidRowsAvx2(blocks, count, bits);
+            return;
+        case SimdLevel::Sse2:
+            solidRowsSse2(blocks, count, bits);
+            return;
+#endif
+        default:
+            solidRowsScalar(blocks, count, bits);
+            return;
+    }
+}
+
+void buildSolidMasks(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    SolidMasks& masks,
+    SimdLevel level
+) {
+    std::memset(&masks, 0, sizeof(masks));
+
+    // Rows are contiguous in the chunk, y major then z: one kernel call
+    uint32_t bits[CHUNK_SIZE * CHUNK_SIZE];
+    solidRows(chunk.data(), CHUNK_SIZE * CHUNK_SIZE, bits, level);
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            masks.rows[y + 1][z + 1] = uint64_t(bits[z + y * CHUNK_SIZE]) << 1;
+        }
+    }
+
+    // Border bits from the x neighbours
+    const Chunk* negX = neighbors.chunks[static_cast<int>(Face::NegX)];
+    const Chunk* posX = neighbors.chunks[static_cast<int>(Face::PosX)];
+    for(int y = 0; negX != nullptr && y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            masks.rows[y + 1][z + 1] |= uint64_t(negX->get(CHUNK_SIZE - 1, y, z) != BLOCK_AIR);
+        }
+    }
+    for(int y = 0; posX != nullptr && y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            masks.rows[y + 1][z + 1] |= uint64_t(posX->get(0, y, z) != BLOCK_AIR) << (CHUNK_SIZE + 1);
+        }
+    }
+
+    // Border rows from the z neighbours
+    const Chunk* negZ = neighbors.chunks[static_cast<int>(Face::NegZ)];
+    const Chunk* posZ = neighbors.chunks[static_cast<int>(Face::PosZ)];
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        uint32_t row;
+        if(negZ != nullptr) {
+            solidRows(negZ->data() + Chunk::index(0, y, CHUNK_SIZE - 1), 1, &row, level);
+            masks.rows[y + 1][0] = uint64_t(row) << 1;
+        }
+        if(posZ != nullptr) {
+            solidRows(posZ->data() + Chunk::index(0, y, 0), 1, &row, level);
+            masks.rows[y + 1][CHUNK_SIZE + 1] = uint64_t(row) << 1;
+        }
+    }
+}
+
+void computeFaceMasks(const SolidMasks& solid, FaceMasks& faces, SimdLevel level) {
+    switch(level) {
+#ifdef BLOCK_MASKS_X86
+        case SimdLevel::Avx2:
+            faceRowsAvx2(solid, faces);
+            return;
+        case SimdLevel::Sse2:
+            faceRowsSse2(solid, faces);
+            return;
+#endif
+        default:
+            faceRowsScalar(solid, faces);
+            return;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "chunk.hpp"
+#include "mesher.hpp"
+
+// Instruction sets the mask kernels can use, slowest first
+enum class SimdLevel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// The highest level this CPU supports, checked once
+SimdLevel detectSimdLevel();
+/*
+    The level greedyMesh uses: SSE2 where the CPU has it, even with AVX2.
+    VoxelBench times the kernels at every level; SSE2 already takes them
+    from ~60us to ~13us per chunk, and AVX2 saves only ~4us more, while
+    256-bit code can lower the clock on some CPUs for the greedy walk that
+    dominates meshing, which measured slower overall on noise.
+*/
+SimdLevel defaultSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+/*
+    One bit per block, a 64-bit word per row of CHUNK_SIZE blocks along x.
+
+    Rows are indexed [y + 1][z + 1] and bit x + 1 is block x, with a
+    one block border all round taken from the neighbour chunks: bits 0 and
+    CHUNK_SIZE + 1 hold the -x and +x neighbours, rows z = -1 and
+    z = CHUNK_SIZE the -z and +z ones. Above and below is always air.
+
+    With the border in place, whether a face is visible is one shift or row
+    lookup and an AND-NOT for 32 blocks at once, with no bounds checks.
+*/
+struct SolidMasks {
+    uint64_t rows[CHUNK_SIZE + 2][CHUNK_SIZE + 2];
+};
+
+// Visible faces for each Face, [face][y][z], bit x set when block x has one
+struct FaceMasks {
+    uint64_t rows[6][CHUNK_SIZE][CHUNK_SIZE];
+};
+
+void buildSolidMasks(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    SolidMasks& masks,
+    SimdLevel level
+);
+
+void computeFaceMasks(const SolidMasks& solid, FaceMasks& faces, SimdLevel level);
+
+// greedyMesh with a given kernel level, to compare levels against each other
+void greedyMeshMasks(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads,
+    SimdLevel level
+);
@@ -0,0 +1,68 @@
+#include "chunk.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool Chunk::isEmpty() const {
+    return std::all_of(blocks.begin(), blocks.end(), [](BlockId block) {
+        return block == BLOCK_AIR;
+    });
+}
+
+// Integer hash of a lattice point to [0, 1)
+static float latticeValue(int32_t x, int32_t z, uint32_t seed) {
+    uint32_t h = seed;
+    h ^= static_cast<uint32_t>(x) * 0x27d4eb2dU;
+    h ^= static_cast<uint32_t>(z) * 0x165667b1U;
+    h ^= h >> 15;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return (h & 0xffffff) / float(0x1000000);
+}
+
+// Smoothly interpolated value noise with lattice spacing `scale` blocks
+static float valueNoise(int32_t x, int32_t z, int32_t scale, uint32_t seed) {
+    // Floor division, so negative coordinates continue the same lattice
+    int32_t cellX = x >= 0 ? x / scale : (x - scale + 1) / scale;
+    int32_t cellZ = z >= 0 ? z / scale : (z - scale + 1) / scale;
+    float fx = float(x - cellX * scale) / scale;
+    float fz = float(z - cellZ * scale) / scale;
+    // smoothstep
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+
+    float a = latticeValue(cellX, cellZ, seed);
+    float b = latticeValue(cellX + 1, cellZ, seed);
+    float c = latticeValue(cellX, cellZ + 1, seed);
+    float d = latticeValue(cellX + 1, cellZ + 1, seed);
+    return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+void generateTerrain(Chunk& chunk, int32_t chunkX, int32_t chunkZ, uint32_t seed) {
+    chunk.fill(BLOCK_AIR);
+
+    for(int z = 0; z < CHUNK_SIZE; z++) {
+        for(int x = 0; x < CHUNK_SIZE; x++) {
+            int32_t worldX = chunkX * CHUNK_SIZE + x;
+            int32_t worldZ = chunkZ * CHUNK_SIZE + z;
+
+            // Two octaves: broad hills plus some bumpiness
+            float height = 4.0f
+                + 18.0f * valueNoise(worldX, worldZ, 24, seed)
+                + 6.0f * valueNoise(worldX, worldZ, 7, seed ^ 0x9e3779b9U);
+            int top = std::clamp(static_cast<int>(height), 1, CHUNK_SIZE - 1);
+
+            for(int y = 0; y < top; y++) {
+                BlockId block = BLOCK_STONE;
+                if(y == top - 1) {
+                    block = BLOCK_GRASS;
+                } else if(y >= top - 4) {
+                    block = BLOCK_DIRT;
+                }
+                chunk.set(x, y, z, block);
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+constexpr int CHUNK_SIZE = 32;
+constexpr int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// 0 is air, every other value an opaque block type
+using BlockId = uint8_t;
+constexpr BlockId BLOCK_AIR = 0;
+constexpr BlockId BLOCK_STONE = 1;
+constexpr BlockId BLOCK_DIRT = 2;
+constexpr BlockId BLOCK_GRASS = 3;
+
+/*
+    A CHUNK_SIZE^3 cube of blocks in one flat array, 32KiB at a byte per
+    block. x varies fastest, then z, then y, so a horizontal slice is one
+    contiguous 1KiB run and walking along x touches consecutive bytes.
+*/
+class Chunk {
+public:
+    static int index(int x, int y, int z) {
+        return x + CHUNK_SIZE * (z + CHUNK_SIZE * y);
+    }
+
+    BlockId get(int x, int y, int z) const {
+        return blocks[index(x, y, z)];
+    }
+    void set(int x, int y, int z, BlockId block) {
+        blocks[index(x, y, z)] = block;
+    }
+
+    const BlockId* data() const {
+        return blocks.data();
+    }
+    BlockId* data() {
+        return blocks.data();
+    }
+
+    void fill(BlockId block) {
+        blocks.fill(block);
+    }
+    bool isEmpty() const;
+
+private:
+    std::array<BlockId, CHUNK_VOLUME> blocks{};
+};
+
+/*
+    Rolling hills for benchmarks and the demo scene: stone, a few blocks of
+    dirt and a grass top. Deterministic in the chunk position and seed, and
+    continuous across chunk borders.
+*/
+void generateTerrain(Chunk& chunk, int32_t chunkX, int32_t chunkZ, uint32_t seed);
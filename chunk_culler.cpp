@@ -0,0 +1,772 @@
+#include "chunk_culler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "chunk.hpp"
+
+// Must match local_size_x in cull.comp
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+// Must match local_size_x and local_size_y in hiz.comp
+constexpr uint32_t HIZ_GROUP_SIZE = 8;
+
+// Must match CullConstants in cull.comp
+struct CullConstants {
+    glm::mat4 viewProjection;
+    uint32_t chunkCount;
+    uint32_t chunkCapacity;
+    uint32_t phase;
+    uint32_t pyramidLevels;
+    uint32_t pyramidSize[2];
+};
+
+// Must match HiZConstants in hiz.comp
+struct HiZConstants {
+    uint32_t sourceSize[2];
+    uint32_t destinationSize[2];
+};
+
+// Must match Counts in cull.comp
+static_assert(sizeof(CullCounts) == 4 * sizeof(uint32_t), "CullCounts must match cull.comp");
+
+ChunkCuller::ChunkCuller(
+    VkDevice device,
+    GpuAllocator& allocator,
+    VkPipelineCache pipelineCache,
+    VkShaderModule cullShader,
+    VkShaderModule hizShader,
+    uint32_t gridSide,
+    uint32_t slotCount,
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+    bool multiDrawIndirect
+) : device(device),
+    allocator(allocator),
+    gridSide(gridSide),
+    maxChunks(gridSide * gridSide),
+    drawIndexedIndirectCount(drawIndexedIndirectCount),
+    multiDrawIndirect(multiDrawIndirect),
+    slots(slotCount) {
+    // Records, commands, counts, visibility, then the pyramid
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings;
+    for(uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = i == 4
+                ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        };
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data()
+    };
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * slotCount },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slotCount }
+    }};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = slotCount,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data()
+    };
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull descriptor pool!");
+    }
+
+    VkPushConstantRange pushConstantRange {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(CullConstants)
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = VkPipelineShaderStageCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = cullShader,
+            .pName = "main"
+        },
+        .layout = pipelineLayout
+    };
+    if(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline!");
+    }
+
+    if(hizShader != VK_NULL_HANDLE) {
+        // Source level (or depth), destination level
+        std::array<VkDescriptorSetLayoutBinding, 2> hizBindings = {{
+            {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            }
+        }};
+        VkDescriptorSetLayoutCreateInfo hizLayoutInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = static_cast<uint32_t>(hizBindings.size()),
+            .pBindings = hizBindings.data()
+        };
+        if(vkCreateDescriptorSetLayout(device, &hizLayoutInfo, nullptr, &hizSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create Hi-Z descriptor set layout!");
+        }
+
+        VkPushConstantRange hizPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(HiZConstants)
+        };
+        VkPipelineLayoutCreateInfo hizPipelineLayoutInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &hizSetLayout,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &hizPushConstantRange
+        };
+        if(vkCreatePipelineLayout(device, &hizPipelineLayoutInfo, nullptr, &hizPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create Hi-Z pipeline layout!");
+        }
+
+        VkComputePipelineCreateInfo hizPipelineInfo {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = VkPipelineShaderStageCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = hizShader,
+                .pName = "main"
+            },
+            .layout = hizPipelineLayout
+        };
+        if(vkCreateComputePipelines(device, pipelineCache, 1, &hizPipelineInfo, nullptr, &hizPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create Hi-Z pipeline!");
+        }
+    }
+
+    // Only ever read with texelFetch, but combined image samplers need one
+    VkSamplerCreateInfo samplerInfo {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = VK_LOD_CLAMP_NONE
+    };
+    if(vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create Hi-Z sampler!");
+    }
+
+    visibility = allocator.createBuffer(
+        sizeof(uint32_t) * maxChunks,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        visibilityAllocation
+    );
+    pyramid = createPyramid(VkExtent2D { 1, 1 });
+
+    std::vector<VkDescriptorSetLayout> setLayouts(slotCount, descriptorSetLayout);
+    std::vector<VkDescriptorSet> sets(slotCount);
+    VkDescriptorSetAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = descriptorPool,
+        .descriptorSetCount = slotCount,
+        .pSetLayouts = setLayouts.data()
+    };
+    if(vkAllocateDescriptorSets(device, &allocateInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate cull descriptor sets!");
+    }
+
+    for(uint32_t i = 0; i < slotCount; i++) {
+        Slot& slot = slots[i];
+        slot.descriptorSet = sets[i];
+        // Written by the CPU every frame
+        slot.records = allocator.createBuffer(
+            sizeof(ChunkRecord) * maxChunks,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            slot.recordAllocation
+        );
+        // Only ever touched by the GPU: the early list, then the late one
+        slot.commands = allocator.createBuffer(
+            2 * sizeof(VkDrawIndexedIndirectCommand) * maxChunks,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            slot.commandAllocation
+        );
+        // Host visible so the counts can be checked against the CPU reference
+        slot.count = allocator.createBuffer(
+            sizeof(CullCounts),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            slot.countAllocation
+        );
+        std::memset(slot.countAllocation.mapped, 0, sizeof(CullCounts));
+
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos = {{
+            { slot.records, 0, VK_WHOLE_SIZE },
+            { slot.commands, 0, VK_WHOLE_SIZE },
+            { slot.count, 0, VK_WHOLE_SIZE },
+            { visibility, 0, VK_WHOLE_SIZE }
+        }};
+        VkDescriptorImageInfo pyramidInfo {
+            .sampler = sampler,
+            .imageView = pyramid.view,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+        std::array<VkWriteDescriptorSet, 5> writes;
+        for(uint32_t b = 0; b < bufferInfos.size(); b++) {
+            writes[b] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = slot.descriptorSet,
+                .dstBinding = b,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &bufferInfos[b]
+            };
+        }
+        writes[4] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = slot.descriptorSet,
+            .dstBinding = 4,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &pyramidInfo
+        };
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+ChunkCuller::~ChunkCuller() {
+    for(Slot& slot : slots) {
+        allocator.destroyBuffer(slot.records, slot.recordAllocation);
+        allocator.destroyBuffer(slot.commands, slot.commandAllocation);
+        allocator.destroyBuffer(slot.count, slot.countAllocation);
+    }
+    allocator.destroyBuffer(visibility, visibilityAllocation);
+    collect(UINT64_MAX);
+    destroyPyramid(pyramid);
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyPipeline(device, hizPipeline, nullptr);
+    vkDestroyPipelineLayout(device, hizPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, hizSetLayout, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    // Frees its sets
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+void ChunkCuller::setChunks(uint32_t index, const std::vector<ChunkDraw>& draws) {
+    if(draws.size() > maxChunks) {
+        throw std::runtime_error("more chunks than the culler has room for");
+    }
+    Slot& slot = slots[index];
+    ChunkRecord* records = static_cast<ChunkRecord*>(slot.recordAllocation.mapped);
+    for(size_t i = 0; i < draws.size(); i++) {
+        /*
+            Chunk coordinates wrapped to the grid: a chunk keeps its id for
+            as long as it stays in view, and chunks within gridSide of each
+            other never share one. A chunk that inherits a leaving one's id
+            can only be drawn early once for nothing, never skipped.
+        */
+        int32_t chunkX = static_cast<int32_t>(std::floor(draws[i].origin.x / CHUNK_SIZE));
+        int32_t chunkZ = static_cast<int32_t>(std::floor(draws[i].origin.z / CHUNK_SIZE));
+        int32_t side = static_cast<int32_t>(gridSide);
+        uint32_t id = static_cast<uint32_t>((chunkX % side + side) % side + (chunkZ % side + side) % side * side);
+        records[i] = ChunkRecord {
+            .origin = draws[i].origin,
+            .indexCount = draws[i].indexCount,
+            .firstIndex = draws[i].firstIndex,
+            .vertexOffset = draws[i].vertexOffset,
+            .id = id
+        };
+    }
+    slot.chunkCount = static_cast<uint32_t>(draws.size());
+}
+
+ChunkCuller::Pyramid ChunkCuller::createPyramid(VkExtent2D size) {
+    Pyramid created;
+    created.size = size;
+    created.levels = 1;
+    while((std::max(size.width, size.height) >> created.levels) > 0) {
+        created.levels++;
+    }
+
+    VkImageCreateInfo imageInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R32_SFLOAT,
+        .extent = { size.width, size.height, 1 },
+        .mipLevels = created.levels,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    created.image = allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, created.allocation);
+    created.fresh = true;
+
+    // The whole pyramid for the cull, then one view per level for hiz.comp
+    for(uint32_t level = 0; level <= created.levels; level++) {
+        VkImageViewCreateInfo viewInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = created.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R32_SFLOAT,
+            .subresourceRange = VkImageSubresourceRange {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = level == 0 ? 0 : level - 1,
+                .levelCount = level == 0 ? created.levels : 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+        VkImageView view;
+        if(vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create Hi-Z pyramid view!");
+        }
+        if(level == 0) {
+            created.view = view;
+        } else {
+            created.levelViews.push_back(view);
+        }
+    }
+    return created;
+}
+
+void ChunkCuller::destroyPyramid(Pyramid& retired) {
+    // Frees its sets
+    vkDestroyDescriptorPool(device, retired.descriptorPool, nullptr);
+    for(VkImageView view : retired.levelViews) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    vkDestroyImageView(device, retired.view, nullptr);
+    allocator.destroyImage(retired.image, retired.allocation);
+    retired = Pyramid{};
+}
+
+void ChunkCuller::setDepthSource(VkImageView depthView, VkExtent2D extent, uint64_t frame) {
+    if(hizPipeline == VK_NULL_HANDLE) {
+        throw std::runtime_error("culler was created without occlusion culling");
+    }
+
+    // Level 0 is the largest power of two that fits, so every level halves
+    // exactly and hiz.comp only has to round at the first one
+    VkExtent2D size = { 1, 1 };
+    while(size.width * 2 <= extent.width) {
+        size.width *= 2;
+    }
+    while(size.height * 2 <= extent.height) {
+        size.height *= 2;
+    }
+    Pyramid next = createPyramid(size);
+    next.depthSize = extent;
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, next.levels },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, next.levels }
+    }};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = next.levels,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data()
+    };
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &next.descriptorPool) != VK_SUCCESS) {
+        destroyPyramid(next);
+        throw std::runtime_error("failed to create Hi-Z descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts(next.levels, hizSetLayout);
+    next.hizSets.assign(next.levels, VK_NULL_HANDLE);
+    VkDescriptorSetAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = next.descriptorPool,
+        .descriptorSetCount = next.levels,
+        .pSetLayouts = setLayouts.data()
+    };
+    if(vkAllocateDescriptorSets(device, &allocateInfo, next.hizSets.data()) != VK_SUCCESS) {
+        destroyPyramid(next);
+        throw std::runtime_error("failed to allocate Hi-Z descriptor sets!");
+    }
+
+    for(uint32_t level = 0; level < next.levels; level++) {
+        VkDescriptorImageInfo source {
+            .sampler = sampler,
+            .imageView = level == 0 ? depthView : next.levelViews[level - 1],
+            .imageLayout = level == 0
+                ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                : VK_IMAGE_LAYOUT_GENERAL
+        };
+        VkDescriptorImageInfo destination {
+            .imageView = next.levelViews[level],
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+        std::array<VkWriteDescriptorSet, 2> writes = {{
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = next.hizSets[level],
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .pImageInfo = &source
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = next.hizSets[level],
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &destination
+            }
+        }};
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // Frames in flight keep reading the old pyramid through their sets
+    retiredPyramids.push_back(RetiredPyramid { pyramid, frame });
+    pyramid = next;
+    pyramidGeneration++;
+}
+
+void ChunkCuller::collect(uint64_t completedFrames) {
+    while(!retiredPyramids.empty() && retiredPyramids.front().retiredAtFrame <= completedFrames) {
+        destroyPyramid(retiredPyramids.front().pyramid);
+        retiredPyramids.pop_front();
+    }
+}
+
+void ChunkCuller::recordCull(
+    VkCommandBuffer commandBuffer,
+    uint32_t index,
+    const glm::mat4& viewProjection,
+    CullPhase phase
+) {
+    Slot& slot = slots[index];
+
+    // The slot's last frame is done, so its set can take the new pyramid
+    if(slot.pyramidGeneration != pyramidGeneration) {
+        VkDescriptorImageInfo pyramidInfo {
+            .sampler = sampler,
+            .imageView = pyramid.view,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+        VkWriteDescriptorSet write {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = slot.descriptorSet,
+            .dstBinding = 4,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &pyramidInfo
+        };
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+        slot.pyramidGeneration = pyramidGeneration;
+    }
+
+    vkCmdFillBuffer(commandBuffer, slot.count, 0, sizeof(CullCounts), 0);
+    if(!usesDrawIndirectCount()) {
+        // Every slot is drawn, so the ones past the count must be empty
+        vkCmdFillBuffer(commandBuffer, slot.commands, 0, VK_WHOLE_SIZE, 0);
+    }
+    if(!visibilityCleared) {
+        vkCmdFillBuffer(commandBuffer, visibility, 0, VK_WHOLE_SIZE, 0);
+        visibilityCleared = true;
+    }
+    /*
+        Besides the fills, the visibility flags and the pyramid are shared
+        with earlier frames: wait for their cull and Hi-Z dispatches.
+    */
+    VkMemoryBarrier clearBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    // The pyramid is only ever in GENERAL; even the placeholder is bound
+    VkImageMemoryBarrier pyramidBarrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = pyramid.image,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levels, 0, 1 }
+    };
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &clearBarrier,
+        0,
+        nullptr,
+        pyramid.fresh ? 1u : 0u,
+        &pyramidBarrier
+    );
+    pyramid.fresh = false;
+
+    dispatchCull(commandBuffer, slot, viewProjection, phase);
+
+    VkMemoryBarrier cullBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT
+    };
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1,
+        &cullBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+}
+
+void ChunkCuller::dispatchCull(
+    VkCommandBuffer commandBuffer,
+    const Slot& slot,
+    const glm::mat4& viewProjection,
+    CullPhase phase
+) {
+    CullConstants constants {
+        .viewProjection = viewProjection,
+        .chunkCount = slot.chunkCount,
+        .chunkCapacity = maxChunks,
+        .phase = static_cast<uint32_t>(phase),
+        .pyramidLevels = pyramid.levels,
+        .pyramidSize = { pyramid.size.width, pyramid.size.height }
+    };
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        pipelineLayout,
+        0,
+        1,
+        &slot.descriptorSet,
+        0,
+        nullptr
+    );
+    vkCmdPushConstants(
+        commandBuffer,
+        pipelineLayout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+    if(slot.chunkCount > 0) {
+        vkCmdDispatch(commandBuffer, (slot.chunkCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+}
+
+void ChunkCuller::recordOcclusion(
+    VkCommandBuffer commandBuffer,
+    uint32_t index,
+    VkImage depthImage,
+    VkImageAspectFlags depthAspects,
+    const glm::mat4& viewProjection
+) {
+    const Slot& slot = slots[index];
+
+    // The early draws' depth, and the early cull's visibility flags
+    VkMemoryBarrier earlyBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    VkImageMemoryBarrier depthBarrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = depthImage,
+        .subresourceRange = { depthAspects, 0, 1, 0, 1 }
+    };
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &earlyBarrier,
+        0,
+        nullptr,
+        1,
+        &depthBarrier
+    );
+
+    // One dispatch per level, each reading the one before
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hizPipeline);
+    VkExtent2D source = pyramid.depthSize;
+    VkExtent2D destination = pyramid.size;
+    for(uint32_t level = 0; level < pyramid.levels; level++) {
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            hizPipelineLayout,
+            0,
+            1,
+            &pyramid.hizSets[level],
+            0,
+            nullptr
+        );
+        HiZConstants constants {
+            .sourceSize = { source.width, source.height },
+            .destinationSize = { destination.width, destination.height }
+        };
+        vkCmdPushConstants(
+            commandBuffer,
+            hizPipelineLayout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0,
+            sizeof(constants),
+            &constants
+        );
+        vkCmdDispatch(
+            commandBuffer,
+            (destination.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            (destination.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            1
+        );
+
+        VkMemoryBarrier levelBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+        };
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &levelBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr
+        );
+
+        source = destination;
+        destination = VkExtent2D {
+            std::max(destination.width / 2, 1u),
+            std::max(destination.height / 2, 1u)
+        };
+    }
+
+    dispatchCull(commandBuffer, slot, viewProjection, CullPhase::Late);
+
+    // The late draws' commands, and depth back for the late render pass
+    VkMemoryBarrier cullBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT
+    };
+    depthBarrier.srcAccessMask = 0;
+    depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT
+            | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        0,
+        1,
+        &cullBarrier,
+        0,
+        nullptr,
+        1,
+        &depthBarrier
+    );
+}
+
+void ChunkCuller::recordDraws(VkCommandBuffer commandBuffer, uint32_t index, CullPhase list) {
+    const Slot& slot = slots[index];
+    if(slot.chunkCount == 0) {
+        return;
+    }
+
+    bool late = list == CullPhase::Late;
+    VkDeviceSize commandOffset = late ? sizeof(VkDrawIndexedIndirectCommand) * maxChunks : 0;
+    if(usesDrawIndirectCount()) {
+        drawIndexedIndirectCount(
+            commandBuffer,
+            slot.commands,
+            commandOffset,
+            slot.count,
+            late ? offsetof(CullCounts, lateDraws) : offsetof(CullCounts, earlyDraws),
+            slot.chunkCount,
+            sizeof(VkDrawIndexedIndirectCommand)
+        );
+    } else if(multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(
+            commandBuffer,
+            slot.commands,
+            commandOffset,
+            slot.chunkCount,
+            sizeof(VkDrawIndexedIndirectCommand)
+        );
+    } else {
+        for(uint32_t i = 0; i < slot.chunkCount; i++) {
+            vkCmdDrawIndexedIndirect(
+                commandBuffer,
+                slot.commands,
+                commandOffset + i * sizeof(VkDrawIndexedIndirectCommand),
+                1,
+                sizeof(VkDrawIndexedIndirectCommand)
+            );
+        }
+    }
+}
+
+CullCounts ChunkCuller::readCounts(uint32_t index) const {
+    CullCounts counts;
+    std::memcpy(&counts, slots[index].countAllocation.mapped, sizeof(counts));
+    return counts;
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include "chunk_streamer.hpp"
+#include "gpu_allocator.hpp"
+
+/*
+    One candidate chunk, as the cull shader reads it. Also bound as a
+    per-instance vertex buffer, so a draw's firstInstance picks the origin
+    the vertex shader adds. Matches ChunkRecord in shaders/cull.comp.
+*/
+struct ChunkRecord {
+    glm::vec4 origin;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    // Stable while the chunk stays in view, to carry its occlusion result
+    // from one frame to the next; see ChunkCuller::setChunks()
+    uint32_t id;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        return VkVertexInputBindingDescription {
+            .binding = 1,
+            .stride = sizeof(ChunkRecord),
+            .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
+        };
+    }
+
+    // layout(location = 2) in vec4 inChunkOrigin
+    static VkVertexInputAttributeDescription getAttributeDescription() {
+        return VkVertexInputAttributeDescription {
+            .location = 2,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(ChunkRecord, origin)
+        };
+    }
+};
+static_assert(sizeof(ChunkRecord) == 32, "ChunkRecord must match the std430 layout in cull.comp");
+
+// Must match the PHASE_ constants in cull.comp
+enum class CullPhase : uint32_t {
+    // Frustum only, one draw list
+    Frustum = 0,
+    // In the frustum and visible last frame
+    Early = 1,
+    // In the frustum, not hidden behind the early draws' depth and not
+    // drawn early
+    Late = 2
+};
+
+// What the GPU did with a frame's candidates
+struct CullCounts {
+    uint32_t earlyDraws = 0;
+    uint32_t lateDraws = 0;
+    // In the frustum but hidden behind the Hi-Z pyramid
+    uint32_t occluded = 0;
+    // Only counted with occlusion culling
+    uint32_t frustumCulled = 0;
+};
+
+/*
+    Frustum culls chunk draws on the GPU.
+
+    Each frame the candidate chunks are written to a host visible record
+    buffer. A compute pass (shaders/cull.comp) tests every chunk's box
+    against the frustum and appends a VkDrawIndexedIndirectCommand for each
+    one inside, compacted, with an atomic count. The render pass then draws
+    them all with one vkCmdDrawIndexedIndirectCount, so the CPU records the
+    same few commands whether there are ten chunks or ten thousand.
+
+    Without VK_KHR_draw_indirect_count the command buffer is zeroed before
+    the dispatch and vkCmdDrawIndexedIndirect draws every slot; the ones
+    past the count have no instances and draw nothing. Without
+    multiDrawIndirect that becomes one indirect draw per slot.
+
+    Every buffer is per frame slot, so recording a frame never touches what
+    a frame in flight reads.
+
+    Occlusion culling (setDepthSource()) splits the frame in two phases
+    around a Hi-Z pyramid, each level holding the farthest depth of the
+    texels below it:
+    - early: draw the chunks in the frustum that were visible last frame;
+    - build the pyramid from the depth they left (shaders/hiz.comp);
+    - late: test every chunk in the frustum against the pyramid, remember
+      which passed for the next frame, and draw the ones that passed but
+      were not drawn early.
+    Depth from last frame's visible set is a good occluder for this frame,
+    and a chunk that comes into view is caught in the late phase of the
+    same frame, so nothing pops in a frame late. The visibility flags and
+    the pyramid are shared by every slot; barriers order the frames.
+    Recreating the depth image swaps in a new pyramid, and the old one stays
+    alive for the frames still in flight.
+*/
+class ChunkCuller {
+public:
+    ChunkCuller(
+        VkDevice device,
+        GpuAllocator& allocator,
+        VkPipelineCache pipelineCache,
+        VkShaderModule cullShader,
+        // Null without occlusion culling
+        VkShaderModule hizShader,
+        // Candidates lie in a gridSide x gridSide square of chunks
+        uint32_t gridSide,
+        uint32_t slotCount,
+        // Null to fall back to vkCmdDrawIndexedIndirect
+        PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+        bool multiDrawIndirect
+    );
+    // The device must be idle
+    ~ChunkCuller();
+
+    ChunkCuller(const ChunkCuller&) = delete;
+    ChunkCuller& operator=(const ChunkCuller&) = delete;
+
+    // Writes the candidates to the slot's record buffer; at most maxChunks
+    void setChunks(uint32_t slot, const std::vector<ChunkDraw>& draws);
+
+    /*
+        Enables occlusion culling against this depth image view, sized
+        extent, which the early draws render to. Called again whenever the
+        depth image is recreated, without waiting for the device: the new
+        pyramid and its descriptors are used from the frame numbered frame
+        on, and the old ones are retired until collect() sees the frames
+        before it done. Each slot's descriptor set is pointed at the new
+        pyramid when that slot is next recorded.
+    */
+    void setDepthSource(VkImageView depthView, VkExtent2D extent, uint64_t frame);
+
+    // Destroy retired pyramids whose frames are all below completedFrames
+    void collect(uint64_t completedFrames);
+
+    // Per-instance vertex buffer for binding 1, whatever the cull mode
+    VkBuffer recordBuffer(uint32_t slot) const {
+        return slots[slot].records;
+    }
+
+    // Outside a render pass: the Frustum or Early cull dispatch, and the
+    // barrier that makes its commands visible to indirect draws and its
+    // counts to the host
+    void recordCull(
+        VkCommandBuffer commandBuffer,
+        uint32_t slot,
+        const glm::mat4& viewProjection,
+        CullPhase phase
+    );
+
+    /*
+        Between the early and the late render pass: builds the pyramid from
+        depthImage, left in DEPTH_STENCIL_ATTACHMENT_OPTIMAL by the early
+        pass, runs the Late cull and hands the image back in the same layout.
+        depthAspects are all the format's aspects, for the layout changes.
+    */
+    void recordOcclusion(
+        VkCommandBuffer commandBuffer,
+        uint32_t slot,
+        VkImage depthImage,
+        VkImageAspectFlags depthAspects,
+        const glm::mat4& viewProjection
+    );
+
+    // Inside a render pass, with the chunk buffers and recordBuffer()
+    // bound: draws what a cull kept, the early (or only) list or the late one
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t slot, CullPhase list);
+
+    // The slot's last frame; only valid once that frame's fence has signaled
+    CullCounts readCounts(uint32_t slot) const;
+
+    bool usesOcclusion() const {
+        return !pyramid.hizSets.empty();
+    }
+
+    bool usesDrawIndirectCount() const {
+        return drawIndexedIndirectCount != nullptr;
+    }
+
+private:
+    struct Slot {
+        VkBuffer records = VK_NULL_HANDLE;
+        GpuAllocation recordAllocation;
+        VkBuffer commands = VK_NULL_HANDLE;
+        GpuAllocation commandAllocation;
+        VkBuffer count = VK_NULL_HANDLE;
+        GpuAllocation countAllocation;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        uint32_t chunkCount = 0;
+        // Of the pyramid its descriptor set points at
+        uint64_t pyramidGeneration = 0;
+    };
+
+    /*
+        R32_SFLOAT, kept in GENERAL layout, with what builds it from one
+        depth image. A 1x1 placeholder, never sampled, until there is a
+        depth source.
+    */
+    struct Pyramid {
+        VkImage image = VK_NULL_HANDLE;
+        GpuAllocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        std::vector<VkImageView> levelViews;
+        VkExtent2D size = {};
+        VkExtent2D depthSize = {};
+        uint32_t levels = 0;
+        // Still UNDEFINED, to transition on first use
+        bool fresh = false;
+        // One per level: the level below (or depth) in, the level out
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> hizSets;
+    };
+
+    struct RetiredPyramid {
+        Pyramid pyramid;
+        // Frames numbered below this one may still use it
+        uint64_t retiredAtFrame;
+    };
+
+    // Images and views only, sized for the depth source
+    Pyramid createPyramid(VkExtent2D size);
+    void destroyPyramid(Pyramid& retired);
+    void dispatchCull(
+        VkCommandBuffer commandBuffer,
+        const Slot& slot,
+        const glm::mat4& viewProjection,
+        CullPhase phase
+    );
+
+    VkDevice device;
+    GpuAllocator& allocator;
+    uint32_t gridSide;
+    uint32_t maxChunks;
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount;
+    bool multiDrawIndirect;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    std::vector<Slot> slots;
+
+    // Per chunk id: whether it passed the late test last frame
+    VkBuffer visibility = VK_NULL_HANDLE;
+    GpuAllocation visibilityAllocation;
+    // Zero-filled on first use
+    bool visibilityCleared = false;
+
+    VkDescriptorSetLayout hizSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout hizPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline hizPipeline = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    Pyramid pyramid;
+    // Bumped by setDepthSource(), for the slots to catch up with
+    uint64_t pyramidGeneration = 0;
+    std::deque<RetiredPyramid> retiredPyramids;
+};
@@ -0,0 +1,348 @@
+#include "chunk_streamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <utility>
+
+#include "chunk.hpp"
+#include "mesher.hpp"
+
+// Frames before a chunk that did not fit in the budget is tried again
+constexpr uint64_t RETRY_FRAMES = 120;
+// Chunks closer than this many chunk widths are always visible
+constexpr float ALWAYS_VISIBLE_CHUNKS = 2.0f;
+// About cos(70 degrees): a wide cone, so chunks come in before they are on
+// screen and wider windows are covered
+constexpr float VIEW_CONE_COS = 0.34f;
+
+/*
+    Quads take 4 vertices of 8 bytes and 6 indices of 4 bytes, so the budget
+    is split 32:24 between the two buffers. Sizes stay multiples of 8.
+*/
+static VkDeviceSize vertexBudget(VkDeviceSize budgetBytes) {
+    return budgetBytes / 7 * 4 / 8 * 8;
+}
+static VkDeviceSize indexBudget(VkDeviceSize budgetBytes) {
+    return (budgetBytes - vertexBudget(budgetBytes)) / 8 * 8;
+}
+
+ChunkStreamer::ChunkStreamer(
+    GpuAllocator& allocator,
+    UploadScheduler& uploads,
+    JobSystem& jobs,
+    VkDeviceSize budgetBytes,
+    uint32_t viewRadius,
+    uint32_t seed
+) : allocator(allocator),
+    uploads(uploads),
+    jobs(jobs),
+    viewRadius(viewRadius),
+    seed(seed),
+    vertexRanges(vertexBudget(budgetBytes)),
+    indexRanges(indexBudget(budgetBytes)),
+    // A few jobs per thread keeps everyone busy without meshing chunks the
+    // camera has long passed by the time they finish
+    maxPending(4 * (jobs.workerCount() + 1)),
+    meshed(maxPending) {
+    vertices = allocator.createBuffer(
+        vertexRanges.size(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        vertexAllocation
+    );
+    indices = allocator.createBuffer(
+        indexRanges.size(),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        indexAllocation
+    );
+}
+
+ChunkStreamer::~ChunkStreamer() {
+    // The jobs write into meshed; errors have nowhere to go at this point
+    try {
+        jobs.wait(meshing);
+    } catch(...) {
+    }
+
+    allocator.destroyBuffer(vertices, vertexAllocation);
+    allocator.destroyBuffer(indices, indexAllocation);
+}
+
+uint64_t ChunkStreamer::chunkKey(int32_t x, int32_t z) {
+    return uint64_t(uint32_t(x)) << 32 | uint32_t(z);
+}
+int32_t ChunkStreamer::chunkX(uint64_t key) {
+    return static_cast<int32_t>(key >> 32);
+}
+int32_t ChunkStreamer::chunkZ(uint64_t key) {
+    return static_cast<int32_t>(key & 0xffffffff);
+}
+
+bool ChunkStreamer::isVisible(int32_t x, int32_t z, glm::vec3 position, glm::vec3 forward) const {
+    float dx = (x + 0.5f) * CHUNK_SIZE - position.x;
+    float dz = (z + 0.5f) * CHUNK_SIZE - position.z;
+    float distance = std::sqrt(dx * dx + dz * dz);
+    if(distance < ALWAYS_VISIBLE_CHUNKS * CHUNK_SIZE) {
+        return true;
+    }
+
+    // Only the horizontal heading matters for columns of terrain
+    float length = std::sqrt(forward.x * forward.x + forward.z * forward.z);
+    if(length < 1e-3f) {
+        return true;
+    }
+    return (dx * forward.x + dz * forward.z) / (distance * length) >= VIEW_CONE_COS;
+}
+
+void ChunkStreamer::requestMesh(uint64_t key) {
+    pending.insert(key);
+    jobs.submit(meshing, [this, key]() {
+        int32_t x = chunkX(key);
+        int32_t z = chunkZ(key);
+
+        // Terrain is cheap and deterministic, so each job generates the
+        // neighbours it needs instead of sharing a chunk cache
+        Chunk chunk;
+        generateTerrain(chunk, x, z, seed);
+        Chunk sides[4];
+        ChunkNeighbors neighbors;
+        const Face faces[4] = { Face::PosX, Face::NegX, Face::PosZ, Face::NegZ };
+        const int32_t offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+        for(int i = 0; i < 4; i++) {
+            generateTerrain(sides[i], x + offsets[i][0], z + offsets[i][1], seed);
+            neighbors.chunks[static_cast<int>(faces[i])] = &sides[i];
+        }
+
+        thread_local std::vector<Quad> quads;
+        quads.clear();
+        greedyMesh(chunk, neighbors, quads);
+
+        MeshedChunk result;
+        result.key = key;
+        result.mesh.origin = glm::vec3(x * CHUNK_SIZE, 0.0f, z * CHUNK_SIZE);
+        appendChunkQuads(quads, result.mesh);
+        // At most maxPending jobs are in flight, the queue's capacity
+        meshed.tryPush(result);
+    });
+}
+
+bool ChunkStreamer::place(const MeshedChunk& chunk, uint64_t frame) {
+    const VoxelMeshData& mesh = chunk.mesh;
+    ResidentChunk entry;
+    entry.lastVisibleFrame = frame;
+    entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    if(entry.indexCount > 0) {
+        Ranges& ranges = entry.ranges;
+        ranges.vertexBytes = sizeof(VoxelVertex) * mesh.vertices.size();
+        ranges.indexBytes = sizeof(uint32_t) * mesh.indices.size();
+
+        // Aligned to the element size, so offsets convert to the
+        // vertexOffset and firstIndex of the draw
+        auto vertexRange = vertexRanges.allocate(ranges.vertexBytes, sizeof(VoxelVertex));
+        if(!vertexRange) {
+            return false;
+        }
+        auto indexRange = indexRanges.allocate(ranges.indexBytes, sizeof(uint32_t));
+        if(!indexRange) {
+            vertexRanges.free(*vertexRange);
+            return false;
+        }
+        ranges.vertices = *vertexRange;
+        ranges.indices = *indexRange;
+
+        uploads.enqueue(
+            vertices,
+            ranges.vertices.offset,
+            mesh.vertices.data(),
+            ranges.vertexBytes,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+        );
+        uploads.enqueue(
+            indices,
+            ranges.indices.offset,
+            mesh.indices.data(),
+            ranges.indexBytes,
+            VK_ACCESS_INDEX_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+        );
+
+        usedBytes += ranges.vertexBytes + ranges.indexBytes;
+        peakUsedBytes = std::max(peakUsedBytes, usedBytes);
+    }
+
+    resident[chunk.key] = entry;
+    loads++;
+    return true;
+}
+
+bool ChunkStreamer::evictFor(uint64_t bytes, uint64_t frame) {
+    std::vector<std::pair<uint64_t, uint64_t>> candidates;
+    for(const auto& [key, chunk] : resident) {
+        if(chunk.lastVisibleFrame < frame && chunk.indexCount > 0) {
+            candidates.emplace_back(chunk.lastVisibleFrame, key);
+        }
+    }
+    if(candidates.empty()) {
+        return false;
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    uint64_t freed = 0;
+    for(const auto& candidate : candidates) {
+        if(freed >= bytes) {
+            break;
+        }
+        auto it = resident.find(candidate.second);
+        const Ranges& ranges = it->second.ranges;
+        freed += ranges.vertexBytes + ranges.indexBytes;
+        retiredBytes += ranges.vertexBytes + ranges.indexBytes;
+        // Frames up to this one may still draw from the ranges
+        retired.push_back(RetiredRanges { ranges, frame });
+        resident.erase(it);
+        evictions++;
+    }
+    return true;
+}
+
+void ChunkStreamer::releaseRanges(const Ranges& ranges) {
+    vertexRanges.free(ranges.vertices);
+    indexRanges.free(ranges.indices);
+    usedBytes -= ranges.vertexBytes + ranges.indexBytes;
+}
+
+void ChunkStreamer::update(
+    glm::vec3 cameraPosition,
+    glm::vec3 cameraForward,
+    uint64_t frame,
+    uint64_t completedFrames
+) {
+    while(!retired.empty() && retired.front().retiredAtFrame < completedFrames) {
+        const Ranges& ranges = retired.front().ranges;
+        retiredBytes -= ranges.vertexBytes + ranges.indexBytes;
+        releaseRanges(ranges);
+        retired.pop_front();
+    }
+
+    // Visible chunks, nearest first
+    int32_t cameraX = static_cast<int32_t>(std::floor(cameraPosition.x / CHUNK_SIZE));
+    int32_t cameraZ = static_cast<int32_t>(std::floor(cameraPosition.z / CHUNK_SIZE));
+    int32_t radius = static_cast<int32_t>(viewRadius);
+    std::vector<std::pair<int32_t, uint64_t>> visible;
+    for(int32_t dz = -radius; dz <= radius; dz++) {
+        for(int32_t dx = -radius; dx <= radius; dx++) {
+            int32_t distanceSquared = dx * dx + dz * dz;
+            if(distanceSquared > radius * radius) {
+                continue;
+            }
+            if(isVisible(cameraX + dx, cameraZ + dz, cameraPosition, cameraForward)) {
+                visible.emplace_back(distanceSquared, chunkKey(cameraX + dx, cameraZ + dz));
+            }
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+    for(const auto& entry : visible) {
+        auto it = resident.find(entry.second);
+        if(it != resident.end()) {
+            it->second.lastVisibleFrame = frame;
+        }
+    }
+
+    // Without workers, jobs only run when someone asks: mesh one per frame
+    if(jobs.workerCount() == 0) {
+        jobs.runOne();
+    }
+
+    // Place finished meshes, oldest first
+    MeshedChunk chunk;
+    while(meshed.tryPop(chunk)) {
+        waitingForSpace.push_back(std::move(chunk));
+    }
+    std::vector<MeshedChunk> stillWaiting;
+    for(MeshedChunk& waiting : waitingForSpace) {
+        int32_t dx = chunkX(waiting.key) - cameraX;
+        int32_t dz = chunkZ(waiting.key) - cameraZ;
+        // Left behind while it was meshed or waiting
+        if(dx * dx + dz * dz > (radius + 1) * (radius + 1)) {
+            pending.erase(waiting.key);
+            continue;
+        }
+        if(place(waiting, frame)) {
+            pending.erase(waiting.key);
+            continue;
+        }
+
+        // Evicted ranges come back once their frames are done; only evict
+        // more if those will not be enough
+        uint64_t bytes = sizeof(VoxelVertex) * waiting.mesh.vertices.size()
+            + sizeof(uint32_t) * waiting.mesh.indices.size();
+        if(retiredBytes >= bytes || evictFor(bytes - retiredBytes, frame)) {
+            stillWaiting.push_back(std::move(waiting));
+        } else {
+            // Everything resident is in view: the budget is too small
+            budgetMisses++;
+            retryAfter[waiting.key] = frame + RETRY_FRAMES;
+            pending.erase(waiting.key);
+        }
+    }
+    waitingForSpace = std::move(stillWaiting);
+
+    for(auto it = retryAfter.begin(); it != retryAfter.end();) {
+        it = it->second <= frame ? retryAfter.erase(it) : std::next(it);
+    }
+
+    visibleDraws.clear();
+    for(const auto& entry : visible) {
+        uint64_t key = entry.second;
+        auto it = resident.find(key);
+        if(it != resident.end()) {
+            const ResidentChunk& chunk = it->second;
+            if(chunk.indexCount > 0) {
+                visibleDraws.push_back(ChunkDraw {
+                    .indexCount = chunk.indexCount,
+                    .firstIndex = static_cast<uint32_t>(chunk.ranges.indices.offset / sizeof(uint32_t)),
+                    .vertexOffset = static_cast<int32_t>(chunk.ranges.vertices.offset / sizeof(VoxelVertex)),
+                    .origin = glm::vec4(chunkX(key) * CHUNK_SIZE, 0.0f, chunkZ(key) * CHUNK_SIZE, 0.0f)
+                });
+            }
+        } else if(
+            pending.size() < maxPending &&
+            pending.count(key) == 0 &&
+            retryAfter.count(key) == 0
+        ) {
+            requestMesh(key);
+        }
+    }
+}
+
+ChunkStreamerStats ChunkStreamer::stats() const {
+    return ChunkStreamerStats {
+        .residentChunks = static_cast<uint32_t>(resident.size()),
+        .visibleChunks = static_cast<uint32_t>(visibleDraws.size()),
+        .pendingChunks = static_cast<uint32_t>(pending.size()),
+        .usedBytes = usedBytes,
+        .peakUsedBytes = peakUsedBytes,
+        .budgetBytes = vertexRanges.size() + indexRanges.size(),
+        .loads = loads,
+        .evictions = evictions,
+        .budgetMisses = budgetMisses
+    };
+}
+
+void ChunkStreamer::printStats(std::ostream& out) const {
+    ChunkStreamerStats s = stats();
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+    out << std::fixed << std::setprecision(1)
+        << "chunk streamer: " << s.residentChunks << " resident, "
+        << s.visibleChunks << " drawn, " << s.pendingChunks << " pending; "
+        << s.usedBytes / (1024.0 * 1024.0) << " MiB used (peak "
+        << s.peakUsedBytes / (1024.0 * 1024.0) << ") of "
+        << s.budgetBytes / (1024.0 * 1024.0) << " MiB; "
+        << s.loads << " loads, " << s.evictions << " evictions, "
+        << s.budgetMisses << " budget misses" << std::endl;
+    out.copyfmt(flags);
+}
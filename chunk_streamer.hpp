@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "gpu_allocator.hpp"
+#include "job_system.hpp"
+#include "mpmc_queue.hpp"
+#include "tlsf.hpp"
+#include "upload_scheduler.hpp"
+#include "voxel_mesh.hpp"
+
+// One resident chunk's slice of the shared buffers, for vkCmdDrawIndexed
+struct ChunkDraw {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    // Pushed as the chunk origin
+    glm::vec4 origin;
+};
+
+struct ChunkStreamerStats {
+    uint32_t residentChunks = 0;
+    uint32_t visibleChunks = 0;
+    // Being meshed, or meshed and waiting for space
+    uint32_t pendingChunks = 0;
+    // Of the vertex and index buffers, including ranges still in use by
+    // frames in flight after eviction
+    uint64_t usedBytes = 0;
+    uint64_t peakUsedBytes = 0;
+    uint64_t budgetBytes = 0;
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    // Meshes dropped because every resident chunk was visible
+    uint64_t budgetMisses = 0;
+};
+
+/*
+    Keeps the chunks around the camera meshed and resident on the GPU within
+    a fixed memory budget.
+
+    All chunk geometry lives in one vertex buffer and one index buffer,
+    created once at the budget size and sub-allocated with TLSF. Evicting a
+    chunk returns its ranges for the next chunk to reuse, so GPU memory is
+    allocated once and never grows. Ranges go back only once the frames that
+    may still draw from them are done.
+
+    Each update():
+    - releases ranges evicted before completedFrames;
+    - uploads finished meshes through the upload scheduler's staging ring,
+      evicting the least recently visible chunks when a mesh does not fit;
+    - queues meshing jobs for visible chunks that are not resident, nearest
+      first, with a bounded number in flight;
+    - builds the draw list of visible resident chunks.
+
+    A chunk is visible when it lies within the view radius and roughly in
+    front of the camera. Chunks are generated from the seed on demand, so
+    nothing but the meshes is kept.
+
+    Not thread safe; call from the thread that submits frames, before
+    acquiring that frame's uploads.
+*/
+class ChunkStreamer {
+public:
+    ChunkStreamer(
+        GpuAllocator& allocator,
+        UploadScheduler& uploads,
+        JobSystem& jobs,
+        VkDeviceSize budgetBytes,
+        uint32_t viewRadius,
+        uint32_t seed
+    );
+    // Waits for its meshing jobs. The device must be idle.
+    ~ChunkStreamer();
+
+    ChunkStreamer(const ChunkStreamer&) = delete;
+    ChunkStreamer& operator=(const ChunkStreamer&) = delete;
+
+    void update(
+        glm::vec3 cameraPosition,
+        glm::vec3 cameraForward,
+        uint64_t frame,
+        uint64_t completedFrames
+    );
+
+    const std::vector<ChunkDraw>& draws() const {
+        return visibleDraws;
+    }
+    VkBuffer vertexBuffer() const {
+        return vertices;
+    }
+    VkBuffer indexBuffer() const {
+        return indices;
+    }
+
+    ChunkStreamerStats stats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Ranges {
+        TlsfAllocator::Allocation vertices;
+        TlsfAllocator::Allocation indices;
+        uint64_t vertexBytes = 0;
+        uint64_t indexBytes = 0;
+    };
+
+    struct ResidentChunk {
+        Ranges ranges;
+        uint32_t indexCount = 0;
+        uint64_t lastVisibleFrame = 0;
+    };
+
+    struct RetiredRanges {
+        Ranges ranges;
+        uint64_t retiredAtFrame;
+    };
+
+    struct MeshedChunk {
+        uint64_t key = 0;
+        VoxelMeshData mesh;
+    };
+
+    static uint64_t chunkKey(int32_t x, int32_t z);
+    static int32_t chunkX(uint64_t key);
+    static int32_t chunkZ(uint64_t key);
+
+    bool isVisible(int32_t x, int32_t z, glm::vec3 position, glm::vec3 forward) const;
+    void requestMesh(uint64_t key);
+    // Allocates, uploads and makes the chunk resident; false if it does not fit
+    bool place(const MeshedChunk& chunk, uint64_t frame);
+    // Evicts chunks not visible this frame, least recently visible first,
+    // until about `bytes` will come free. False if nothing could be evicted.
+    bool evictFor(uint64_t bytes, uint64_t frame);
+    void releaseRanges(const Ranges& ranges);
+
+    GpuAllocator& allocator;
+    UploadScheduler& uploads;
+    JobSystem& jobs;
+    uint32_t viewRadius;
+    uint32_t seed;
+
+    VkBuffer vertices = VK_NULL_HANDLE;
+    GpuAllocation vertexAllocation;
+    TlsfAllocator vertexRanges;
+    VkBuffer indices = VK_NULL_HANDLE;
+    GpuAllocation indexAllocation;
+    TlsfAllocator indexRanges;
+
+    std::unordered_map<uint64_t, ResidentChunk> resident;
+    std::deque<RetiredRanges> retired;
+    uint64_t retiredBytes = 0;
+
+    // Meshing jobs report back through this queue
+    JobGroup meshing;
+    uint32_t maxPending;
+    MpmcQueue<MeshedChunk> meshed;
+    // Chunks with a job in flight or a mesh waiting for space
+    std::unordered_set<uint64_t> pending;
+    std::vector<MeshedChunk> waitingForSpace;
+    // Chunks that did not fit, and the frame to try them again
+    std::unordered_map<uint64_t, uint64_t> retryAfter;
+
+    std::vector<ChunkDraw> visibleDraws;
+
+    uint64_t usedBytes = 0;
+    uint64_t peakUsedBytes = 0;
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    uint64_t budgetMisses = 0;
+};
@@ -0,0 +1,69 @@
+#include "command_cache.hpp"
+
+#include <stdexcept>
+
+CommandCache::CommandCache(
+    VkDevice device,
+    uint32_t queueFamily,
+    uint32_t slotCount
+) : device(device), entries(slotCount) {
+    // Long lived buffers, re-recorded one at a time when they go stale
+    VkCommandPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueFamily
+    };
+    if(vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("could not create command cache pool!");
+    }
+}
+
+CommandCache::~CommandCache() {
+    // Frees its buffers
+    vkDestroyCommandPool(device, pool, nullptr);
+}
+
+VkCommandBuffer CommandCache::lookup(
+    uint32_t slot,
+    uint32_t framebuffer,
+    uint64_t generation
+) const {
+    const std::vector<Entry>& slotEntries = entries[slot];
+    if(framebuffer >= slotEntries.size()) {
+        return VK_NULL_HANDLE;
+    }
+    const Entry& entry = slotEntries[framebuffer];
+    if(!entry.recorded || entry.generation != generation) {
+        return VK_NULL_HANDLE;
+    }
+    return entry.buffer;
+}
+
+VkCommandBuffer CommandCache::rerecord(
+    uint32_t slot,
+    uint32_t framebuffer,
+    uint64_t generation
+) {
+    std::vector<Entry>& slotEntries = entries[slot];
+    if(framebuffer >= slotEntries.size()) {
+        slotEntries.resize(framebuffer + 1);
+    }
+    Entry& entry = slotEntries[framebuffer];
+    if(entry.buffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        if(vkAllocateCommandBuffers(device, &allocInfo, &entry.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate cached command buffer!");
+        }
+    } else {
+        vkResetCommandBuffer(entry.buffer, 0);
+    }
+    entry.generation = generation;
+    entry.recorded = true;
+    records++;
+    return entry.buffer;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+    Primary command buffers recorded once and submitted again every frame
+    whose commands would come out the same.
+
+    There is one buffer per frame slot and framebuffer, so a buffer is only
+    ever resubmitted by its own slot, after that slot's fence has signaled:
+    it is never still pending, and per-slot query indices baked into it
+    stay right.
+
+    Each buffer remembers the generation it was recorded at. The owner bumps
+    its generation whenever anything recorded changes (scene, pipelines,
+    extent, framebuffers); every buffer then fails lookup() and is
+    re-recorded on next use. Nothing is freed until destruction.
+*/
+class CommandCache {
+public:
+    CommandCache(VkDevice device, uint32_t queueFamily, uint32_t slotCount);
+    // The device must be idle
+    ~CommandCache();
+
+    CommandCache(const CommandCache&) = delete;
+    CommandCache& operator=(const CommandCache&) = delete;
+
+    // The buffer recorded for this slot and framebuffer at `generation`, or
+    // VK_NULL_HANDLE if there is none or it is stale
+    VkCommandBuffer lookup(uint32_t slot, uint32_t framebuffer, uint64_t generation) const;
+
+    // Resets (or allocates) the buffer for this slot and framebuffer, ready
+    // to begin, and takes it as recorded at `generation`. The slot's last
+    // frame must be done.
+    VkCommandBuffer rerecord(uint32_t slot, uint32_t framebuffer, uint64_t generation);
+
+    uint64_t recordCount() const {
+        return records;
+    }
+
+private:
+    struct Entry {
+        VkCommandBuffer buffer = VK_NULL_HANDLE;
+        uint64_t generation = 0;
+        bool recorded = false;
+    };
+
+    VkDevice device;
+    VkCommandPool pool = VK_NULL_HANDLE;
+    // [slot][framebuffer], grown as framebuffers are seen
+    std::vector<std::vector<Entry>> entries;
+    uint64_t records = 0;
+};
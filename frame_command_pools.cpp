@@ -0,0 +1,55 @@
+#include "frame_command_pools.hpp"
+
+#include <stdexcept>
+
+FrameCommandPools::FrameCommandPools(
+    VkDevice device,
+    uint32_t queueFamily,
+    uint32_t slotCount,
+    VkCommandBufferLevel level
+) : device(device), level(level), pools(slotCount) {
+    for(Pool& pool : pools) {
+        // Re-recorded every frame, and only ever reset as a whole
+        VkCommandPoolCreateInfo poolInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = queueFamily
+        };
+        if(vkCreateCommandPool(device, &poolInfo, nullptr, &pool.pool) != VK_SUCCESS) {
+            throw std::runtime_error("could not create frame command pool!");
+        }
+    }
+}
+
+FrameCommandPools::~FrameCommandPools() {
+    for(Pool& pool : pools) {
+        // Frees its buffers
+        vkDestroyCommandPool(device, pool.pool, nullptr);
+    }
+}
+
+void FrameCommandPools::reset(uint32_t slot) {
+    Pool& pool = pools[slot];
+    if(pool.used > 0) {
+        vkResetCommandPool(device, pool.pool, 0);
+        pool.used = 0;
+    }
+}
+
+VkCommandBuffer FrameCommandPools::acquire(uint32_t slot) {
+    Pool& pool = pools[slot];
+    if(pool.used == pool.buffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool.pool,
+            .level = level,
+            .commandBufferCount = 1
+        };
+        VkCommandBuffer commandBuffer;
+        if(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate frame command buffer!");
+        }
+        pool.buffers.push_back(commandBuffer);
+    }
+    return pool.buffers[pool.used++];
+}
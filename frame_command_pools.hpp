@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+    A transient command pool per frame slot, reset as a whole.
+
+    Resetting buffers one at a time (RESET_COMMAND_BUFFER_BIT pools and
+    vkResetCommandBuffer) makes many drivers track each buffer's memory
+    separately, which is slower and fragments the pool. Here nothing is
+    reset individually: once a slot's fence has signaled, reset() hands the
+    pool's memory back in one vkResetCommandPool, and every buffer allocated
+    from it goes back on a free list for acquire() to hand out again.
+
+    A pool may only be used by one thread at a time, so each recording
+    thread needs its own FrameCommandPools.
+*/
+class FrameCommandPools {
+public:
+    FrameCommandPools(
+        VkDevice device,
+        uint32_t queueFamily,
+        uint32_t slotCount,
+        VkCommandBufferLevel level
+    );
+    // The device must be idle
+    ~FrameCommandPools();
+
+    FrameCommandPools(const FrameCommandPools&) = delete;
+    FrameCommandPools& operator=(const FrameCommandPools&) = delete;
+
+    // The slot's last frame must be done
+    void reset(uint32_t slot);
+
+    // A buffer from the slot's free list, allocated if the list is empty.
+    // Ready to begin; valid until the slot's next reset().
+    VkCommandBuffer acquire(uint32_t slot);
+
+private:
+    struct Pool {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> buffers;
+        // Handed out since the last reset; the rest are free
+        size_t used = 0;
+    };
+
+    VkDevice device;
+    VkCommandBufferLevel level;
+    std::vector<Pool> pools;
+};
@@ -0,0 +1,42 @@
+#include "frustum.hpp"
+
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+    // GLM is column major: row i is m[0][i], m[1][i], m[2][i], m[3][i]
+    auto row = [&](int i) {
+        return glm::vec4(
+            viewProjection[0][i],
+            viewProjection[1][i],
+            viewProjection[2][i],
+            viewProjection[3][i]
+        );
+    };
+    glm::vec4 x = row(0);
+    glm::vec4 y = row(1);
+    glm::vec4 z = row(2);
+    glm::vec4 w = row(3);
+
+    // -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space
+    Frustum frustum;
+    frustum.planes = {
+        w + x,
+        w - x,
+        w + y,
+        w - y,
+        z,
+        w - z
+    };
+    return frustum;
+}
+
+bool boxInFrustum(const Frustum& frustum, glm::vec3 boxMin, glm::vec3 boxMax) {
+    for(const glm::vec4& plane : frustum.planes) {
+        // The corner furthest along the plane normal
+        float x = plane.x >= 0.0f ? boxMax.x : boxMin.x;
+        float y = plane.y >= 0.0f ? boxMax.y : boxMin.y;
+        float z = plane.z >= 0.0f ? boxMax.z : boxMin.z;
+        if(plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
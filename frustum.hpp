@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+/*
+    The six planes bounding what a camera sees, as (a, b, c, d) with
+    a*x + b*y + c*z + d >= 0 on the inside. Planes are not normalized; the
+    tests only look at the sign.
+*/
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+};
+
+// Planes of a view-projection matrix with Vulkan's 0 to 1 clip depth
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+/*
+    False only if the box is entirely outside one plane. Boxes that straddle
+    two planes outside a corner of the frustum are kept, which is
+    conservative and cheap.
+
+    This is the CPU reference for shaders/cull.comp and does the same float
+    math in the same order, so both keep the same chunks.
+*/
+bool boxInFrustum(const Frustum& frustum, glm::vec3 boxMin, glm::vec3 boxMax);
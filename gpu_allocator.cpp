@@ -0,0 +1,327 @@
+#include "gpu_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+GpuAllocator::GpuAllocator(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize preferredBlockSize
+) : device(device) {
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    bufferImageGranularity = properties.limits.bufferImageGranularity;
+    nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    pools.resize(memoryProperties.memoryTypeCount * 2);
+    for(uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+        // Small heaps (e.g. 256MB host visible device memory) get smaller
+        // blocks so one block cannot eat the whole heap
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[
+            memoryProperties.memoryTypes[type].heapIndex
+        ].size;
+        VkDeviceSize blockSize = std::min(preferredBlockSize, heapSize / 8);
+
+        for(uint32_t kind = 0; kind < 2; kind++) {
+            pools[type * 2 + kind].memoryType = type;
+            pools[type * 2 + kind].blockSize = std::max<VkDeviceSize>(blockSize, 1);
+        }
+    }
+}
+
+GpuAllocator::~GpuAllocator() {
+    for(Pool& pool : pools) {
+        for(Block& block : pool.blocks) {
+            // freeing implicitly unmaps
+            vkFreeMemory(device, block.memory, nullptr);
+        }
+    }
+}
+
+uint32_t GpuAllocator::findMemoryType(
+    uint32_t typeFilter,
+    VkMemoryPropertyFlags properties
+) const {
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if(
+            (typeFilter & (1 << i)) &&
+            (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties
+        ) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceMemory GpuAllocator::allocateDeviceMemory(
+    VkDeviceSize size,
+    uint32_t memoryType
+) {
+    if(deviceAllocationCount >= maxAllocationCount) {
+        throw std::runtime_error("maxMemoryAllocationCount exceeded");
+    }
+
+    VkMemoryAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryType
+    };
+
+    VkDeviceMemory memory;
+    if(vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+    deviceAllocationCount++;
+    deviceBytes += size;
+    peakDeviceBytes = std::max(peakDeviceBytes, deviceBytes);
+
+    return memory;
+}
+
+void GpuAllocator::releaseDeviceMemory(VkDeviceMemory memory, VkDeviceSize size) {
+    vkFreeMemory(device, memory, nullptr);
+    deviceAllocationCount--;
+    deviceBytes -= size;
+}
+
+void* GpuAllocator::mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryType) {
+    VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+    if(!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        return nullptr;
+    }
+
+    void* mapped = nullptr;
+    if(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map device memory!");
+    }
+    return mapped;
+}
+
+GpuAllocation GpuAllocator::allocate(
+    const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags properties,
+    GpuResourceKind kind
+) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+    // One shared pool per type unless the granularity rule forces a split
+    uint32_t kindIndex = (bufferImageGranularity > 1 && kind == GpuResourceKind::Optimal)
+        ? 1
+        : 0;
+    uint32_t poolIndex = memoryType * 2 + kindIndex;
+    Pool& pool = pools[poolIndex];
+
+    GpuAllocation allocation;
+    allocation.size = requirements.size;
+    allocation.pool = poolIndex;
+
+    // Anything over half a block would waste most of a shared block
+    if(requirements.size > pool.blockSize / 2) {
+        allocation.memory = allocateDeviceMemory(requirements.size, memoryType);
+        allocation.mapped = mapIfHostVisible(allocation.memory, memoryType);
+        allocation.dedicated = true;
+        dedicatedCount++;
+        dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    // Flushes of non-coherent memory work in nonCoherentAtomSize units, so
+    // keep neighbouring allocations out of each other's atoms
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    VkDeviceSize size = requirements.size;
+    VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+    if(
+        (typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    ) {
+        alignment = std::max(alignment, nonCoherentAtomSize);
+        size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+    }
+
+    for(uint32_t i = 0; i < pool.blocks.size(); i++) {
+        auto range = pool.blocks[i].ranges->allocate(size, alignment);
+        if(range) {
+            allocation.memory = pool.blocks[i].memory;
+            allocation.offset = range->offset;
+            allocation.block = i;
+            allocation.range = *range;
+            if(pool.blocks[i].mapped) {
+                allocation.mapped = static_cast<char*>(pool.blocks[i].mapped) + range->offset;
+            }
+            return allocation;
+        }
+    }
+
+    // Every block is full, start a new one
+    Block block;
+    block.memory = allocateDeviceMemory(pool.blockSize, memoryType);
+    block.mapped = mapIfHostVisible(block.memory, memoryType);
+    block.ranges = std::make_unique<TlsfAllocator>(pool.blockSize);
+
+    auto range = block.ranges->allocate(size, alignment);
+    if(!range) {
+        // Only possible with an alignment larger than the block
+        releaseDeviceMemory(block.memory, pool.blockSize);
+        throw std::runtime_error("allocation does not fit in a memory block");
+    }
+
+    allocation.memory = block.memory;
+    allocation.offset = range->offset;
+    allocation.block = static_cast<uint32_t>(pool.blocks.size());
+    allocation.range = *range;
+    if(block.mapped) {
+        allocation.mapped = static_cast<char*>(block.mapped) + range->offset;
+    }
+    pool.blocks.push_back(std::move(block));
+
+    return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation) {
+    if(allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(allocation.dedicated) {
+        releaseDeviceMemory(allocation.memory, allocation.size);
+        dedicatedCount--;
+        dedicatedBytes -= allocation.size;
+        allocation = GpuAllocation{};
+        return;
+    }
+
+    Pool& pool = pools[allocation.pool];
+    Block& block = pool.blocks[allocation.block];
+    block.ranges->free(allocation.range);
+
+    /*
+        Return a block to the driver once it empties, except the last one of
+        the pool, so a resource created and destroyed every frame does not
+        allocate a fresh block every time. Only the last block is dropped so
+        the block indices held by live allocations stay valid.
+    */
+    while(
+        pool.blocks.size() > 1 &&
+        pool.blocks.back().ranges->empty()
+    ) {
+        releaseDeviceMemory(pool.blocks.back().memory, pool.blockSize);
+        pool.blocks.pop_back();
+    }
+
+    allocation = GpuAllocation{};
+}
+
+VkBuffer GpuAllocator::createBuffer(
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    GpuAllocation& allocation
+) {
+    VkBufferCreateInfo bufferInfo {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+
+    VkBuffer buffer;
+    if(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    try {
+        allocation = allocate(memRequirements, properties, GpuResourceKind::Linear);
+    } catch(...) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        throw;
+    }
+
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    return buffer;
+}
+
+VkImage GpuAllocator::createImage(
+    const VkImageCreateInfo& imageInfo,
+    VkMemoryPropertyFlags properties,
+    GpuAllocation& allocation
+) {
+    VkImage image;
+    if(vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    GpuResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL
+        ? GpuResourceKind::Optimal
+        : GpuResourceKind::Linear;
+    try {
+        allocation = allocate(memRequirements, properties, kind);
+    } catch(...) {
+        vkDestroyImage(device, image, nullptr);
+        throw;
+    }
+
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    return image;
+}
+
+void GpuAllocator::destroyBuffer(VkBuffer buffer, GpuAllocation& allocation) {
+    vkDestroyBuffer(device, buffer, nullptr);
+    free(allocation);
+}
+
+void GpuAllocator::destroyImage(VkImage image, GpuAllocation& allocation) {
+    vkDestroyImage(device, image, nullptr);
+    free(allocation);
+}
+
+GpuAllocatorStats GpuAllocator::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    GpuAllocatorStats stats;
+    stats.dedicatedCount = dedicatedCount;
+    stats.allocationCount = dedicatedCount;
+    stats.reservedBytes = dedicatedBytes;
+    stats.usedBytes = dedicatedBytes;
+    stats.peakReservedBytes = peakDeviceBytes;
+
+    for(const Pool& pool : pools) {
+        for(const Block& block : pool.blocks) {
+            TlsfAllocator::Stats blockStats = block.ranges->stats();
+            stats.blockCount++;
+            stats.allocationCount += blockStats.allocationCount;
+            stats.reservedBytes += blockStats.size;
+            stats.usedBytes += blockStats.usedBytes;
+            stats.freeRegionCount += blockStats.freeRegionCount;
+            stats.largestFreeRegion = std::max(
+                stats.largestFreeRegion,
+                blockStats.largestFreeRegion
+            );
+        }
+    }
+
+    return stats;
+}
+
+void GpuAllocator::printStats(std::ostream& out) const {
+    GpuAllocatorStats s = stats();
+    out << "gpu memory: " << s.allocationCount << " allocations in "
+        << s.blockCount << " blocks + " << s.dedicatedCount << " dedicated, "
+        << s.usedBytes / 1024 << "KiB used of " << s.reservedBytes / 1024
+        << "KiB reserved (peak " << s.peakReservedBytes / 1024 << "KiB), "
+        << s.freeRegionCount << " free regions (largest "
+        << s.largestFreeRegion / 1024 << "KiB)" << std::endl;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "tlsf.hpp"
+
+/*
+    What a sub-allocation will be bound to. Buffers and linear images may not
+    share a bufferImageGranularity page with optimally tiled images, so when
+    the device's granularity is larger than 1 the two kinds are kept in
+    separate memory blocks and the rule can never be broken.
+*/
+enum class GpuResourceKind {
+    Linear,
+    Optimal
+};
+
+struct GpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Host pointer to offset, if the memory type is host visible
+    void* mapped = nullptr;
+
+    // Bookkeeping for free()
+    uint32_t pool = UINT32_MAX;
+    uint32_t block = UINT32_MAX;
+    TlsfAllocator::Allocation range;
+    bool dedicated = false;
+};
+
+struct GpuAllocatorStats {
+    uint32_t blockCount = 0;
+    uint32_t dedicatedCount = 0;
+    uint32_t allocationCount = 0;
+    // Bytes of VkDeviceMemory allocated from the driver
+    VkDeviceSize reservedBytes = 0;
+    // Most reservedBytes has ever been
+    VkDeviceSize peakReservedBytes = 0;
+    // Bytes handed out to resources
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize largestFreeRegion = 0;
+    uint32_t freeRegionCount = 0;
+};
+
+/*
+    Sub-allocates resources out of large VkDeviceMemory blocks.
+
+    vkAllocateMemory is slow and the number of live allocations is capped by
+    maxMemoryAllocationCount (as low as 4096), so instead of one allocation
+    per resource we allocate big blocks per memory type and carve them up with
+    a TLSF allocator. Resources too large to share a block get a dedicated
+    allocation of their own.
+
+    Host visible blocks are mapped once when created and stay mapped.
+    Thread safe.
+*/
+class GpuAllocator {
+public:
+    GpuAllocator(
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        VkDeviceSize preferredBlockSize = 64 * 1024 * 1024
+    );
+    // All allocations must have been freed
+    ~GpuAllocator();
+
+    GpuAllocator(const GpuAllocator&) = delete;
+    GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+    GpuAllocation allocate(
+        const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags properties,
+        GpuResourceKind kind
+    );
+    void free(GpuAllocation& allocation);
+
+    // Create a resource, allocate memory for it and bind the two
+    VkBuffer createBuffer(
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        GpuAllocation& allocation
+    );
+    VkImage createImage(
+        const VkImageCreateInfo& imageInfo,
+        VkMemoryPropertyFlags properties,
+        GpuAllocation& allocation
+    );
+    void destroyBuffer(VkBuffer buffer, GpuAllocation& allocation);
+    void destroyImage(VkImage image, GpuAllocation& allocation);
+
+    uint32_t findMemoryType(
+        uint32_t typeFilter,
+        VkMemoryPropertyFlags properties
+    ) const;
+
+    GpuAllocatorStats stats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* mapped = nullptr;
+        std::unique_ptr<TlsfAllocator> ranges;
+    };
+
+    // Blocks for one memory type and resource kind
+    struct Pool {
+        uint32_t memoryType = 0;
+        VkDeviceSize blockSize = 0;
+        std::vector<Block> blocks;
+    };
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType);
+    void releaseDeviceMemory(VkDeviceMemory memory, VkDeviceSize size);
+    void* mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryType);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxAllocationCount;
+
+    mutable std::mutex mutex;
+    // Indexed by memoryType * 2 + kind
+    std::vector<Pool> pools;
+    uint32_t deviceAllocationCount = 0;
+    VkDeviceSize deviceBytes = 0;
+    VkDeviceSize peakDeviceBytes = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+};
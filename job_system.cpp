@@ -0,0 +1,153 @@
+#include "job_system.hpp"
+
+// Which pool, if any, the current thread works for, and its deque
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local unsigned currentQueue = 0;
+
+JobSystem::JobSystem(unsigned workerCount) {
+    for(unsigned i = 0; i <= workerCount; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for(unsigned i = 0; i < workerCount; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCondition.notify_all();
+
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::submit(JobGroup& group, std::function<void()> job) {
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    // Counted before it is visible, so a worker never sees a job in a
+    // deque without the count saying so
+    queuedJobs.fetch_add(1);
+
+    unsigned index;
+    if(currentSystem == this) {
+        index = currentQueue;
+    } else if(workers.empty()) {
+        index = 0;
+    } else {
+        index = nextQueue.fetch_add(1, std::memory_order_relaxed) % workerCount();
+    }
+    {
+        WorkerQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(Job { std::move(job), &group });
+    }
+
+    /*
+        A worker going to sleep bumps sleepingWorkers before checking
+        queuedJobs, and we bumped queuedJobs before reading sleepingWorkers,
+        so at least one of us sees the other. Taking the mutex orders the
+        notify after the worker starts waiting.
+    */
+    if(sleepingWorkers.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        sleepCondition.notify_one();
+    }
+}
+
+void JobSystem::wait(JobGroup& group) {
+    unsigned self = currentSystem == this ? currentQueue : workerCount();
+    while(!group.done()) {
+        Job job;
+        if(takeJob(self, job)) {
+            execute(job);
+        } else {
+            // The last jobs of the group are running elsewhere
+            std::this_thread::yield();
+        }
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(group.errorMutex);
+        std::swap(error, group.error);
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool JobSystem::runOne() {
+    Job job;
+    if(!takeJob(currentSystem == this ? currentQueue : workerCount(), job)) {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+bool JobSystem::takeJob(unsigned self, Job& job) {
+    if(queuedJobs.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    unsigned count = static_cast<unsigned>(queues.size());
+    for(unsigned i = 0; i < count; i++) {
+        WorkerQueue& queue = *queues[(self + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.jobs.empty()) {
+            continue;
+        }
+        if(i == 0) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        queuedJobs.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(Job& job) {
+    try {
+        job.function();
+    } catch(...) {
+        std::lock_guard<std::mutex> lock(job.group->errorMutex);
+        if(!job.group->error) {
+            job.group->error = std::current_exception();
+        }
+    }
+    // Releases the job's writes to whoever sees the group done
+    job.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::workerLoop(unsigned index) {
+    currentSystem = this;
+    currentQueue = index;
+
+    while(true) {
+        Job job;
+        if(takeJob(index, job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        sleepCondition.wait(lock, [this]() {
+            return stopping || queuedJobs.load() > 0;
+        });
+        sleepingWorkers.fetch_sub(1);
+        // Drain the deques before exiting so no group is left waiting
+        if(stopping && queuedJobs.load() == 0) {
+            return;
+        }
+    }
+}
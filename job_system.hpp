@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    A set of jobs that can be waited on together. Must outlive its jobs.
+
+    The first exception thrown by one of its jobs is kept and rethrown from
+    JobSystem::wait().
+*/
+class JobGroup {
+public:
+    bool done() const {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
+
+/*
+    Runs small CPU jobs (meshing a chunk, say) on a pool of worker threads.
+
+    Each worker has its own deque. Jobs submitted from a worker go on the
+    back of its deque and it takes them back from there, newest first, while
+    their data is still in its cache. A worker with nothing left steals the
+    oldest job from the front of another's deque, so load balances itself
+    without a single shared queue everyone contends on. Jobs submitted from
+    other threads are dealt round-robin across the deques.
+
+    The thread calling wait() does not block: it runs jobs too until its
+    group is done, so a main thread waiting on meshing adds a core rather
+    than idling one. With zero workers everything runs in wait() or
+    runOne() on the calling thread.
+
+    Idle workers sleep on a condition variable and are only woken when work
+    is submitted while one is asleep.
+*/
+class JobSystem {
+public:
+    explicit JobSystem(unsigned workerCount);
+    // Finishes queued jobs, then joins the workers
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    void submit(JobGroup& group, std::function<void()> job);
+
+    // Helps run jobs until the group is done, then rethrows its first error
+    void wait(JobGroup& group);
+
+    // Runs one queued job on the calling thread, if there is any
+    bool runOne();
+
+    unsigned workerCount() const {
+        return static_cast<unsigned>(workers.size());
+    }
+
+private:
+    struct Job {
+        std::function<void()> function;
+        JobGroup* group;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // Own deque first (from the back), then steal from the others' fronts
+    bool takeJob(unsigned self, Job& job);
+    void execute(Job& job);
+    void workerLoop(unsigned index);
+
+    // One per worker, plus one for threads outside the pool to steal with
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    // Jobs sitting in deques, not yet taken
+    std::atomic<uint32_t> queuedJobs{0};
+    std::atomic<uint32_t> nextQueue{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<uint32_t> sleepingWorkers{0};
+    bool stopping = false;
+};
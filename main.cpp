@@ -1,11 +1,18 @@
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <ostream>
 #include <set>
+#include <string>
+#include <unordered_set>
 #include <vector>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
@@ -14,8 +21,10 @@
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include <iostream>
 
@@ -27,6 +36,25 @@
 
 #include<fstream>
 
+#include "bench.hpp"
+#include "bindless_table.hpp"
+#include "chunk.hpp"
+#include "chunk_culler.hpp"
+#include "chunk_streamer.hpp"
+#include "command_cache.hpp"
+#include "frame_command_pools.hpp"
+#include "frustum.hpp"
+#include "gpu_allocator.hpp"
+#include "job_system.hpp"
+#include "material_library.hpp"
+#include "mesher.hpp"
+#include "mpmc_queue.hpp"
+#include "pipeline_builder.hpp"
+#include "profiler.hpp"
+#include "secondary_recorder.hpp"
+#include "upload_scheduler.hpp"
+#include "voxel_mesh.hpp"
+
 struct QueueFamilyIndices {
     // queue with graphics capabilities
     std::optional<uint32_t> graphicsFamily;
@@ -34,18 +62,219 @@ struct QueueFamilyIndices {
     // queue with ability to present to window surface
     std::optional<uint32_t> presentFamily;
 
+    // queue for streaming uploads; a transfer-only family when there is one,
+    // otherwise the graphics family
+    std::optional<uint32_t> transferFamily;
+
     bool isComplete() {
         return graphicsFamily.has_value() &&
                presentFamily.has_value();
     }
 };
 
+/*
+    A swap chain that has been replaced but may still be referenced by frames
+    in flight. Destroyed once every frame before retiredAtFrame is done.
+*/
+struct RetiredSwapChain {
+    VkSwapchainKHR swapChain;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> frameBuffers;
+    // Depth buffer sized for the old extent
+    VkImage depthImage;
+    GpuAllocation depthImageAllocation;
+    VkImageView depthImageView;
+    uint64_t retiredAtFrame;
+};
+
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
     std::vector<VkSurfaceFormatKHR> formats;
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+/*
+    Per-vertex data as laid out in the vertex buffer. The binding and
+    attribute descriptions tell the pipeline how to pull it apart into the
+    vertex shader's inputs.
+*/
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        return VkVertexInputBindingDescription {
+            .binding = 0,
+            .stride = sizeof(Vertex),
+            // Move to the next entry per vertex, not per instance
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        };
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+        return {{
+            // layout(location = 0) in vec3 inPosition
+            {
+                .location = 0,
+                .binding = 0,
+                .format = VK_FORMAT_R32G32B32_SFLOAT,
+                .offset = offsetof(Vertex, pos)
+            },
+            // layout(location = 1) in vec3 inColor
+            {
+                .location = 1,
+                .binding = 0,
+                .format = VK_FORMAT_R32G32B32_SFLOAT,
+                .offset = offsetof(Vertex, color)
+            }
+        }};
+    }
+};
+
+// CPU side geometry, before upload
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Per-draw data pushed straight into the command buffer
+struct PushConstants {
+    // Model-view-projection; identity for the flat scenes
+    glm::mat4 mvp;
+    // Voxel scene only: world position of the chunk being drawn
+    glm::vec4 chunkOrigin;
+};
+
+// Geometry resident in device local memory
+struct Mesh {
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    GpuAllocation vertexAllocation;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    GpuAllocation indexAllocation;
+    uint32_t indexCount = 0;
+    // Pushed as PushConstants::chunkOrigin for voxel meshes
+    glm::vec4 origin = glm::vec4(0.0f);
+};
+
+// A re-meshed chunk's old mesh, destroyed once every frame before
+// retiredAtFrame is done
+struct RetiredMesh {
+    Mesh mesh;
+    uint64_t retiredAtFrame;
+};
+
+/*
+    How frames are handed to the display, trading latency against throughput.
+    Each policy ranks present modes and picks a swap chain image count; see
+    chooseSwapPresentMode() and chooseSwapImageCount().
+*/
+enum class PresentPolicy {
+    // Newest frame replaces queued ones; no tearing, little queueing
+    LowLatency,
+    // Never block on the display; tearing allowed
+    MaxThroughput,
+    // Classic v-sync, frames queue behind the refresh
+    Vsync,
+    // Present as soon as possible, even mid-refresh
+    Immediate
+};
+
+// How a frame slot's command buffer is made recordable again
+enum class CommandReset {
+    // vkResetCommandPool on a transient pool per frame slot
+    Pool,
+    // vkResetCommandBuffer on a buffer from one shared pool
+    Buffer
+};
+
+// Where streamed chunks outside the view are dropped
+enum class CullMode {
+    // Draw every candidate chunk
+    Off,
+    // Test chunks on the CPU, one vkCmdDrawIndexed per visible chunk
+    Cpu,
+    // Test chunks in a compute pass and draw them indirectly
+    Gpu
+};
+
+/*
+    Runtime options, filled from the command line in main().
+
+    Headless mode skips GLFW, the surface and the swap chain entirely and
+    renders into a ring of device-local images instead, so the renderer can
+    run on machines without a display (CI, render farm, lavapipe).
+*/
+struct AppConfig {
+    bool headless = false;
+    uint32_t width = 800;
+    uint32_t height = 600;
+    // Number of frames to render before exiting. 0 renders until the window
+    // is closed, and is only valid with a window.
+    uint32_t frameCount = 0;
+    // Headless only: when set, every rendered frame is read back and written
+    // here as frame_NNNNN.ppm
+    std::string frameOutputDir;
+    // Compiled pipelines are persisted here between runs. Empty disables.
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // Worker threads compiling pipelines. 0 uses one per hardware thread.
+    uint32_t pipelineThreads = 0;
+    // Threads meshing chunks, counting the main thread, which helps while
+    // it waits. 0 uses one per hardware thread.
+    uint32_t jobThreads = 0;
+    // Extra permutations of the main pipeline (cull, polygon, blend, ...)
+    // to build at startup, for measuring pipeline compile throughput.
+    uint32_t pipelineVariantCount = 0;
+    PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+    // Swap chain images to request. 0 lets the present policy decide.
+    uint32_t swapChainImageCount = 0;
+    // Frame timing statistics are written here (.json for JSON, otherwise
+    // CSV) every few seconds and at exit. Empty only prints them at exit.
+    std::string profileOutputPath;
+    // Scene: this many small triangles split over this many draw calls.
+    // The defaults draw the single tutorial triangle.
+    uint32_t sceneTriangles = 1;
+    uint32_t sceneDraws = 1;
+    // When non-zero, draw a voxelGrid x voxelGrid patch of terrain chunks
+    // instead, one draw per chunk, seen through a perspective camera
+    uint32_t voxelGrid = 0;
+    // When non-zero, stream terrain chunks within this many chunks of a
+    // camera flying a scripted path, in a GPU budget of streamBudgetMiB
+    uint32_t streamRadius = 0;
+    uint32_t streamBudgetMiB = 64;
+    CullMode cullMode = CullMode::Gpu;
+    // Two-phase Hi-Z occlusion culling of the streamed chunks on top of GPU
+    // frustum culling; see ChunkCuller
+    bool occlusionCulling = false;
+    // Also runs the CPU reference culler each frame with --cull gpu, and
+    // counts the frames where the GPU disagreed
+    bool verifyCulling = false;
+    // Draws the scene twice: depth only, then color with depth writes off,
+    // so each pixel's color is shaded once however much geometry overlaps
+    bool depthPrepass = false;
+    // When non-zero, the render pass's draws are recorded in this many
+    // secondary command buffers in parallel on the job threads
+    uint32_t recordThreads = 0;
+    CommandReset commandReset = CommandReset::Pool;
+    // Keeps the VkRenderPass and VkFramebuffer objects even where
+    // VK_KHR_dynamic_rendering is available
+    bool forceRenderPass = false;
+    // Records one command buffer per frame slot and framebuffer and submits
+    // it again until the scene, pipelines or extent change
+    bool cachedCommands = false;
+    // Voxel scenes shade with the colors built into shaders/voxel.vert
+    // instead of bindless materials and textures
+    bool noBindless = false;
+    // With --voxels, digs or places this many blocks every frame, and
+    // re-meshes the chunks they touch
+    uint32_t voxelEdits = 0;
+    // Appends a benchmark result row (see bench.hpp) here after the run
+    std::string benchOutputPath;
+    // Compares the run to the row for the same scene in this file and fails
+    // if it regressed by more than benchTolerance
+    std::string benchBaselinePath;
+    double benchTolerance = 0.15;
+};
+
 VkResult CreateDebugUtilsMessengerEXT(
     VkInstance instance,
     const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
@@ -106,18 +335,59 @@ static std::vector<char> readFile(const std::string& filename) {
     return buffer;
 }
 
+/*
+    VK_KHR_dynamic_rendering and what it depends on, for Vulkan 1.0 devices
+    where none of them are core.
+*/
+const char* const DYNAMIC_RENDERING_EXTENSIONS[] = {
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+    VK_KHR_MULTIVIEW_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE_2_EXTENSION_NAME
+};
+
+// VK_EXT_descriptor_indexing and what it depends on
+const char* const DESCRIPTOR_INDEXING_EXTENSIONS[] = {
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE_3_EXTENSION_NAME
+};
+
+// Which part of the frame a scene pass draws; see beginScenePass()
+enum class ScenePass {
+    // The whole frame in one pass
+    Whole,
+    // Occlusion culling splits the frame around building the Hi-Z pyramid
+    Early,
+    Late
+};
+
 class HelloTriangleApplication {
 public:
+    explicit HelloTriangleApplication(const AppConfig& config)
+        : config(config) {
+        // Without a surface there is nothing to present, so the swap chain
+        // extension is not needed (and lavapipe-only boxes may lack it).
+        if(!config.headless) {
+            deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+    }
+
     void run() {
-        initWindow();
+        if(!config.headless) {
+            initWindow();
+        }
         initVulkan();
         mainLoop();
         cleanup();
+
+        if(benchRegressed) {
+            throw std::runtime_error("benchmark regressed against baseline");
+        }
     }
 
 private:
-    const uint32_t WIDTH = 800;
-    const uint32_t HEIGHT = 600;
+    const AppConfig config;
     /*
         Validation layers insert necessary checks for when things go wrong, and
         are intended for disabling in a release build.
@@ -134,15 +404,75 @@ private:
     #else
         const bool enableValidationLayers = true;
     #endif
-    const std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
+    // Filled in the constructor, depends on headless mode
+    std::vector<const char*> deviceExtensions;
+    /*
+        Number of frames the CPU may record and submit ahead of the GPU. With
+        one frame the CPU idles at the fence while the GPU renders; with two
+        we record frame N+1 while frame N executes. Kept small so input
+        latency does not grow.
+    */
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
     GLFWwindow *window = nullptr;
     VkInstance instance;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
+    // All buffer and image memory is sub-allocated from here
+    std::unique_ptr<GpuAllocator> allocator;
     VkQueue graphicsQueue;
+    // Copies run here; may be the graphics queue itself
+    VkQueue transferQueue;
+    // Staged copies into device local buffers
+    std::unique_ptr<UploadScheduler> uploads;
+    // CPU work (chunk meshing) spread over worker threads
+    std::unique_ptr<JobSystem> jobs;
+    // Terrain around the camera with --stream, drawn instead of meshes
+    std::unique_ptr<ChunkStreamer> streamer;
+    // Culls and draws the streamed chunks
+    std::unique_ptr<ChunkCuller> culler;
+    // config.cullMode, unless the device cannot cull on the GPU
+    CullMode cullMode = CullMode::Off;
+    // config.occlusionCulling, unless culling fell back to the CPU
+    bool occlusionCulling = false;
+    // Split the frame's render pass around the Hi-Z pyramid build with
+    // occlusion culling: the early pass keeps its depth, the late one loads
+    // color and depth back
+    VkRenderPass earlyRenderPass = VK_NULL_HANDLE;
+    VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+    // From VK_KHR_draw_indirect_count, when the device has it
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+    // VK_KHR_get_physical_device_properties2, for querying extension features
+    bool physicalDeviceProperties2 = false;
+    /*
+        Rendering without render pass and framebuffer objects, through
+        VK_KHR_dynamic_rendering, unless the device lacks it or
+        --render-pass was given. renderPass, the occlusion render passes and
+        swapChainFrameBuffers are then never created.
+    */
+    bool dynamicRendering = false;
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+    /*
+        Voxel materials looked up by block type in one bindless descriptor
+        set (VK_EXT_descriptor_indexing), bound once per pass, unless the
+        device lacks it or --no-bindless was given. Otherwise the pipeline
+        layout has no sets and the vertex shader's colors are used.
+    */
+    bool bindless = false;
+    // Table capacities, within the device's update-after-bind limits
+    uint32_t bindlessMaxBuffers = 0;
+    uint32_t bindlessMaxImages = 0;
+    std::unique_ptr<BindlessTable> bindlessTable;
+    std::unique_ptr<MaterialLibrary> materials;
+    // Per frame slot: whether the slot's last frame culled on the GPU, so
+    // its counts can be read once it is done
+    std::vector<bool> cullCountsPending;
+    // With --verify-cull, GPU culling results checked against the CPU
+    // reference once each frame is done: chunks the CPU kept, per slot
+    std::vector<std::optional<uint32_t>> referenceDrawCounts;
+    uint64_t cullFramesChecked = 0;
+    uint64_t cullMismatches = 0;
     VkDebugUtilsMessengerEXT debugMessenger;
 
     // Window surface
@@ -151,25 +481,87 @@ private:
     VkSurfaceKHR surface;
     // queue for presentation
     VkQueue presentQueue;
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    // Replaced swap chains waiting for their last frames to finish
+    std::vector<RetiredSwapChain> retiredSwapChains;
+    // Shared by every frame in flight; render pass dependencies order the
+    // frames' depth writes
+    VkFormat depthFormat;
+    VkImage depthImage = VK_NULL_HANDLE;
+    GpuAllocation depthImageAllocation;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+    // Set by GLFW on resize; drivers are not required to report OUT_OF_DATE
+    bool framebufferResized = false;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
 
+    // Headless render targets. These stand in for the swap chain images (and
+    // are stored in swapChainImages so views and framebuffers are shared);
+    // one per frame in flight so the ring is guarded by the in flight fences.
+    std::vector<GpuAllocation> offscreenImageAllocations;
+    // Host visible copies of the offscreen targets for writing frames out,
+    // mapped for the whole run
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<GpuAllocation> readbackAllocations;
+    // Frame number waiting in each readback buffer, or -1 if none
+    std::vector<int64_t> pendingReadbackFrame;
+    uint64_t frameNumber = 0;
+
     // TODO: Implement uniforms
-    VkRenderPass renderPass;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout;
 
     VkPipeline graphicsPipeline;
+    // With --depth-prepass: graphicsPipeline without a fragment shader,
+    // writing depth; graphicsPipeline then only tests against it
+    VkPipeline depthPrepassPipeline = VK_NULL_HANDLE;
+    /*
+        Driver-owned cache of compiled pipeline state. Seeded from disk at
+        startup so shaders already compiled by an earlier run are not
+        compiled again, and written back out in cleanup().
+    */
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    // Permutations of graphicsPipeline requested with --pipeline-variants
+    std::vector<VkPipeline> pipelineVariants;
+    // Optional features turned on in createLogicalDevice()
+    VkPhysicalDeviceFeatures enabledFeatures{};
 
     std::vector<VkFramebuffer> swapChainFrameBuffers;
+    // Everything drawn each frame. With --voxels, meshes[i] is chunk i's,
+    // with no buffers when the chunk has nothing to draw.
+    std::vector<Mesh> meshes;
+    // --voxels: the terrain, and the chunks whose meshes no longer match it
+    std::vector<Chunk> voxelChunks;
+    std::unordered_set<uint32_t> dirtyChunks;
+    std::vector<RetiredMesh> retiredMeshes;
     VkCommandPool commandPool;
-    VkCommandBuffer commandBuffer;
-
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
-    VkFence inFlightFence;
+    // Frame command buffers with CommandReset::Pool; commandBuffers from
+    // commandPool are used otherwise
+    std::unique_ptr<FrameCommandPools> frameCommandPools;
+    // Parallel recording with --record-threads
+    std::unique_ptr<SecondaryRecorder> secondaryRecorder;
+    // Record-once buffers with --cached-commands, valid while their
+    // generation matches commandGeneration; see invalidateCommands()
+    std::unique_ptr<CommandCache> commandCache;
+    uint64_t commandGeneration = 0;
+    // One of each per frame in flight, indexed by currentFrame
+    std::vector<VkCommandBuffer> commandBuffers;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    uint32_t currentFrame = 0;
+
+    // CPU scope times and GPU render pass times, in milliseconds
+    Profiler profiler;
+    std::unique_ptr<GpuFrameTimer> gpuTimer;
+    // Fragment shader invocations per pixel; only counts in debug builds
+    std::unique_ptr<GpuOverdrawCounter> overdrawCounter;
+    std::optional<Profiler::Clock::time_point> lastFrameStart;
+    // Set by reportBenchmark(); reported once everything is cleaned up
+    bool benchRegressed = false;
 
     void initWindow() {
         assert(glfwInit() == GLFW_TRUE);
@@ -179,20 +571,28 @@ private:
             intend to use OpenGL.
         */
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        /*
-            We want to disable resizing for now as there will be logic required
-            on a resize.
-        */
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        // Resizing recreates the swap chain, see recreateSwapChain()
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         this->window = glfwCreateWindow(
-            WIDTH, 
-            HEIGHT, 
+            config.width, 
+            config.height, 
             "Vulkan", 
             nullptr, // no monitor preference
             nullptr // only relevant for OpenGL, null under Vulkan
         );
         assert(this->window != nullptr);
+
+        // GLFW callbacks are plain functions; get back to this via the window
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(
+            glfwGetWindowUserPointer(window)
+        );
+        app->framebufferResized = true;
     }
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -310,21 +710,47 @@ private:
     }
 
     std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions
-            = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        
-        std::vector<const char*> extensions(
-            glfwExtensions, 
-            glfwExtensions + glfwExtensionCount
-        );
+        std::vector<const char*> extensions;
+
+        // GLFW is never initialized in headless mode, and no surface
+        // extensions are required there.
+        if(!config.headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions
+                = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+            extensions.assign(
+                glfwExtensions, 
+                glfwExtensions + glfwExtensionCount
+            );
+        }
         if(enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
         }
+        // Needed to ask whether device extensions' features are supported
+        physicalDeviceProperties2 = hasInstanceExtension(
+            VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
+        );
+        if(physicalDeviceProperties2) {
+            extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
 
         return extensions;
     }
 
+    bool hasInstanceExtension(const char* name) {
+        uint32_t extensionCount = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+        for(const auto& extension : extensions) {
+            if(std::strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
         // different types of queues exist for different subsets of commands
         QueueFamilyIndices indices { .graphicsFamily = 0 };
@@ -348,18 +774,26 @@ private:
         for(const auto& queueFamily: queueFamilies) {
             if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                 indices.graphicsFamily = i;
-            }
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(
-                device, 
-                i, 
-                surface, 
-                &presentSupport
-            );
+                // Nothing is presented when headless, so the graphics queue
+                // stands in for the present queue.
+                if(config.headless) {
+                    indices.presentFamily = i;
+                }
+            }
 
-            if(presentSupport) {
-                indices.presentFamily = i;
+            if(!config.headless) {
+                VkBool32 presentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(
+                    device, 
+                    i, 
+                    surface, 
+                    &presentSupport
+                );
+
+                if(presentSupport) {
+                    indices.presentFamily = i;
+                }
             }
 
             if(indices.isComplete()) {
@@ -369,6 +803,23 @@ private:
             i++;
         }
 
+        /*
+            Transfer-only families are usually dedicated DMA engines, which
+            copy while the graphics queue keeps rendering. Graphics families
+            always support transfers, so fall back to that.
+        */
+        indices.transferFamily = indices.graphicsFamily;
+        for(uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if(
+                (flags & VK_QUEUE_TRANSFER_BIT) &&
+                !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+            ) {
+                indices.transferFamily = family;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -401,13 +852,129 @@ private:
         return requiredExtensions.empty();
     }
 
+    bool hasDeviceExtension(const char* name) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(
+            physicalDevice,
+            nullptr,
+            &extensionCount,
+            nullptr
+        );
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(
+            physicalDevice,
+            nullptr,
+            &extensionCount,
+            availableExtensions.data()
+        );
+        for(const auto& extension : availableExtensions) {
+            if(std::strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The extensions are there and the feature is turned on by the driver
+    bool supportsDynamicRendering() {
+        if(!physicalDeviceProperties2) {
+            return false;
+        }
+        for(const char* extension : DYNAMIC_RENDERING_EXTENSIONS) {
+            if(!hasDeviceExtension(extension)) {
+                return false;
+            }
+        }
+
+        auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR")
+        );
+        if(getFeatures2 == nullptr) {
+            return false;
+        }
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR
+        };
+        VkPhysicalDeviceFeatures2 features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR,
+            .pNext = &dynamicRenderingFeatures
+        };
+        getFeatures2(physicalDevice, &features);
+        return dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+    }
+
+    /*
+        The extensions are there, with the features shaders/voxel.frag and
+        BindlessTable use. Fills in the table capacities.
+    */
+    bool supportsDescriptorIndexing() {
+        if(!physicalDeviceProperties2) {
+            return false;
+        }
+        for(const char* extension : DESCRIPTOR_INDEXING_EXTENSIONS) {
+            if(!hasDeviceExtension(extension)) {
+                return false;
+            }
+        }
+
+        auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR")
+        );
+        auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR")
+        );
+        if(getFeatures2 == nullptr || getProperties2 == nullptr) {
+            return false;
+        }
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT
+        };
+        VkPhysicalDeviceFeatures2 features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR,
+            .pNext = &indexingFeatures
+        };
+        getFeatures2(physicalDevice, &features);
+        bool supported = features.features.shaderStorageBufferArrayDynamicIndexing
+            && indexingFeatures.shaderSampledImageArrayNonUniformIndexing
+            && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+            && indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind
+            && indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+            && indexingFeatures.descriptorBindingPartiallyBound
+            && indexingFeatures.runtimeDescriptorArray;
+        if(!supported) {
+            return false;
+        }
+
+        // Room for thousands of materials without reallocating the set
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT
+        };
+        VkPhysicalDeviceProperties2 properties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
+            .pNext = &indexingProperties
+        };
+        getProperties2(physicalDevice, &properties);
+        bindlessMaxBuffers = std::min({
+            64u,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers
+        });
+        bindlessMaxImages = std::min({
+            4096u,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages
+        });
+        return bindlessMaxBuffers > 0 && bindlessMaxImages > 0;
+    }
+
     bool isDeviceSuitable(VkPhysicalDevice physicalDevice) {
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
 
-        bool swapChainAdequate = false;
-        if(extensionsSupported) {
+        // Headless devices only need to render, not present
+        bool swapChainAdequate = config.headless;
+        if(extensionsSupported && !config.headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(
                 physicalDevice
             );
@@ -429,7 +996,8 @@ private:
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
         std::set<uint32_t> uniqueQueueFamilies = {
             indices.graphicsFamily.value(), 
-            indices.presentFamily.value()
+            indices.presentFamily.value(),
+            indices.transferFamily.value()
         };
 
         float queuePriority = 1.0f;
@@ -442,10 +1010,103 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
+        // Only enable optional features the device actually has
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        // Wireframe (LINE polygon mode) pipeline variants
+        enabledFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+        // Indirect chunk draws: firstInstance picks each chunk's record, and
+        // one call draws them all
+        enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+#ifndef NDEBUG
+        // Overdraw counter; statistics queries cost a little on some drivers
+        enabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+#endif
+
+        // Streamed chunks: the cull mode the device can do, decided here
+        // because the depth image depends on it
+        if(config.streamRadius > 0) {
+            cullMode = config.cullMode;
+            if(cullMode == CullMode::Gpu && !enabledFeatures.drawIndirectFirstInstance) {
+                // Indirect draws could not tell the chunks' origins apart
+                std::cout << "GPU culling needs drawIndirectFirstInstance, culling on the CPU"
+                          << std::endl;
+                cullMode = CullMode::Cpu;
+            }
+            occlusionCulling = config.occlusionCulling && cullMode == CullMode::Gpu;
+            if(config.occlusionCulling && !occlusionCulling) {
+                std::cout << "occlusion culling needs GPU culling, disabled" << std::endl;
+            }
+        }
+
+        // Optional: lets the GPU cull pass decide how many draws there are
+        bool drawIndirectCount = config.streamRadius > 0
+            && hasDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if(drawIndirectCount) {
+            deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+
+        // Optional: no render pass or framebuffers to rebuild on resize
+        dynamicRendering = !config.forceRenderPass && supportsDynamicRendering();
+        if(dynamicRendering) {
+            deviceExtensions.insert(
+                deviceExtensions.end(),
+                std::begin(DYNAMIC_RENDERING_EXTENSIONS),
+                std::end(DYNAMIC_RENDERING_EXTENSIONS)
+            );
+        }
+        std::cout << "Rendering with "
+                  << (dynamicRendering ? "VK_KHR_dynamic_rendering" : "render pass objects")
+                  << std::endl;
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+            .dynamicRendering = VK_TRUE
+        };
+
+        // Optional: one descriptor set for every voxel material
+        bool voxels = config.voxelGrid > 0 || config.streamRadius > 0;
+        bindless = voxels && !config.noBindless && supportsDescriptorIndexing();
+        if(bindless) {
+            deviceExtensions.insert(
+                deviceExtensions.end(),
+                std::begin(DESCRIPTOR_INDEXING_EXTENSIONS),
+                std::end(DESCRIPTOR_INDEXING_EXTENSIONS)
+            );
+            enabledFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        }
+        if(voxels) {
+            std::cout << "Voxel materials from "
+                      << (bindless ? "a bindless descriptor set" : "vertex colors")
+                      << std::endl;
+        }
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+            .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+            .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+            .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+            .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+            .descriptorBindingPartiallyBound = VK_TRUE,
+            .runtimeDescriptorArray = VK_TRUE
+        };
+
+        VkPhysicalDeviceFeatures deviceFeatures = enabledFeatures;
+
+        // Extension features are chained on
+        void* featureChain = nullptr;
+        if(bindless) {
+            indexingFeatures.pNext = featureChain;
+            featureChain = &indexingFeatures;
+        }
+        if(dynamicRendering) {
+            dynamicRenderingFeatures.pNext = featureChain;
+            featureChain = &dynamicRenderingFeatures;
+        }
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = featureChain;
 
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -469,8 +1130,43 @@ private:
             throw std::runtime_error("failed to create logical device!");
         }
 
+        if(drawIndirectCount) {
+            cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR")
+            );
+        }
+        if(dynamicRendering) {
+            cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+                vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR")
+            );
+            cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+                vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR")
+            );
+        }
+
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+
+        allocator = std::make_unique<GpuAllocator>(physicalDevice, device);
+        uploads = std::make_unique<UploadScheduler>(
+            device,
+            *allocator,
+            transferQueue,
+            indices.transferFamily.value(),
+            indices.graphicsFamily.value()
+        );
+        gpuTimer = std::make_unique<GpuFrameTimer>(
+            physicalDevice,
+            device,
+            indices.graphicsFamily.value(),
+            MAX_FRAMES_IN_FLIGHT
+        );
+        overdrawCounter = std::make_unique<GpuOverdrawCounter>(
+            device,
+            enabledFeatures.pipelineStatisticsQuery,
+            MAX_FRAMES_IN_FLIGHT
+        );
     }
 
     void pickPhysicalDevice() {
@@ -582,26 +1278,88 @@ private:
         return availableFormats[0];
     }
 
+    static const char* presentModeName(VkPresentModeKHR mode) {
+        switch(mode) {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+            case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+            case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+            default: return "other";
+        }
+    }
+
     VkPresentModeKHR chooseSwapPresentMode(
         const std::vector<VkPresentModeKHR>& availablePresentModes
     ) {
-        // FIFO is guaranteed to be made available
-        // return VK_PRESENT_MODE_FIFO_KHR;
+        /*
+            Modes in order of preference for each policy.
 
-        // We may also iterate and rank presentation modes.
-        for(const auto& availablePresentMode: availablePresentModes) {
-            if(availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                // Mailbox mode replaces upcoming frames instead of blocking
-                // when queue is fuill, rendering as fast as possible but still
-                // avoiding tearing. known as "triple buffering"
+            MAILBOX replaces the queued frame instead of blocking when the
+            queue is full, rendering as fast as possible while still avoiding
+            tearing ("triple buffering"). IMMEDIATE does not wait for vertical
+            blank at all and may tear. FIFO_RELAXED is v-sync that tears
+            rather than waits when a frame is late.
+        */
+        std::vector<VkPresentModeKHR> preferred;
+        switch(config.presentPolicy) {
+            case PresentPolicy::LowLatency:
+                preferred = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+                break;
+            case PresentPolicy::MaxThroughput:
+                preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+                break;
+            case PresentPolicy::Vsync:
+                break;
+            case PresentPolicy::Immediate:
+                preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+                break;
+        }
 
-                return availablePresentMode;
+        for(VkPresentModeKHR mode : preferred) {
+            if(
+                std::find(
+                    availablePresentModes.begin(),
+                    availablePresentModes.end(),
+                    mode
+                ) != availablePresentModes.end()
+            ) {
+                return mode;
             }
         }
 
+        // FIFO is guaranteed to be made available
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
+    /*
+        Requesting only minImageCount means that once the presentation engine
+        holds its images, acquire blocks until one is released. One extra
+        image lets us render ahead instead; MAILBOX needs a spare to replace
+        into. IMMEDIATE never holds on to images, so the minimum suffices.
+    */
+    uint32_t chooseSwapImageCount(
+        const VkSurfaceCapabilitiesKHR& capabilities,
+        VkPresentModeKHR presentMode
+    ) {
+        uint32_t imageCount = config.swapChainImageCount;
+        if(imageCount == 0) {
+            imageCount = capabilities.minImageCount;
+            if(presentMode != VK_PRESENT_MODE_IMMEDIATE_KHR) {
+                imageCount++;
+            }
+            if(presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+                imageCount = std::max(imageCount, 3u);
+            }
+        }
+
+        // maxImageCount of 0 means there is no maximum
+        imageCount = std::max(imageCount, capabilities.minImageCount);
+        if(capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
+            imageCount = capabilities.maxImageCount;
+        }
+        return imageCount;
+    }
+
     VkExtent2D chooseSwapExtent(
         const VkSurfaceCapabilitiesKHR& capabilities
     ) {
@@ -641,10 +1399,10 @@ private:
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
         // Determine swap chain image count
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount;
-        if(swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+        uint32_t imageCount = chooseSwapImageCount(
+            swapChainSupport.capabilities,
+            presentMode
+        );
 
         VkSwapchainCreateInfoKHR createInfo{
             .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -703,18 +1461,24 @@ private:
         // we would want to disable this if we needed to read back the values
         createInfo.clipped = VK_TRUE; 
 
-        // ! Assumes only one swapchain - will update this later
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        /*
+            When recreating, hand over the old swap chain. The driver can reuse
+            its resources, and images already acquired from it can still be
+            presented. It stays alive until retired in drawFrame().
+        */
+        createInfo.oldSwapchain = swapChain;
 
+        VkSwapchainKHR newSwapChain;
         VkResult result = vkCreateSwapchainKHR(
             device, 
             &createInfo, 
             nullptr, 
-            &swapChain
+            &newSwapChain
         );
         if(result != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
         }
+        swapChain = newSwapChain;
 
         // MARK: Swapchain images
         // Created for swap chain, retrieve array of however many in chain
@@ -732,77 +1496,489 @@ private:
             swapChainImages.data()
         );
 
+        // imageCount now holds what the driver actually created
+        std::cout << "present mode " << presentModeName(presentMode) << ", "
+                  << imageCount << " swap chain images" << std::endl;
+
         // store swap chain format and extent for later use
         swapChainImageFormat = surfaceFormat.format;
         swapChainExtent = extent;
     }
 
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainImages.size());
-        for(size_t i = 0; i < swapChainImages.size(); i++) {
-            VkImageViewCreateInfo createInfo {
-                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                .image = swapChainImages[i],
-                // use 2D texture and swapchain format
-                .viewType = VK_IMAGE_VIEW_TYPE_2D,
-                .format = swapChainImageFormat,
-                // default "swizzle" (swapping color channels) config
-                .components = VkComponentMapping {
-                    .r = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .g = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .b = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .a = VK_COMPONENT_SWIZZLE_IDENTITY
-                },
-                // subresource configuration describes part of image and purpose
-                // use these images as color target without mipmap or layering
-                .subresourceRange = VkImageSubresourceRange {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    // stereo 3D would use swapchain with multiple layers
-                    // with multiple image views for left and right eyes for 
-                    // different layers
-                    .layerCount = 1
-                }
-            };
-
-            VkResult result = vkCreateImageView(
-                device, 
-                &createInfo, 
-                nullptr, 
-                &swapChainImageViews[i]
-            );
-            if(result != VK_SUCCESS) {
-                throw std::runtime_error("failed to create image view");
-            }
-        };
-    }
+    // MARK: Swap chain recreation
+    /*
+        The window surface no longer matches the swap chain (resize, moved to
+        another display), so build a new one.
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo createInfo {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = code.size(),
-            .pCode = reinterpret_cast<const uint32_t*>(code.data())
-        };
+        Frames still in flight reference the old images, views and
+        framebuffers. Rather than waiting for the device to idle, which stalls
+        on every resize, they are retired and destroyed by drawFrame() once
+        the frames that used them have finished.
 
-        VkShaderModule shaderModule;
-        VkResult createShaderResult = vkCreateShaderModule(
-            device, 
-            &createInfo, 
-            nullptr, 
-            &shaderModule
-        );
-        if(createShaderResult != VK_SUCCESS) {
-            throw std::runtime_error("failed to create shader module!");
+        The render pass only depends on the image format, which does not
+        change here, so it and the pipelines are kept. With dynamic rendering
+        there are no framebuffers to rebuild either.
+    */
+    void recreateSwapChain() {
+        // A minimized window has a zero sized framebuffer, which is not a
+        // valid swap chain extent. Sleep until it is visible again.
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while(width == 0 || height == 0) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(window, &width, &height);
         }
 
-        return shaderModule;
-    }
+        // Every frame numbered below frameNumber may use the old swap chain
+        retiredSwapChains.push_back(RetiredSwapChain {
+            .swapChain = swapChain,
+            .imageViews = std::move(swapChainImageViews),
+            .frameBuffers = std::move(swapChainFrameBuffers),
+            .depthImage = depthImage,
+            .depthImageAllocation = depthImageAllocation,
+            .depthImageView = depthImageView,
+            .retiredAtFrame = frameNumber
+        });
+        swapChainImageViews.clear();
+        swapChainFrameBuffers.clear();
+
+        createSwapChain();
+        createImageViews();
+        createDepthResources();
+        if(!dynamicRendering) {
+            createFramebuffers();
+        }
+
+        // The culler builds its Hi-Z pyramid from the new depth image;
+        // frames in flight keep the old pyramid until they are done
+        if(occlusionCulling) {
+            culler->setDepthSource(depthImageView, swapChainExtent, frameNumber);
+        }
+
+        // Cached command buffers name the old framebuffers and extent
+        invalidateCommands();
+    }
+
+    /*
+        Call whenever something recorded in a frame's command buffer changes
+        outside of drawFrame(): meshes, pipelines, extent or framebuffers.
+        Cached command buffers from older generations are re-recorded on
+        their next use.
+    */
+    void invalidateCommands() {
+        commandGeneration++;
+    }
+
+    void destroySwapChainResources(RetiredSwapChain& retired) {
+        for(VkFramebuffer frameBuffer : retired.frameBuffers) {
+            vkDestroyFramebuffer(device, frameBuffer, nullptr);
+        }
+        for(VkImageView imageView : retired.imageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroyImageView(device, retired.depthImageView, nullptr);
+        allocator->destroyImage(retired.depthImage, retired.depthImageAllocation);
+        vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+    }
+
+    // Destroy retired swap chains whose frames are all below completedFrames
+    void destroyRetiredSwapChains(uint64_t completedFrames) {
+        auto retired = retiredSwapChains.begin();
+        while(retired != retiredSwapChains.end()) {
+            if(retired->retiredAtFrame <= completedFrames) {
+                destroySwapChainResources(*retired);
+                retired = retiredSwapChains.erase(retired);
+            } else {
+                ++retired;
+            }
+        }
+    }
+
+    // MARK: Depth buffer
+    /*
+        Came in with the voxel scene: its chunks overlap on screen and are
+        drawn in no particular order, so without a depth test the far ones
+        paint over the near. The flat scenes never overlap. The depth
+        pre-pass (--depth-prepass) builds on this.
+    */
+    VkFormat findSupportedFormat(
+        const std::vector<VkFormat>& candidates,
+        VkImageTiling tiling,
+        VkFormatFeatureFlags features
+    ) {
+        for(VkFormat format : candidates) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+            VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR
+                ? properties.linearTilingFeatures
+                : properties.optimalTilingFeatures;
+            if((supported & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkFormat findDepthFormat() {
+        VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if(occlusionCulling) {
+            // Sampled to build the Hi-Z pyramid
+            features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+        }
+        // Most precise first; we do not use stencil
+        return findSupportedFormat(
+            {
+                VK_FORMAT_D32_SFLOAT,
+                VK_FORMAT_D32_SFLOAT_S8_UINT,
+                VK_FORMAT_D24_UNORM_S8_UINT
+            },
+            VK_IMAGE_TILING_OPTIMAL,
+            features
+        );
+    }
+
+    // Layout changes of the depth image must name every aspect it has
+    VkImageAspectFlags depthAspectMask() const {
+        if(depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+
+    /*
+        One depth image the size of the swap chain. Only the render pass uses
+        it, cleared on load and discarded on store, so frames in flight can
+        share it as long as the render pass orders their depth accesses.
+    */
+    void createDepthResources() {
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if(occlusionCulling) {
+            // The Hi-Z pyramid is built from it
+            usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        }
+        VkImageCreateInfo imageInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = depthFormat,
+            .extent = {
+                .width = swapChainExtent.width,
+                .height = swapChainExtent.height,
+                .depth = 1
+            },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        depthImage = allocator->createImage(
+            imageInfo,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            depthImageAllocation
+        );
+
+        VkImageViewCreateInfo viewInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = depthImage,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = depthFormat,
+            .subresourceRange = VkImageSubresourceRange {
+                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+        if(vkCreateImageView(device, &viewInfo, nullptr, &depthImageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth image view!");
+        }
+    }
+
+    // MARK: Headless render targets
+    /*
+        Replaces createSwapChain() when headless. Images are device local and
+        rendered to exactly like swap chain images, but finish the render pass
+        in TRANSFER_SRC_OPTIMAL so they can be copied out instead of presented.
+    */
+    void createOffscreenTargets() {
+        swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        swapChainExtent = { config.width, config.height };
+
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        offscreenImageAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+
+        for(size_t i = 0; i < swapChainImages.size(); i++) {
+            VkImageCreateInfo imageInfo {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = swapChainImageFormat,
+                .extent = { swapChainExtent.width, swapChainExtent.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            };
+
+            swapChainImages[i] = allocator->createImage(
+                imageInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                offscreenImageAllocations[i]
+            );
+        }
+    }
+
+    /*
+        One staging buffer per offscreen target. recordCommandBuffer() copies
+        the finished image in, and drawFrame() writes it to disk once the
+        slot's fence says the copy is done. Mapped for the whole run.
+    */
+    void createReadbackBuffers() {
+        VkDeviceSize size = static_cast<VkDeviceSize>(swapChainExtent.width)
+            * swapChainExtent.height * 4;
+
+        readbackBuffers.resize(swapChainImages.size());
+        readbackAllocations.resize(swapChainImages.size());
+        pendingReadbackFrame.assign(swapChainImages.size(), -1);
+
+        for(size_t i = 0; i < swapChainImages.size(); i++) {
+            readbackBuffers[i] = allocator->createBuffer(
+                size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                readbackAllocations[i]
+            );
+        }
+    }
+
+    // Write out the frame waiting in a readback buffer as a binary PPM
+    void writeReadbackFrame(size_t slot) {
+        if(pendingReadbackFrame[slot] < 0) {
+            return;
+        }
+
+        char name[32];
+        std::snprintf(
+            name,
+            sizeof(name),
+            "/frame_%05lld.ppm",
+            static_cast<long long>(pendingReadbackFrame[slot])
+        );
+        std::ofstream file(config.frameOutputDir + name, std::ios::binary);
+        if(!file.is_open()) {
+            throw std::runtime_error("failed to open frame output file");
+        }
+
+        file << "P6\n" << swapChainExtent.width << " "
+             << swapChainExtent.height << "\n255\n";
+
+        // PPM has no alpha channel, drop it from the RGBA pixels
+        const uint8_t* pixels = static_cast<const uint8_t*>(readbackAllocations[slot].mapped);
+        std::vector<char> row(swapChainExtent.width * 3);
+        for(uint32_t y = 0; y < swapChainExtent.height; y++) {
+            for(uint32_t x = 0; x < swapChainExtent.width; x++) {
+                const uint8_t* pixel = pixels + (y * swapChainExtent.width + x) * 4;
+                row[x * 3 + 0] = pixel[0];
+                row[x * 3 + 1] = pixel[1];
+                row[x * 3 + 2] = pixel[2];
+            }
+            file.write(row.data(), row.size());
+        }
+
+        pendingReadbackFrame[slot] = -1;
+    }
+
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainImages.size());
+        for(size_t i = 0; i < swapChainImages.size(); i++) {
+            VkImageViewCreateInfo createInfo {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = swapChainImages[i],
+                // use 2D texture and swapchain format
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = swapChainImageFormat,
+                // default "swizzle" (swapping color channels) config
+                .components = VkComponentMapping {
+                    .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+                    .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+                    .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+                    .a = VK_COMPONENT_SWIZZLE_IDENTITY
+                },
+                // subresource configuration describes part of image and purpose
+                // use these images as color target without mipmap or layering
+                .subresourceRange = VkImageSubresourceRange {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    // stereo 3D would use swapchain with multiple layers
+                    // with multiple image views for left and right eyes for 
+                    // different layers
+                    .layerCount = 1
+                }
+            };
+
+            VkResult result = vkCreateImageView(
+                device, 
+                &createInfo, 
+                nullptr, 
+                &swapChainImageViews[i]
+            );
+            if(result != VK_SUCCESS) {
+                throw std::runtime_error("failed to create image view");
+            }
+        };
+    }
+
+    VkShaderModule createShaderModule(const std::vector<char>& code) {
+        VkShaderModuleCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = code.size(),
+            .pCode = reinterpret_cast<const uint32_t*>(code.data())
+        };
+
+        VkShaderModule shaderModule;
+        VkResult createShaderResult = vkCreateShaderModule(
+            device, 
+            &createInfo, 
+            nullptr, 
+            &shaderModule
+        );
+        if(createShaderResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        return shaderModule;
+    }
+
+    // MARK: Pipeline cache
+    /*
+        Cache blobs are only valid for the exact driver and device that wrote
+        them. Drivers are supposed to reject foreign data themselves but some
+        crash instead, so check the header (VkPipelineCacheHeaderVersionOne)
+        against this device before handing the data over.
+    */
+    bool isPipelineCacheCompatible(const std::vector<char>& data) {
+        VkPipelineCacheHeaderVersionOne header;
+        if(data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        return header.headerSize >= sizeof(header) &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID &&
+               header.deviceID == properties.deviceID &&
+               std::memcmp(
+                   header.pipelineCacheUUID,
+                   properties.pipelineCacheUUID,
+                   VK_UUID_SIZE
+               ) == 0;
+    }
+
+    void createPipelineCache() {
+        std::vector<char> initialData;
+
+        if(!config.pipelineCachePath.empty()) {
+            // A missing cache is normal on first run, so don't use readFile()
+            std::ifstream file(
+                config.pipelineCachePath,
+                std::ios::ate | std::ios::binary
+            );
+            if(file.is_open()) {
+                initialData.resize(static_cast<size_t>(file.tellg()));
+                file.seekg(0);
+                file.read(initialData.data(), initialData.size());
+            }
+
+            if(!initialData.empty() && !isPipelineCacheCompatible(initialData)) {
+                std::cout << "discarding incompatible pipeline cache" << std::endl;
+                initialData.clear();
+            }
+        }
+
+        VkPipelineCacheCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = initialData.size(),
+            .pInitialData = initialData.empty() ? nullptr : initialData.data()
+        };
+
+        VkResult result = vkCreatePipelineCache(
+            device,
+            &createInfo,
+            nullptr,
+            &pipelineCache
+        );
+        if(result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    /*
+        Write the cache next to its final path then rename over it, so a crash
+        mid-write never leaves a truncated cache for the next run. Failing to
+        save only costs startup time, so report it and carry on.
+    */
+    void savePipelineCache() {
+        if(config.pipelineCachePath.empty()) {
+            return;
+        }
+
+        size_t dataSize = 0;
+        vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+        std::vector<char> data(dataSize);
+        VkResult result = vkGetPipelineCacheData(
+            device,
+            pipelineCache,
+            &dataSize,
+            data.data()
+        );
+        if(result != VK_SUCCESS) {
+            std::cerr << "failed to read back pipeline cache" << std::endl;
+            return;
+        }
+
+        std::string tempPath = config.pipelineCachePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), dataSize);
+            file.flush();
+            if(!file) {
+                std::cerr << "failed to write pipeline cache" << std::endl;
+                std::remove(tempPath.c_str());
+                return;
+            }
+        }
+
+        if(std::rename(tempPath.c_str(), config.pipelineCachePath.c_str()) != 0) {
+            std::cerr << "failed to replace pipeline cache" << std::endl;
+            std::remove(tempPath.c_str());
+        }
+    }
 
     void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+        // The voxel scene uses packed vertices, decoded by its own shader.
+        // Streamed chunks take their origin from a per-instance attribute.
+        bool streaming = config.streamRadius > 0;
+        bool voxels = config.voxelGrid > 0 || streaming;
+        auto vertShaderCode = readFile(
+            streaming ? "shaders/voxel_stream_vert.spv"
+            : voxels ? "shaders/voxel_vert.spv"
+            : "shaders/vert.spv"
+        );
+        auto fragShaderCode = readFile(bindless ? "shaders/voxel_frag.spv" : "shaders/frag.spv");
 
         // Create shader modules, which are thin wrappers around bytecode
         // Compilation/linking of SPIR-V doesn't occur until pipeline creation 
@@ -827,17 +2003,27 @@ private:
            */
         };
 
+        // The bindless fragment shader is told where the material buffer is
+        uint32_t materialBuffer = bindless ? materials->materialBuffer() : 0;
+        VkSpecializationMapEntry materialBufferEntry {
+            .constantID = 0,
+            .offset = 0,
+            .size = sizeof(materialBuffer)
+        };
+        VkSpecializationInfo fragSpecialization {
+            .mapEntryCount = 1,
+            .pMapEntries = &materialBufferEntry,
+            .dataSize = sizeof(materialBuffer),
+            .pData = &materialBuffer
+        };
+
         // Equivalent for fragment shader
         VkPipelineShaderStageCreateInfo fragShaderStageInfo {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
             .module = fragShaderModule,
-            .pName = "main"
-        };
-
-        VkPipelineShaderStageCreateInfo shaderStages[] = {
-            vertShaderStageInfo,
-            fragShaderStageInfo
+            .pName = "main",
+            .pSpecializationInfo = bindless ? &fragSpecialization : nullptr
         };
 
         // MARK: Dynamic State
@@ -855,12 +2041,6 @@ private:
             VK_DYNAMIC_STATE_SCISSOR
         };
 
-        VkPipelineDynamicStateCreateInfo dynamicState {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-            .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
-            .pDynamicStates = dynamicStates.data()
-        };
-
         /*
             Create a vertex input state structure. Specifies the input format
             for incoming data into the vertex shaders.
@@ -871,18 +2051,24 @@ private:
             - Attribute descriptions: What kinds of data being passed, what
             binding to load from, and offset information
         */
-        // TODO: Specify that we are not passing in any vertex data.
-        // We will later specify this data when we are no longer hardcoding in
-        // the shader.
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .vertexBindingDescriptionCount = 0,
-            // Structure with descriptions of bindings
-            .pVertexBindingDescriptions = nullptr,
-            .vertexAttributeDescriptionCount = 0,
-            // Structure with descriptions of attributes
-            .pVertexAttributeDescriptions = nullptr
+        // Vertex data comes from one interleaved buffer of Vertex (or
+        // VoxelVertex) structs. (Bindings and attributes go in the pipeline
+        // description below; PipelineBuilder::build() makes the create info
+        // from them.)
+        auto attributeDescriptions = voxels
+            ? VoxelVertex::getAttributeDescriptions()
+            : Vertex::getAttributeDescriptions();
+        std::vector<VkVertexInputBindingDescription> vertexBindings = {
+            voxels ? VoxelVertex::getBindingDescription() : Vertex::getBindingDescription()
         };
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes(
+            attributeDescriptions.begin(),
+            attributeDescriptions.end()
+        );
+        if(streaming) {
+            vertexBindings.push_back(ChunkRecord::getBindingDescription());
+            vertexAttributes.push_back(ChunkRecord::getAttributeDescription());
+        }
 
         // MARK: Input assembly
         /*
@@ -928,32 +2114,11 @@ private:
             a scissor rectangle across the entire viewport, the entire viewport
             will be processed. If we create a smaller scissor rectangle, we 
             filter the processed pixels.
-        */
-
-        VkViewport viewport {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(swapChainExtent.width),
-            .height = static_cast<float>(swapChainExtent.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
-        };
-
-        VkRect2D scissor {
-            .offset = {
-                .x = 0,
-                .y = 0,
-            },
-            .extent = swapChainExtent
-        };
 
-        VkPipelineViewportStateCreateInfo viewportState {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-            .viewportCount = 1,
-            .pViewports = &viewport,
-            .scissorCount = 1,
-            .pScissors = &scissor
-        };
+            Both are dynamic state (see above) and are set in
+            recordCommandBuffer(), so the pipeline only records that there is
+            one of each and does not depend on the swap chain extent.
+        */
 
         // MARK: Rasterizer
         /*
@@ -1032,8 +2197,23 @@ private:
         };
 
         // MARK: Depth testing
-        // ! Depth testing requires depth and stencil test create info
-        // TODO: Implement depth testing. (For now we pass nullptr, disabled)
+        /*
+            Keep fragments closer than what is already in the depth buffer
+            (LESS, as depth is cleared to 1.0, the far plane) and record their
+            depth. Bounds and stencil tests are off.
+        */
+        VkPipelineDepthStencilStateCreateInfo depthStencil {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable = VK_TRUE,
+            .depthWriteEnable = VK_TRUE,
+            .depthCompareOp = VK_COMPARE_OP_LESS,
+            .depthBoundsTestEnable = VK_FALSE,
+            .stencilTestEnable = VK_FALSE,
+            .front = {},
+            .back = {},
+            .minDepthBounds = 0.0f,
+            .maxDepthBounds = 1.0f
+        };
 
         // MARK: Color blending
         /*
@@ -1103,16 +2283,26 @@ private:
 
         // MARK: Pipeline Layout
         /*
-            Pipeline layout defines layout for uniform shaders. We need to 
-            specify them, though we are not using them yet.
+            Pipeline layout defines layout for uniform shaders. The camera
+            matrix is small enough for push constants, which need no buffer
+            or descriptor at all. The only descriptor set is the bindless
+            table of voxel materials, when there is one.
         */
+        VkPushConstantRange pushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .offset = 0,
+            .size = sizeof(PushConstants)
+        };
+        VkDescriptorSetLayout bindlessSetLayout = bindless
+            ? bindlessTable->setLayout()
+            : VK_NULL_HANDLE;
         VkPipelineLayoutCreateInfo pipelineLayoutInfo {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
             // below are optional
-            .setLayoutCount = 0,
-            .pSetLayouts = nullptr,
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = nullptr
+            .setLayoutCount = bindless ? 1u : 0u,
+            .pSetLayouts = bindless ? &bindlessSetLayout : nullptr,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange
         };
         VkResult createPipelineLayoutResult = vkCreatePipelineLayout(
             device, 
@@ -1125,51 +2315,109 @@ private:
         }
 
         // MARK: Graphics pipeline creation
-        VkGraphicsPipelineCreateInfo pipelineInfo {
-            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-            .stageCount = 2,
-            .pStages = shaderStages,
-
-            // Input piopeline shader stage structs
-            .pVertexInputState = &vertexInputInfo,
-            .pInputAssemblyState = &inputAssembly,
-            .pViewportState = &viewportState,
-            .pRasterizationState = &rasterizerCreateInfo,
-            .pMultisampleState = &multisampling,
-            .pDepthStencilState = nullptr, // depth test disabled
-            .pColorBlendState = &colorBlending,
-            .pDynamicState = &dynamicState,
-
-            // then fixed function
-            .layout = pipelineLayout,
-
-            // then pipeline layout (Vulkan handle rather than struct pointer)
-            .renderPass = renderPass,
-            .subpass = 0,
+        /*
+            The state above is gathered into a description which owns it, and
+            compiled by the PipelineBuilder's worker threads. Variants are
+            copies of the description with a few fields changed.
+
+            We could instead derive variants from the base pipeline
+            (VK_PIPELINE_CREATE_DERIVATIVE_BIT with basePipelineHandle), but
+            drivers largely ignore that hint; the shared pipeline cache is
+            what actually saves work.
+        */
+        GraphicsPipelineDesc baseDesc;
+        baseDesc.shaderStages = { vertShaderStageInfo, fragShaderStageInfo };
+        baseDesc.vertexBindings = vertexBindings;
+        baseDesc.vertexAttributes = vertexAttributes;
+        baseDesc.inputAssembly = inputAssembly;
+        baseDesc.rasterizer = rasterizerCreateInfo;
+        baseDesc.multisampling = multisampling;
+        baseDesc.depthStencil = depthStencil;
+        baseDesc.colorBlendAttachments = { colorBlendAttachment };
+        baseDesc.colorBlending = colorBlending;
+        baseDesc.dynamicStates = dynamicStates;
+        // then fixed function
+        baseDesc.layout = pipelineLayout;
+        // then pipeline layout (Vulkan handle rather than struct pointer)
+        baseDesc.renderPass = renderPass;
+        baseDesc.subpass = 0;
+        // Without a render pass the pipeline names its attachments' formats
+        if(dynamicRendering) {
+            baseDesc.colorAttachmentFormats = { swapChainImageFormat };
+            baseDesc.depthAttachmentFormat = depthFormat;
+        }
 
-            /*
-                We can derive pipelines if we share a lot of functionality in 
-                common. Right now we only have one pipeline, so this is 
-                not needed. These values only used if 
-                VK_PIPELINE_CREATE_DERIVATIVE_IT is set in info.
-                below for reference
-            */
-            .basePipelineHandle = VK_NULL_HANDLE,
-            .basePipelineIndex = -1
-        };
+        /*
+            Depth pre-pass: the same vertex shader with no fragment shader
+            and no color writes lays down the nearest depth first, then the
+            color pass only shades fragments that match it. The early depth
+            test rejects everything hidden before the fragment shader runs.
+            The shaders declare gl_Position invariant, so both pipelines
+            compute bit-identical depth.
+        */
+        GraphicsPipelineDesc prepassDesc = baseDesc;
+        if(config.depthPrepass) {
+            prepassDesc.shaderStages = { vertShaderStageInfo };
+            prepassDesc.colorBlendAttachments[0].colorWriteMask = 0;
+            baseDesc.depthStencil->depthWriteEnable = VK_FALSE;
+            baseDesc.depthStencil->depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        }
 
-        VkResult createPipelineResult = vkCreateGraphicsPipelines(
-            device,
-            VK_NULL_HANDLE,
-            1,
-            &pipelineInfo,
-            nullptr,
-            &graphicsPipeline
-        );
-        if(createPipelineResult != VK_SUCCESS) {
-            throw std::runtime_error("Could not create graphics pipeline!");
+        // Shader compilation happens on the workers; a warm cache skips most
+        // of it
+        auto compileStart = std::chrono::steady_clock::now();
+        unsigned threadCount = config.pipelineThreads != 0
+            ? config.pipelineThreads
+            : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::future<VkPipeline>> variantFutures;
+        std::future<VkPipeline> baseFuture;
+        std::future<VkPipeline> prepassFuture;
+        {
+            PipelineBuilder builder(device, pipelineCache, threadCount);
+
+            baseFuture = builder.submit(baseDesc);
+            if(config.depthPrepass) {
+                prepassFuture = builder.submit(prepassDesc);
+            }
+            for(uint32_t i = 0; i < config.pipelineVariantCount; i++) {
+                variantFutures.push_back(
+                    builder.submit(makePipelineVariant(baseDesc, i))
+                );
+            }
+            // builder joins its workers here, after every submission finished
         }
 
+        // get() rethrows creation failures; collect every result first so
+        // the pipelines that did compile are still destroyed in cleanup()
+        std::exception_ptr failure;
+        try {
+            graphicsPipeline = baseFuture.get();
+        } catch(...) {
+            failure = std::current_exception();
+        }
+        if(prepassFuture.valid()) {
+            try {
+                depthPrepassPipeline = prepassFuture.get();
+            } catch(...) {
+                failure = std::current_exception();
+            }
+        }
+        for(auto& future : variantFutures) {
+            try {
+                pipelineVariants.push_back(future.get());
+            } catch(...) {
+                failure = std::current_exception();
+            }
+        }
+
+        std::cout << 1 + (config.depthPrepass ? 1 : 0) + config.pipelineVariantCount
+                  << " graphics pipelines created on " << threadCount
+                  << " threads in "
+                  << std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - compileStart
+                     ).count()
+                  << "ms" << std::endl;
+
         // clean up shader modules after creating pipeline
         vkDestroyShaderModule(
             device, 
@@ -1181,22 +2429,100 @@ private:
             fragShaderModule, 
             nullptr
         );
+
+        if(failure) {
+            std::rethrow_exception(failure);
+        }
+        invalidateCommands();
+    }
+
+    /*
+        Deterministic permutation number `index` of the base pipeline. The
+        axes multiply out to 96 distinct pipelines before repeating, which is
+        plenty to measure how compile time scales with thread count.
+    */
+    GraphicsPipelineDesc makePipelineVariant(
+        const GraphicsPipelineDesc& base,
+        uint32_t index
+    ) {
+        static const VkCullModeFlags cullModes[] = {
+            VK_CULL_MODE_BACK_BIT,
+            VK_CULL_MODE_NONE,
+            VK_CULL_MODE_FRONT_BIT
+        };
+
+        GraphicsPipelineDesc desc = base;
+
+        desc.rasterizer.cullMode = cullModes[index % 3];
+        index /= 3;
+
+        desc.rasterizer.frontFace = (index % 2)
+            ? VK_FRONT_FACE_COUNTER_CLOCKWISE
+            : VK_FRONT_FACE_CLOCKWISE;
+        index /= 2;
+
+        // Wireframe needs the fillModeNonSolid feature
+        if((index % 2) && enabledFeatures.fillModeNonSolid) {
+            desc.rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
+        }
+        index /= 2;
+
+        desc.rasterizer.depthBiasEnable = (index % 2) ? VK_TRUE : VK_FALSE;
+        index /= 2;
+
+        // Standard alpha blending
+        if(index % 2) {
+            VkPipelineColorBlendAttachmentState& blend = desc.colorBlendAttachments[0];
+            blend.blendEnable = VK_TRUE;
+            blend.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            blend.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            blend.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+            blend.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        }
+        index /= 2;
+
+        if(index % 2) {
+            desc.inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+        }
+
+        return desc;
     }
 
     void initVulkan() {
         createInstance();
         setupDebugMessenger();
-        createSurface();
+        if(!config.headless) {
+            createSurface();
+        }
         pickPhysicalDevice();
         createLogicalDevice();
-        createSwapChain();
+        if(config.headless) {
+            createOffscreenTargets();
+        } else {
+            createSwapChain();
+        }
         createImageViews();
-        createRenderPass();
+        depthFormat = findDepthFormat();
+        createDepthResources();
+        if(!dynamicRendering) {
+            createRenderPass();
+        }
+        createPipelineCache();
+        if(bindless) {
+            createMaterials();
+        }
         createGraphicsPipeline();
-        createFramebuffers();
+        if(!dynamicRendering) {
+            createFramebuffers();
+        }
         createCommandPool();
-        createCommandBuffer();
+        createJobSystem();
+        createMeshes();
+        createCommandBuffers();
         createSyncObjects();
+        if(config.headless && !config.frameOutputDir.empty()) {
+            createReadbackBuffers();
+        }
     }
 
     // MARK: Synchronization
@@ -1214,42 +2540,521 @@ private:
             .flags = VK_FENCE_CREATE_SIGNALED_BIT
         };
 
-        VkResult result;
-        result = vkCreateSemaphore(
-            device,
-            &semaphoreInfo,
-            nullptr,
-            &imageAvailableSemaphore
-        );
-        if(result != VK_SUCCESS) {
-            throw std::runtime_error("could not create image available semaphore");
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
+        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            VkResult result;
+            result = vkCreateSemaphore(
+                device,
+                &semaphoreInfo,
+                nullptr,
+                &imageAvailableSemaphores[i]
+            );
+            if(result != VK_SUCCESS) {
+                throw std::runtime_error("could not create image available semaphore");
+            }
+
+            result = vkCreateSemaphore(
+                device,
+                &semaphoreInfo,
+                nullptr,
+                &renderFinishedSemaphores[i]
+            );
+            if(result != VK_SUCCESS) {
+                throw std::runtime_error("could not create render finished semaphore");
+            }
+
+            result = vkCreateFence(
+                device,
+                &fenceInfo,
+                nullptr,
+                &inFlightFences[i]
+            );
+            if(result != VK_SUCCESS) {
+                throw std::runtime_error("could not create in flight fence");
+            }
         }
+    }
 
-        result = vkCreateSemaphore(
-            device,
-            &semaphoreInfo,
-            nullptr,
-            &renderFinishedSemaphore
+    /*
+        Writes this frame's candidate chunks and works out which are in the
+        frustum: on the GPU in a compute pass, or on the CPU into
+        visibleChunks (indices into the streamer's draws).
+
+        GPU culling leaves the CPU nothing to do per chunk. With
+        --verify-cull the CPU reference runs as well, only to count, and the
+        count is compared with the GPU's once the frame is done.
+    */
+    void recordChunkCulling(VkCommandBuffer commandBuffer, std::vector<uint32_t>& visibleChunks) {
+        const std::vector<ChunkDraw>& draws = streamer->draws();
+        culler->setChunks(currentFrame, draws);
+
+        glm::mat4 vp = viewProjection();
+        if(cullMode != CullMode::Gpu || config.verifyCulling) {
+            Frustum frustum = extractFrustum(vp);
+            for(uint32_t i = 0; i < draws.size(); i++) {
+                glm::vec3 boxMin(draws[i].origin.x, draws[i].origin.y, draws[i].origin.z);
+                glm::vec3 boxMax = boxMin + glm::vec3(static_cast<float>(CHUNK_SIZE));
+                if(cullMode == CullMode::Off || boxInFrustum(frustum, boxMin, boxMax)) {
+                    visibleChunks.push_back(i);
+                }
+            }
+            profiler.record("cull_visible_chunks", visibleChunks.size());
+        }
+
+        if(cullMode == CullMode::Gpu) {
+            culler->recordCull(
+                commandBuffer,
+                currentFrame,
+                vp,
+                occlusionCulling ? CullPhase::Early : CullPhase::Frustum
+            );
+            cullCountsPending[currentFrame] = true;
+            if(config.verifyCulling) {
+                referenceDrawCounts[currentFrame] = static_cast<uint32_t>(visibleChunks.size());
+            }
+        }
+    }
+
+    /*
+        Occlusion culling, between the early draws and the late ones: ends
+        the early render pass, builds the Hi-Z pyramid from its depth and
+        culls against it, then carries on in the late render pass, on the
+        same framebuffer, with the chunks that just came into view.
+    */
+    void recordOcclusionLatePass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        endScenePass(commandBuffer, imageIndex, ScenePass::Early);
+
+        glm::mat4 mvp = viewProjection();
+        culler->recordOcclusion(commandBuffer, currentFrame, depthImage, depthAspectMask(), mvp);
+
+        beginScenePass(commandBuffer, imageIndex, ScenePass::Late, false);
+
+        recordPassState(commandBuffer, graphicsPipeline, mvp);
+        bindStreamedChunks(commandBuffer);
+        culler->recordDraws(commandBuffer, currentFrame, CullPhase::Late);
+    }
+
+    // Streamed chunks share one vertex and one index buffer; each draw
+    // picks its chunk's ranges through firstIndex and vertexOffset, and
+    // its origin from the chunk records through firstInstance
+    void bindStreamedChunks(VkCommandBuffer commandBuffer) {
+        VkBuffer vertexBuffers[2] = {
+            streamer->vertexBuffer(),
+            culler->recordBuffer(currentFrame)
+        };
+        VkDeviceSize offsets[2] = { 0, 0 };
+        vkCmdBindVertexBuffers(
+            commandBuffer,
+            0,
+            2,
+            vertexBuffers,
+            offsets
         );
-        if(result != VK_SUCCESS) {
-            throw std::runtime_error("could not create render finished semaphore");
+        vkCmdBindIndexBuffer(
+            commandBuffer,
+            streamer->indexBuffer(),
+            0,
+            VK_INDEX_TYPE_UINT32
+        );
+    }
+
+    // Pipeline and dynamic state for draws; none of it carries over from
+    // one render pass, or command buffer, to the next
+    void recordPassState(VkCommandBuffer commandBuffer, VkPipeline pipeline, const glm::mat4& mvp) {
+        vkCmdBindPipeline(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipeline
+        );
+
+        // ! Need to set viewport and scissor here since it's dynamic.
+        VkViewport viewport {
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(swapChainExtent.width),
+            .height = static_cast<float>(swapChainExtent.height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        };
+        vkCmdSetViewport(
+            commandBuffer,
+            0,
+            1,
+            &viewport
+        );
+
+        VkRect2D scissor {
+            .offset = { 0, 0 },
+            .extent = swapChainExtent
+        };
+        vkCmdSetScissor(
+            commandBuffer,
+            0,
+            1,
+            &scissor
+        );
+
+        vkCmdPushConstants(
+            commandBuffer,
+            pipelineLayout,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            offsetof(PushConstants, mvp),
+            sizeof(mvp),
+            &mvp
+        );
+
+        // Every draw's materials, whatever block types it has
+        if(bindless) {
+            VkDescriptorSet materialSet = bindlessTable->set();
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelineLayout,
+                0,
+                1,
+                &materialSet,
+                0,
+                nullptr
+            );
         }
+    }
 
-        result = vkCreateFence(
-            device,
-            &fenceInfo,
-            nullptr,
-            &inFlightFence
+    // A draw call per mesh in [begin, end). Only reads, so ranges can be
+    // recorded on several threads at once.
+    void recordMeshDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) const {
+        for(uint32_t i = begin; i < end; i++) {
+            const Mesh& mesh = meshes[i];
+            if(mesh.indexCount == 0) {
+                continue;
+            }
+            // Only the origin changes between chunks; the matrix stays
+            if(config.voxelGrid > 0) {
+                vkCmdPushConstants(
+                    commandBuffer,
+                    pipelineLayout,
+                    VK_SHADER_STAGE_VERTEX_BIT,
+                    offsetof(PushConstants, chunkOrigin),
+                    sizeof(mesh.origin),
+                    &mesh.origin
+                );
+            }
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(
+                commandBuffer,
+                0,
+                1,
+                &mesh.vertexBuffer,
+                &offset
+            );
+            vkCmdBindIndexBuffer(
+                commandBuffer,
+                mesh.indexBuffer,
+                0,
+                VK_INDEX_TYPE_UINT32
+            );
+            vkCmdDrawIndexed(
+                commandBuffer,
+                mesh.indexCount,
+                1, // Set 1 for non-instanced rendering
+                0,
+                0,
+                0
+            );
+        }
+    }
+
+    /*
+        --record-threads: the mesh draws split in ranges, each recorded in
+        its own secondary command buffer on the job threads, for the render
+        pass begun with SECONDARY_COMMAND_BUFFERS contents. Secondaries
+        inherit no state, so each sets up its own pipeline and constants.
+        With the depth pre-pass, every range's depth goes first.
+    */
+    void recordSceneDrawsParallel(
+        VkCommandBuffer commandBuffer,
+        uint32_t imageIndex,
+        const glm::mat4& mvp
+    ) {
+        secondaryRecorder->beginFrame(currentFrame);
+        VkCommandBufferInheritanceInfo inheritance {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = renderPass,
+            .subpass = 0,
+            // Optional, but lets the driver know the attachments up front
+            .framebuffer = dynamicRendering
+                ? VK_NULL_HANDLE
+                : swapChainFrameBuffers[imageIndex]
+        };
+        // With dynamic rendering the secondaries name the attachment
+        // formats instead of a render pass
+        VkCommandBufferInheritanceRenderingInfoKHR renderingInheritance {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &swapChainImageFormat,
+            .depthAttachmentFormat = depthFormat,
+            .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+            .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+        };
+        if(dynamicRendering) {
+            inheritance.pNext = &renderingInheritance;
+        }
+
+        std::vector<VkCommandBuffer> secondaries;
+        auto recordPass = [&](VkPipeline pipeline) {
+            secondaryRecorder->record(
+                *jobs,
+                currentFrame,
+                inheritance,
+                static_cast<uint32_t>(meshes.size()),
+                [this, pipeline, &mvp](VkCommandBuffer secondary, uint32_t begin, uint32_t end) {
+                    recordPassState(secondary, pipeline, mvp);
+                    recordMeshDraws(secondary, begin, end);
+                },
+                secondaries
+            );
+        };
+        if(config.depthPrepass) {
+            recordPass(depthPrepassPipeline);
+        }
+        recordPass(graphicsPipeline);
+
+        if(!secondaries.empty()) {
+            vkCmdExecuteCommands(
+                commandBuffer,
+                static_cast<uint32_t>(secondaries.size()),
+                secondaries.data()
+            );
+        }
+    }
+
+    // Pixels in a frame, for the overdraw ratio
+    uint64_t framePixels() const {
+        return uint64_t(swapChainExtent.width) * swapChainExtent.height;
+    }
+
+    // Every draw of the frame, with the pipeline already bound
+    void recordSceneDraws(
+        VkCommandBuffer commandBuffer,
+        uint32_t imageIndex,
+        const std::vector<uint32_t>& visibleChunks
+    ) {
+        if(streamer) {
+            bindStreamedChunks(commandBuffer);
+            if(cullMode == CullMode::Gpu) {
+                culler->recordDraws(
+                    commandBuffer,
+                    currentFrame,
+                    occlusionCulling ? CullPhase::Early : CullPhase::Frustum
+                );
+                if(occlusionCulling) {
+                    recordOcclusionLatePass(commandBuffer, imageIndex);
+                }
+            } else {
+                const std::vector<ChunkDraw>& draws = streamer->draws();
+                for(uint32_t i : visibleChunks) {
+                    vkCmdDrawIndexed(
+                        commandBuffer,
+                        draws[i].indexCount,
+                        1,
+                        draws[i].firstIndex,
+                        draws[i].vertexOffset,
+                        i
+                    );
+                }
+            }
+        }
+
+        recordMeshDraws(commandBuffer, 0, static_cast<uint32_t>(meshes.size()));
+    }
+
+    /*
+        Starts drawing into the swap chain image and the depth image.
+
+        With render pass objects the pass does the layout changes and
+        clears. With dynamic rendering the attachments are named here
+        instead, and the layout changes a render pass would have made are
+        our own barriers: into attachment layouts here, and out to present
+        (or copy) in endScenePass().
+    */
+    void beginScenePass(
+        VkCommandBuffer commandBuffer,
+        uint32_t imageIndex,
+        ScenePass pass,
+        bool secondaryContents
+    ) {
+        // In attachment order: color, then depth cleared to the far plane
+        VkClearValue clearValues[2] = {};
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        VkRect2D renderArea {
+            .offset = { 0, 0 },
+            .extent = swapChainExtent
+        };
+
+        if(!dynamicRendering) {
+            VkRenderPass passes[] = { renderPass, earlyRenderPass, lateRenderPass };
+            VkRenderPassBeginInfo renderPassInfo {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .renderPass = passes[static_cast<int>(pass)],
+                // Specify attachments to bind
+                .framebuffer = swapChainFrameBuffers[imageIndex],
+                /*
+                    Define render size. This defines where shader loads and
+                    stores take place. Anything outside this region is
+                    undefined.
+
+                    Should match size of attachments for best performance.
+                */
+                .renderArea = renderArea,
+                // The late pass loads what the early one stored instead
+                .clearValueCount = pass == ScenePass::Late ? 0u : 2u,
+                .pClearValues = clearValues
+            };
+            vkCmdBeginRenderPass(
+                commandBuffer,
+                &renderPassInfo,
+                secondaryContents
+                    ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                    : VK_SUBPASS_CONTENTS_INLINE
+            );
+            return;
+        }
+
+        VkImageMemoryBarrier barriers[2] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                // Contents are cleared, so whatever was there can go
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = swapChainImages[imageIndex],
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                // Shared between frames in flight: wait for the last
+                // frame's depth writes, as the render pass dependency does
+                .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+                    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = depthImage,
+                .subresourceRange = { depthAspectMask(), 0, 1, 0, 1 }
+            }
+        };
+        if(pass == ScenePass::Late) {
+            // Keep the early pass's color and draw over it. Its depth comes
+            // back from recordOcclusion() already in attachment layout.
+            barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+                | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            // Color waits on the same stage as the image available semaphore
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            pass == ScenePass::Late ? 1 : 2, barriers
         );
-        if(result != VK_SUCCESS) {
-            throw std::runtime_error("could not create in flight fence");
+
+        VkAttachmentLoadOp loadOp = pass == ScenePass::Late
+            ? VK_ATTACHMENT_LOAD_OP_LOAD
+            : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        VkRenderingAttachmentInfoKHR colorAttachment {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .imageView = swapChainImageViews[imageIndex],
+            .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .loadOp = loadOp,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .clearValue = clearValues[0]
+        };
+        VkRenderingAttachmentInfoKHR depthAttachment {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .imageView = depthImageView,
+            .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .loadOp = loadOp,
+            // Only kept for building the Hi-Z pyramid
+            .storeOp = pass == ScenePass::Early
+                ? VK_ATTACHMENT_STORE_OP_STORE
+                : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .clearValue = clearValues[1]
+        };
+        VkRenderingInfoKHR renderingInfo {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+            .flags = secondaryContents
+                ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR
+                : 0u,
+            .renderArea = renderArea,
+            .layerCount = 1,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachment,
+            .pDepthAttachment = &depthAttachment
+        };
+        cmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    void endScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, ScenePass pass) {
+        if(!dynamicRendering) {
+            vkCmdEndRenderPass(commandBuffer);
+            return;
+        }
+        cmdEndRendering(commandBuffer);
+        if(pass == ScenePass::Early) {
+            // Stays attached for the late pass
+            return;
         }
+
+        // The render pass's final layout: presented, or copied out headless
+        VkImageMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = config.headless ? VK_ACCESS_TRANSFER_READ_BIT : 0u,
+            .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .newLayout = config.headless
+                ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = swapChainImages[imageIndex],
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            // Presentation waits on the render finished semaphore
+            config.headless
+                ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
     }
 
     void recordCommandBuffer(
         VkCommandBuffer commandBuffer,
         // Swapchain image we wish to write to.
-        uint32_t imageIndex
+        uint32_t imageIndex,
+        // Uploads that become visible to this frame
+        const UploadAcquire& uploadAcquire
     ) {
         VkCommandBufferBeginInfo beginInfo {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -1282,109 +3087,617 @@ private:
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
-        // MARK: Starting render pass
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-
-        VkRenderPassBeginInfo renderPassInfo {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            // Get render pass
-            .renderPass = renderPass,
-            // Specify attachments to bind
-            .framebuffer = swapChainFrameBuffers[imageIndex],
+        // Take ownership of freshly uploaded buffers from the transfer queue
+        uploadAcquire.record(commandBuffer);
 
-            /*
-                Define render size. This defines where shader loads and stores
-                take place. Anything outside this region is undefined.
-
-                Should match size of attachments for best performance.
-            */
-            .renderArea = {
-                .offset = { 0, 0 },
-                .extent = swapChainExtent
-            },
+        // The streamed chunks worth drawing are worked out before the render
+        // pass: compute dispatches are not allowed inside one
+        std::vector<uint32_t> visibleChunks;
+        if(streamer) {
+            recordChunkCulling(commandBuffer, visibleChunks);
+        }
 
-            /*
-                Define clear color. In this case black.
-            */
-            .clearValueCount = 1,
-            .pClearValues = &clearColor
-        };
+        // Time the render pass on the GPU; read back in drawFrame()
+        gpuTimer->reset(commandBuffer, currentFrame);
+        gpuTimer->begin(commandBuffer, currentFrame);
+        overdrawCounter->reset(commandBuffer, currentFrame);
+        overdrawCounter->begin(commandBuffer, currentFrame);
 
-        vkCmdBeginRenderPass(
+        // MARK: Starting render pass
+        /*
+            Controls how the drawing commands are provided: inline in this
+            primary command buffer, or by secondary command buffers with
+            --record-threads, see recordSceneDrawsParallel().
+        */
+        beginScenePass(
             commandBuffer,
-            &renderPassInfo,
-            /*
-                Controls how the drawing commands are provided.
-
-                INLINE -> Primary command buffer holds drawing commands and no
-                secondary commands are to be executed.
-
-                SECONDARY_COMMAND_BUFFERS -> Render pass commands to be executed
-                by secondary command buffers.
-
-                We use INLINE as we do not currently use secondary command
-                buffers.
-            */
-            VK_SUBPASS_CONTENTS_INLINE
+            imageIndex,
+            occlusionCulling ? ScenePass::Early : ScenePass::Whole,
+            secondaryRecorder != nullptr
         );
 
-        vkCmdBindPipeline(
+        glm::mat4 mvp = viewProjection();
+        if(secondaryRecorder) {
+            recordSceneDrawsParallel(commandBuffer, imageIndex, mvp);
+        } else {
+            if(config.depthPrepass) {
+                recordPassState(commandBuffer, depthPrepassPipeline, mvp);
+                recordSceneDraws(commandBuffer, imageIndex, visibleChunks);
+            }
+            recordPassState(commandBuffer, graphicsPipeline, mvp);
+            recordSceneDraws(commandBuffer, imageIndex, visibleChunks);
+        }
+
+        // End render pass
+        endScenePass(
             commandBuffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            graphicsPipeline
+            imageIndex,
+            occlusionCulling ? ScenePass::Late : ScenePass::Whole
         );
+        overdrawCounter->end(commandBuffer, currentFrame);
+        gpuTimer->end(commandBuffer, currentFrame);
 
-        // ! Need to set viewport and scissor here since it's dynamic.
-        VkViewport viewport {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(swapChainExtent.width),
-            .height = static_cast<float>(swapChainExtent.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
+        // Headless: copy the finished frame out for writing to disk
+        if(!readbackBuffers.empty()) {
+            recordReadback(commandBuffer, imageIndex);
+        }
+
+        // Finish recording command buffer
+        VkResult recordResult = vkEndCommandBuffer(commandBuffer);
+        if(recordResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        // Image is already in TRANSFER_SRC_OPTIMAL from endScenePass()
+        VkBufferImageCopy region {
+            .bufferOffset = 0,
+            // 0 means tightly packed according to imageExtent
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 }
         };
-        vkCmdSetViewport(
+        vkCmdCopyImageToBuffer(
             commandBuffer,
-            0,
+            swapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            readbackBuffers[imageIndex],
             1,
-            &viewport
+            &region
         );
 
-        VkRect2D scissor {
-            .offset = { 0, 0 },
-            .extent = swapChainExtent
+        // Make the copy visible to the host once the fence is waited on
+        VkBufferMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = readbackBuffers[imageIndex],
+            .offset = 0,
+            .size = VK_WHOLE_SIZE
         };
-        vkCmdSetScissor(
+        vkCmdPipelineBarrier(
             commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
             0,
-            1,
-            &scissor
+            0, nullptr,
+            1, &barrier,
+            0, nullptr
         );
+    }
 
-        // Issue draw call
-        vkCmdDraw(
-            commandBuffer,
-            3, // 3 verts to draw even w/o vertex buffer
-            1, // Set 1 for non-instanced rendering
+    // MARK: Buffer uploads
+    /*
+        Device local memory is the fastest for the GPU to read but usually
+        not visible to the CPU. The upload scheduler stages the data in host
+        visible memory and copies it across on the transfer queue; frames
+        wait for the copy before drawing.
+    */
+    VkBuffer createDeviceLocalBuffer(
+        const void* data,
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkAccessFlags dstAccess,
+        GpuAllocation& allocation
+    ) {
+        VkBuffer buffer = allocator->createBuffer(
+            size,
+            usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            allocation
+        );
+        uploads->enqueue(
+            buffer,
             0,
-            0
+            data,
+            size,
+            dstAccess,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
         );
+        return buffer;
+    }
 
-        // End render pass
-        vkCmdEndRenderPass(commandBuffer);
+    Mesh createMesh(
+        const void* vertices,
+        VkDeviceSize vertexBytes,
+        const std::vector<uint32_t>& indices
+    ) {
+        Mesh mesh;
+        mesh.vertexBuffer = createDeviceLocalBuffer(
+            vertices,
+            vertexBytes,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            mesh.vertexAllocation
+        );
+        mesh.indexBuffer = createDeviceLocalBuffer(
+            indices.data(),
+            sizeof(uint32_t) * indices.size(),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_ACCESS_INDEX_READ_BIT,
+            mesh.indexAllocation
+        );
+        mesh.indexCount = static_cast<uint32_t>(indices.size());
+        return mesh;
+    }
 
-        // Finish recording command buffer
-        VkResult recordResult = vkEndCommandBuffer(commandBuffer);
-        if(recordResult != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+    Mesh createMesh(const MeshData& data) {
+        return createMesh(
+            data.vertices.data(),
+            sizeof(Vertex) * data.vertices.size(),
+            data.indices
+        );
+    }
+
+    Mesh createMesh(const VoxelMeshData& data) {
+        Mesh mesh = createMesh(
+            data.vertices.data(),
+            sizeof(VoxelVertex) * data.vertices.size(),
+            data.indices
+        );
+        mesh.origin = glm::vec4(data.origin, 0.0f);
+        return mesh;
+    }
+
+    /*
+        Benchmark scene: triangleCount small triangles, one per cell of a
+        square grid over the viewport, split as evenly as possible over
+        drawCount meshes so each mesh is one draw call.
+    */
+    std::vector<MeshData> generateTriangleGrid(
+        uint32_t triangleCount,
+        uint32_t drawCount
+    ) {
+        uint32_t columns = static_cast<uint32_t>(
+            std::ceil(std::sqrt(static_cast<double>(triangleCount)))
+        );
+        float cell = 1.8f / columns;
+        float half = cell * 0.4f;
+
+        std::vector<MeshData> draws(drawCount);
+        for(uint32_t i = 0; i < triangleCount; i++) {
+            MeshData& mesh = draws[static_cast<uint64_t>(i) * drawCount / triangleCount];
+            float cx = -0.9f + (i % columns + 0.5f) * cell;
+            float cy = -0.9f + (i / columns + 0.5f) * cell;
+            glm::vec3 color(
+                (i % 7) / 6.0f,
+                (i % 5) / 4.0f,
+                (i % 3) / 2.0f
+            );
+
+            // Same winding as the tutorial triangle, so it survives culling
+            uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+            mesh.vertices.push_back({ { cx, cy - half, 0.0f }, color });
+            mesh.vertices.push_back({ { cx + half, cy + half, 0.0f }, color });
+            mesh.vertices.push_back({ { cx - half, cy + half, 0.0f }, color });
+            mesh.indices.insert(mesh.indices.end(), { base, base + 1, base + 2 });
+        }
+        return draws;
+    }
+
+    // MARK: Voxel scene
+    void createJobSystem() {
+        unsigned threadCount = config.jobThreads != 0
+            ? config.jobThreads
+            : std::max(1u, std::thread::hardware_concurrency());
+        jobs = std::make_unique<JobSystem>(threadCount - 1);
+    }
+
+    /*
+        Terrain chunks around the origin, one mesh (so one draw) per chunk.
+        Generation runs as jobs, one per chunk; then every chunk is dirty,
+        and meshed like any edit would be.
+    */
+    void createVoxelMeshes() {
+        uint32_t grid = config.voxelGrid;
+        voxelChunks.resize(grid * grid);
+        meshes.resize(voxelChunks.size());
+
+        JobGroup generated;
+        for(uint32_t cz = 0; cz < grid; cz++) {
+            for(uint32_t cx = 0; cx < grid; cx++) {
+                jobs->submit(generated, [this, grid, cx, cz]() {
+                    generateTerrain(voxelChunks[cx + cz * grid], cx, cz, 1234);
+                });
+            }
+        }
+        // Meshing reads the neighbours, so every chunk must exist first
+        jobs->wait(generated);
+
+        for(uint32_t i = 0; i < voxelChunks.size(); i++) {
+            dirtyChunks.insert(i);
+        }
+        remeshDirtyChunks();
+    }
+
+    /*
+        Re-meshes every chunk in dirtyChunks, one job per chunk. Finished
+        meshes come back through a lock-free queue; this thread uploads them
+        as they arrive and helps with meshing whenever none are ready. The
+        meshes they replace are retired, as frames in flight still draw them.
+    */
+    void remeshDirtyChunks() {
+        if(dirtyChunks.empty()) {
+            return;
+        }
+        uint32_t grid = config.voxelGrid;
+
+        struct Remeshed {
+            uint32_t chunk;
+            VoxelMeshData mesh;
+        };
+        // Sized for every dirty chunk, so pushes never fail
+        MpmcQueue<Remeshed> meshed(dirtyChunks.size());
+        JobGroup meshing;
+        for(uint32_t index : dirtyChunks) {
+            jobs->submit(meshing, [this, &meshed, grid, index]() {
+                uint32_t cx = index % grid;
+                uint32_t cz = index / grid;
+                // Neighbours let the mesher drop faces between chunks
+                ChunkNeighbors neighbors;
+                auto at = [&](uint32_t x, uint32_t z) -> const Chunk* {
+                    return x < grid && z < grid ? &voxelChunks[x + z * grid] : nullptr;
+                };
+                neighbors.chunks[static_cast<int>(Face::PosX)] = at(cx + 1, cz);
+                neighbors.chunks[static_cast<int>(Face::NegX)] = at(cx - 1, cz);
+                neighbors.chunks[static_cast<int>(Face::PosZ)] = at(cx, cz + 1);
+                neighbors.chunks[static_cast<int>(Face::NegZ)] = at(cx, cz - 1);
+
+                thread_local std::vector<Quad> quads;
+                quads.clear();
+                greedyMesh(voxelChunks[index], neighbors, quads);
+
+                Remeshed remeshed;
+                remeshed.chunk = index;
+                remeshed.mesh.origin = glm::vec3(cx * CHUNK_SIZE, 0.0f, cz * CHUNK_SIZE);
+                appendChunkQuads(quads, remeshed.mesh);
+                meshed.tryPush(remeshed);
+            });
+        }
+        dirtyChunks.clear();
+
+        Remeshed remeshed;
+        auto upload = [&]() {
+            Mesh& mesh = meshes[remeshed.chunk];
+            if(mesh.indexCount > 0) {
+                retiredMeshes.push_back(RetiredMesh {
+                    .mesh = mesh,
+                    .retiredAtFrame = frameNumber
+                });
+            }
+            // Chunks of only air or only buried blocks have nothing to draw
+            mesh = remeshed.mesh.indices.empty() ? Mesh{} : createMesh(remeshed.mesh);
+        };
+        while(!meshing.done()) {
+            if(meshed.tryPop(remeshed)) {
+                upload();
+            } else if(!jobs->runOne()) {
+                std::this_thread::yield();
+            }
+        }
+        // Rethrows meshing errors
+        jobs->wait(meshing);
+        while(meshed.tryPop(remeshed)) {
+            upload();
+        }
+
+        invalidateCommands();
+    }
+
+    /*
+        --voxel-edits: digs out or places config.voxelEdits blocks on top of
+        the terrain, at spots picked from the frame number alone so runs
+        repeat. Each edit marks its chunk dirty, and the neighbour across
+        the border when it is on one, as that neighbour's faces against it
+        change too.
+    */
+    void editVoxels(uint64_t frame) {
+        uint32_t grid = config.voxelGrid;
+        for(uint32_t i = 0; i < config.voxelEdits; i++) {
+            uint64_t h = (frame * 0x9e3779b97f4a7c15ull) ^ (i * 0xbf58476d1ce4e5b9ull);
+            h ^= h >> 31;
+            h *= 0x94d049bb133111ebull;
+            h ^= h >> 29;
+
+            uint32_t x = h % (grid * CHUNK_SIZE);
+            uint32_t z = (h >> 20) % (grid * CHUNK_SIZE);
+            uint32_t cx = x / CHUNK_SIZE;
+            uint32_t cz = z / CHUNK_SIZE;
+            int bx = x % CHUNK_SIZE;
+            int bz = z % CHUNK_SIZE;
+            Chunk& chunk = voxelChunks[cx + cz * grid];
+
+            // The highest solid block of the column, -1 for none
+            int top = CHUNK_SIZE - 1;
+            while(top >= 0 && chunk.get(bx, top, bz) == BLOCK_AIR) {
+                top--;
+            }
+            if((h >> 40) & 1) {
+                if(top + 1 >= CHUNK_SIZE) {
+                    continue;
+                }
+                chunk.set(bx, top + 1, bz, BLOCK_GRASS);
+            } else {
+                // Leave the bottom layer, so no column is dug through
+                if(top <= 0) {
+                    continue;
+                }
+                chunk.set(bx, top, bz, BLOCK_AIR);
+            }
+
+            dirtyChunks.insert(cx + cz * grid);
+            if(bx == 0 && cx > 0) {
+                dirtyChunks.insert(cx - 1 + cz * grid);
+            }
+            if(bx == CHUNK_SIZE - 1 && cx + 1 < grid) {
+                dirtyChunks.insert(cx + 1 + cz * grid);
+            }
+            if(bz == 0 && cz > 0) {
+                dirtyChunks.insert(cx + (cz - 1) * grid);
+            }
+            if(bz == CHUNK_SIZE - 1 && cz + 1 < grid) {
+                dirtyChunks.insert(cx + (cz + 1) * grid);
+            }
+        }
+    }
+
+    void destroyMesh(Mesh& mesh) {
+        allocator->destroyBuffer(mesh.vertexBuffer, mesh.vertexAllocation);
+        allocator->destroyBuffer(mesh.indexBuffer, mesh.indexAllocation);
+    }
+
+    // Destroy retired meshes whose frames are all below completedFrames
+    void destroyRetiredMeshes(uint64_t completedFrames) {
+        auto retired = retiredMeshes.begin();
+        while(retired != retiredMeshes.end()) {
+            if(retired->retiredAtFrame <= completedFrames) {
+                destroyMesh(retired->mesh);
+                retired = retiredMeshes.erase(retired);
+            } else {
+                ++retired;
+            }
+        }
+    }
+
+    struct CameraPose {
+        glm::vec3 position;
+        glm::vec3 forward;
+    };
+
+    /*
+        The --stream camera: a function of the frame number only, so runs
+        are repeatable and headless runs need no input. It flies along +x
+        at half a block per frame, weaving in z, looking ahead and down.
+    */
+    static CameraPose streamCameraPose(uint64_t frame) {
+        float t = static_cast<float>(frame);
+        glm::vec3 position(0.5f * t, 48.0f, 96.0f * std::sin(0.004f * t));
+        // Heading along the path, from its derivative
+        glm::vec3 heading(0.5f, 0.0f, 96.0f * 0.004f * std::cos(0.004f * t));
+        heading /= std::sqrt(heading.x * heading.x + heading.z * heading.z);
+        return CameraPose {
+            .position = position,
+            .forward = glm::vec3(heading.x, -0.35f, heading.z)
+        };
+    }
+
+    /*
+        Flat scenes are already in clip space. The voxel scene is looked at
+        from above one corner of the terrain.
+    */
+    glm::mat4 viewProjection() {
+        if(config.streamRadius > 0) {
+            CameraPose pose = streamCameraPose(frameNumber);
+            glm::mat4 view = glm::lookAt(
+                pose.position,
+                pose.position + pose.forward,
+                glm::vec3(0.0f, 1.0f, 0.0f)
+            );
+            glm::mat4 projection = glm::perspective(
+                glm::radians(60.0f),
+                swapChainExtent.width / static_cast<float>(swapChainExtent.height),
+                0.5f,
+                (config.streamRadius + 1.0f) * CHUNK_SIZE
+            );
+            projection[1][1] *= -1;
+            return projection * view;
+        }
+        if(config.voxelGrid == 0) {
+            return glm::mat4(1.0f);
+        }
+
+        float size = static_cast<float>(config.voxelGrid * CHUNK_SIZE);
+        glm::mat4 view = glm::lookAt(
+            glm::vec3(-0.25f * size, 24.0f + 0.5f * size, -0.25f * size),
+            glm::vec3(0.5f * size, 8.0f, 0.5f * size),
+            glm::vec3(0.0f, 1.0f, 0.0f)
+        );
+        glm::mat4 projection = glm::perspective(
+            glm::radians(60.0f),
+            swapChainExtent.width / static_cast<float>(swapChainExtent.height),
+            0.5f,
+            4.0f * size
+        );
+        // GLM follows OpenGL, where clip space y points up
+        projection[1][1] *= -1;
+        return projection * view;
+    }
+
+    void createChunkCuller() {
+        // Every chunk in the view radius could be a candidate
+        uint32_t side = 2 * config.streamRadius + 1;
+        VkShaderModule cullShader = createShaderModule(readFile("shaders/cull_comp.spv"));
+        VkShaderModule hizShader = VK_NULL_HANDLE;
+        try {
+            if(occlusionCulling) {
+                hizShader = createShaderModule(readFile("shaders/hiz_comp.spv"));
+            }
+            culler = std::make_unique<ChunkCuller>(
+                device,
+                *allocator,
+                pipelineCache,
+                cullShader,
+                hizShader,
+                side,
+                MAX_FRAMES_IN_FLIGHT,
+                cmdDrawIndexedIndirectCount,
+                enabledFeatures.multiDrawIndirect
+            );
+        } catch(...) {
+            vkDestroyShaderModule(device, hizShader, nullptr);
+            vkDestroyShaderModule(device, cullShader, nullptr);
+            throw;
+        }
+        vkDestroyShaderModule(device, hizShader, nullptr);
+        vkDestroyShaderModule(device, cullShader, nullptr);
+        cullCountsPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+        referenceDrawCounts.assign(MAX_FRAMES_IN_FLIGHT, std::nullopt);
+
+        if(occlusionCulling) {
+            if(!dynamicRendering) {
+                createOcclusionRenderPasses();
+            }
+            culler->setDepthSource(depthImageView, swapChainExtent, frameNumber);
+        }
+    }
+
+    /*
+        The bindless table and the voxel materials in it. Their uploads go
+        out with the meshes' first flush.
+    */
+    void createMaterials() {
+        bindlessTable = std::make_unique<BindlessTable>(
+            device,
+            bindlessMaxBuffers,
+            bindlessMaxImages
+        );
+        materials = std::make_unique<MaterialLibrary>(
+            device,
+            *allocator,
+            *uploads,
+            *bindlessTable
+        );
+    }
+
+    void createMeshes() {
+        if(config.streamRadius > 0) {
+            // Fills in over the first frames, from update() in drawFrame
+            streamer = std::make_unique<ChunkStreamer>(
+                *allocator,
+                *uploads,
+                *jobs,
+                VkDeviceSize(config.streamBudgetMiB) * 1024 * 1024,
+                config.streamRadius,
+                1234
+            );
+            createChunkCuller();
+        } else if(config.voxelGrid > 0) {
+            createVoxelMeshes();
+        } else if(config.sceneTriangles == 1 && config.sceneDraws == 1) {
+            // The triangle that used to be hardcoded in shader.vert
+            MeshData triangle {
+                .vertices = {
+                    { { 0.0f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+                    { { 0.5f, 0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f } },
+                    { { -0.5f, 0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } }
+                },
+                .indices = { 0, 1, 2 }
+            };
+            meshes.push_back(createMesh(triangle));
+        } else {
+            for(const MeshData& draw : generateTriangleGrid(
+                config.sceneTriangles,
+                config.sceneDraws
+            )) {
+                meshes.push_back(createMesh(draw));
+            }
+        }
+
+        invalidateCommands();
+
+        // The first frame acquires the batch and waits for it
+        uploads->flush();
+    }
+
+    void destroyMeshes() {
+        for(Mesh& mesh : meshes) {
+            // Empty voxel chunks have no buffers
+            if(mesh.indexCount > 0) {
+                destroyMesh(mesh);
+            }
         }
+        meshes.clear();
+        // The device is idle, so every retired mesh can go
+        destroyRetiredMeshes(UINT64_MAX);
     }
 
     // MARK: Command buffer creation
     /*
-        Create a command buffer which resides on the pool.
+        Create command buffers which reside on the pool, one per frame in
+        flight so a buffer is never re-recorded while the GPU still reads it.
     */
-    void createCommandBuffer() {
+    void createCommandBuffers() {
+        uint32_t graphicsFamily = findQueueFamilies(physicalDevice).graphicsFamily.value();
+        if(config.recordThreads > 0) {
+            secondaryRecorder = std::make_unique<SecondaryRecorder>(
+                device,
+                graphicsFamily,
+                MAX_FRAMES_IN_FLIGHT,
+                config.recordThreads
+            );
+        }
+
+        if(config.cachedCommands) {
+            commandCache = std::make_unique<CommandCache>(
+                device,
+                graphicsFamily,
+                MAX_FRAMES_IN_FLIGHT
+            );
+        }
+
+        // Handed out each frame in drawFrame() instead
+        if(config.commandReset == CommandReset::Pool) {
+            frameCommandPools = std::make_unique<FrameCommandPools>(
+                device,
+                graphicsFamily,
+                MAX_FRAMES_IN_FLIGHT,
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY
+            );
+            return;
+        }
+
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
         VkCommandBufferAllocateInfo allocInfo {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
             .commandPool = commandPool,
@@ -1399,13 +3712,13 @@ private:
                 buffers.
             */
             .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1
+            .commandBufferCount = static_cast<uint32_t>(commandBuffers.size())
         };
 
         VkResult createCommandBufferResult = vkAllocateCommandBuffers(
             device, 
             &allocInfo, 
-            &commandBuffer
+            commandBuffers.data()
         );
         if(createCommandBufferResult != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate command buffers!");
@@ -1432,8 +3745,9 @@ private:
                 individually (otherwise all must be reset together)
 
                 We are recording buffer every frame so we want
-                RESET_COMMAND_BUFFER_BIT. (Unsure why we don't use transient
-                bit)
+                RESET_COMMAND_BUFFER_BIT. This pool is for --command-reset
+                buffer and one-off work; by default frames come from
+                FrameCommandPools, transient pools reset whole each frame.
             */
             .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
             .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()
@@ -1456,15 +3770,16 @@ private:
         swapChainFrameBuffers.resize(swapChainImageViews.size());
 
         for(size_t i = 0; i<swapChainImageViews.size(); i++) {
-            VkImageView attachments = {
-                swapChainImageViews[i]
+            VkImageView attachments[] = {
+                swapChainImageViews[i],
+                depthImageView
             };
 
             VkFramebufferCreateInfo framebufferInfo {
                 .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
                 .renderPass = renderPass,
-                .attachmentCount = 1,
-                .pAttachments = &attachments,
+                .attachmentCount = 2,
+                .pAttachments = attachments,
                 .width = swapChainExtent.width,
                 .height = swapChainExtent.height,
                 .layers = 1
@@ -1539,9 +3854,27 @@ private:
                 finalLayout specifies the layout to transition to when the
                 render pass is complete. We want the image to be presentable
                 to swap chain so choose VK_IMAGE_LAYOUT_PRESENT_SRC_KHR.
+                Headless targets are copied out instead of presented.
             */
             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+            .finalLayout = config.headless
+                ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        };
+
+        /*
+            Depth only matters during the pass: clear it on load and let the
+            driver throw it away afterwards (tilers then never write it out).
+        */
+        VkAttachmentDescription depthAttachment {
+            .format = depthFormat,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
         };
 
         // MARK: Subpasses and Attachment References
@@ -1572,6 +3905,11 @@ private:
             .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
         };
 
+        VkAttachmentReference depthAttachmentRef {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        };
+
         /*
             Next we define the subpass itself
         */
@@ -1583,11 +3921,13 @@ private:
             
             // Define color attachment
             .colorAttachmentCount = 1,
-            .pColorAttachments = &colorAttachmentRef
+            .pColorAttachments = &colorAttachmentRef,
             /*
                 The layout(location = 0) out vec4 outColor
                 referers to THIS INDEX in the attachment reference.
             */
+            // Only one depth attachment per subpass, so no count
+            .pDepthStencilAttachment = &depthAttachmentRef
         };
 
         // MARK: Subpass dependencies
@@ -1619,24 +3959,44 @@ private:
                 Specify operations to wait on. We need to wait on the swap
                 chain image, so we wait on the color attachment stage.
             */
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
                         /*
                 The color attachment stage should wait for this, including
-                for writing.
+                for writing. The depth image is shared between frames in
+                flight, so the clear must also wait for the previous frame's
+                depth writes (late tests is where the last ones happen).
             */
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = 0,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
             .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        };
+
+        /*
+            Headless frames are copied to a readback buffer right after the
+            render pass, so the copy must wait for the color writes.
+        */
+        VkSubpassDependency readbackDependency {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
         };
+        VkSubpassDependency dependencies[] = { dependency, readbackDependency };
 
+        VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
         VkRenderPassCreateInfo renderPassInfo {
             .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-            .attachmentCount = 1,
-            .pAttachments = &colorAttachment,
+            .attachmentCount = 2,
+            .pAttachments = attachments,
             .subpassCount = 1,
             .pSubpasses = &subpass,
-            .dependencyCount = 1,
-            .pDependencies = &dependency
+            .dependencyCount = config.headless ? 2u : 1u,
+            .pDependencies = dependencies
         };
 
         // NOTE: Must clean up render pass
@@ -1651,6 +4011,102 @@ private:
         }
     }
 
+    /*
+        The two halves of the frame with occlusion culling. Same attachments
+        and subpass as renderPass, so both work with its framebuffers and
+        pipeline, but the early pass stores what it drew and leaves it
+        attached, and the late pass picks it up from there.
+    */
+    void createOcclusionRenderPasses() {
+        VkAttachmentDescription attachments[2] = {
+            {
+                .format = swapChainImageFormat,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+            },
+            {
+                .format = depthFormat,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                // Read back to build the Hi-Z pyramid
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+            }
+        };
+        VkAttachmentReference colorAttachmentRef {
+            .attachment = 0,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        };
+        VkAttachmentReference depthAttachmentRef {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        };
+        VkSubpassDescription subpass {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachmentRef,
+            .pDepthStencilAttachment = &depthAttachmentRef
+        };
+        // As in createRenderPass()
+        VkSubpassDependency dependencies[2] = {
+            {
+                .srcSubpass = VK_SUBPASS_EXTERNAL,
+                .dstSubpass = 0,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                    | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                    | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+                    | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            },
+            {
+                .srcSubpass = 0,
+                .dstSubpass = VK_SUBPASS_EXTERNAL,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+            }
+        };
+        VkRenderPassCreateInfo renderPassInfo {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .attachmentCount = 2,
+            .pAttachments = attachments,
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = 1,
+            .pDependencies = dependencies
+        };
+        if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &earlyRenderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create early render pass!");
+        }
+
+        // The early pass's color, and the depth recordOcclusion() handed back
+        for(VkAttachmentDescription& attachment : attachments) {
+            attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            attachment.initialLayout = attachment.finalLayout;
+        }
+        attachments[0].finalLayout = config.headless
+            ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+            : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        renderPassInfo.dependencyCount = config.headless ? 2u : 1u;
+        if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &lateRenderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create late render pass!");
+        }
+    }
+
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
         createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -1679,10 +4135,37 @@ private:
 
     // MARK: Main loop
     void mainLoop() {
-        while(!glfwWindowShouldClose(window)) {
-            // process events (including window close)
-            glfwPollEvents();
-            drawFrame();
+        auto startTime = std::chrono::steady_clock::now();
+
+        auto lastProfileDump = startTime;
+        // Rewrite the profile every few seconds so long runs can be watched
+        auto dumpProfilePeriodically = [&]() {
+            if(config.profileOutputPath.empty()) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if(now - lastProfileDump >= std::chrono::seconds(5)) {
+                profiler.writeFile(config.profileOutputPath);
+                lastProfileDump = now;
+            }
+        };
+
+        if(config.headless) {
+            // No window to close, render a fixed number of frames
+            while(frameNumber < config.frameCount) {
+                drawFrame();
+                dumpProfilePeriodically();
+            }
+        } else {
+            while(
+                !glfwWindowShouldClose(window) &&
+                (config.frameCount == 0 || frameNumber < config.frameCount)
+            ) {
+                // process events (including window close)
+                glfwPollEvents();
+                drawFrame();
+                dumpProfilePeriodically();
+            }
         }
 
         /*
@@ -1691,6 +4174,110 @@ private:
             Recall: drawFrame operations to GPU are asynchronous.
         */
         vkDeviceWaitIdle(device);
+
+        // Frames still sitting in readback buffers are complete after idle
+        for(size_t i = 0; i < readbackBuffers.size(); i++) {
+            writeReadbackFrame(i);
+        }
+
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - startTime
+        ).count();
+        std::cout << "rendered " << frameNumber << " frames in " << seconds
+                  << "s (" << frameNumber / seconds << " fps)" << std::endl;
+        allocator->printStats(std::cout);
+        uploads->printStats(std::cout);
+        if(streamer) {
+            streamer->printStats(std::cout);
+        }
+        if(culler && cullMode == CullMode::Gpu && config.verifyCulling) {
+            std::cout << "gpu culling ("
+                      << (culler->usesDrawIndirectCount() ? "draw indirect count" : "draw indirect")
+                      << (occlusionCulling ? ", hi-z occlusion" : "")
+                      << "): " << cullFramesChecked << " frames checked against the CPU, "
+                      << cullMismatches << " mismatched" << std::endl;
+        }
+
+        // Read the GPU times of the last frames, now they are done
+        for(uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++) {
+            if(std::optional<double> gpuMs = gpuTimer->collect(slot)) {
+                profiler.record("gpu_render_pass_ms", *gpuMs);
+            }
+            if(std::optional<double> overdraw = overdrawCounter->collect(slot, framePixels())) {
+                profiler.record("gpu_overdraw", *overdraw);
+            }
+        }
+        profiler.print(std::cout);
+        if(!config.profileOutputPath.empty()) {
+            profiler.writeFile(config.profileOutputPath);
+        }
+
+        if(!config.benchOutputPath.empty() || !config.benchBaselinePath.empty()) {
+            reportBenchmark(seconds);
+        }
+    }
+
+    // MARK: Benchmark reporting
+    void reportBenchmark(double seconds) {
+        auto p = [&](const char* series, double percentile) {
+            const RollingStats* stats = profiler.find(series);
+            return stats ? stats->percentile(percentile) : 0.0;
+        };
+
+        BenchResult result;
+        result.scene = (config.streamRadius > 0
+                ? "s" + std::to_string(config.streamRadius) + (config.occlusionCulling ? "o" : "") + "_"
+                : "")
+            + (config.voxelGrid > 0 ? "v" + std::to_string(config.voxelGrid) + "_" : "")
+            + (config.voxelEdits > 0 ? "e" + std::to_string(config.voxelEdits) + "_" : "")
+            + (config.depthPrepass ? "zp_" : "")
+            + (config.recordThreads > 0 ? "r" + std::to_string(config.recordThreads) + "_" : "")
+            + (config.commandReset == CommandReset::Buffer ? "rb_" : "")
+            + (config.cachedCommands ? "cc_" : "")
+            + (config.forceRenderPass ? "rp_" : "")
+            + (config.noBindless ? "nb_" : "")
+            + "t" + std::to_string(config.sceneTriangles)
+            + "_d" + std::to_string(config.sceneDraws)
+            + "_" + std::to_string(config.width)
+            + "x" + std::to_string(config.height);
+        result.width = config.width;
+        result.height = config.height;
+        result.triangles = config.sceneTriangles;
+        result.draws = config.sceneDraws;
+        result.frames = frameNumber;
+        result.seconds = seconds;
+        result.fps = frameNumber / seconds;
+        result.recordP50Ms = p("cpu_record_ms", 0.50);
+        result.recordP95Ms = p("cpu_record_ms", 0.95);
+        result.submitP50Ms = p("cpu_submit_ms", 0.50);
+        result.submitP95Ms = p("cpu_submit_ms", 0.95);
+        result.resetP50Ms = p("cpu_reset_ms", 0.50);
+        result.resetP95Ms = p("cpu_reset_ms", 0.95);
+        result.gpuP50Ms = p("gpu_render_pass_ms", 0.50);
+        result.peakResidentKiB = peakResidentKiB();
+        result.peakGpuBytes = allocator->stats().peakReservedBytes;
+
+        if(!config.benchOutputPath.empty()) {
+            appendBenchResult(config.benchOutputPath, result);
+        }
+
+        if(!config.benchBaselinePath.empty()) {
+            std::optional<BenchResult> baseline = findBenchResult(
+                config.benchBaselinePath,
+                result.scene
+            );
+            if(!baseline) {
+                std::cout << "no baseline for " << result.scene << " in "
+                          << config.benchBaselinePath << std::endl;
+            } else if(!compareBenchResult(
+                result,
+                *baseline,
+                config.benchTolerance,
+                std::cout
+            )) {
+                benchRegressed = true;
+            }
+        }
     }
 
     // MARK: Frame rendering
@@ -1717,64 +4304,223 @@ private:
             to wait for render to prevent double-rendering.
         */
 
-        // Wait for previous frame to complete
+        // Frame time is measured start to start, so it includes whatever
+        // the main loop does between frames
+        Profiler::Clock::time_point frameStart = Profiler::Clock::now();
+        if(lastFrameStart) {
+            profiler.record(
+                "frame_ms",
+                std::chrono::duration<double, std::milli>(
+                    frameStart - *lastFrameStart
+                ).count()
+            );
+        }
+        lastFrameStart = frameStart;
+
+        // Wait for the frame that last used this slot to complete, which was
+        // MAX_FRAMES_IN_FLIGHT frames ago; newer frames may still execute.
         // Relies on initial condition of fence being signaled.
-        vkWaitForFences(
-            device,
-            1,
-            &inFlightFence,
-            VK_TRUE,
-            UINT64_MAX
-        );
+        {
+            Profiler::Scope scope(profiler, "cpu_wait_ms");
+            vkWaitForFences(
+                device,
+                1,
+                &inFlightFences[currentFrame],
+                VK_TRUE,
+                UINT64_MAX
+            );
+        }
 
-        // Manually reset fence to unsignaled state once signaled
-        vkResetFences(
-            device,
-            1,
-            &inFlightFence
-        );
+        // Its timestamps are available now the fence has signaled
+        if(std::optional<double> gpuMs = gpuTimer->collect(currentFrame)) {
+            profiler.record("gpu_render_pass_ms", *gpuMs);
+        }
+        if(std::optional<double> overdraw = overdrawCounter->collect(currentFrame, framePixels())) {
+            profiler.record("gpu_overdraw", *overdraw);
+        }
+
+        // Its chunk draws too, checked against the CPU reference if it ran
+        if(culler && cullCountsPending[currentFrame]) {
+            CullCounts counts = culler->readCounts(currentFrame);
+            uint32_t gpuDraws = counts.earlyDraws + counts.lateDraws;
+            profiler.record("cull_gpu_draws", gpuDraws);
+            // Everything in the frustum is drawn early, drawn late or occluded
+            uint32_t inFrustum = gpuDraws;
+            if(occlusionCulling) {
+                profiler.record("cull_early_draws", counts.earlyDraws);
+                profiler.record("cull_late_draws", counts.lateDraws);
+                profiler.record("cull_occluded", counts.occluded);
+                profiler.record("cull_frustum_culled", counts.frustumCulled);
+                inFrustum += counts.occluded;
+            }
+            if(referenceDrawCounts[currentFrame]) {
+                cullFramesChecked++;
+                if(inFrustum != *referenceDrawCounts[currentFrame]) {
+                    cullMismatches++;
+                }
+                referenceDrawCounts[currentFrame].reset();
+            }
+            cullCountsPending[currentFrame] = false;
+        }
+
+        // The frame that used this slot is done, and so is every frame
+        // before it; release what only they were using
+        uint64_t completedFrames = frameNumber + 1 > MAX_FRAMES_IN_FLIGHT
+            ? frameNumber + 1 - MAX_FRAMES_IN_FLIGHT
+            : 0;
+        uploads->collect(completedFrames);
+        destroyRetiredSwapChains(completedFrames);
+        destroyRetiredMeshes(completedFrames);
+        if(culler) {
+            culler->collect(completedFrames);
+        }
 
         // Need to acquire an image from the swap chain
         uint32_t imageIndex;
-        vkAcquireNextImageKHR(
+        if(config.headless) {
+            /*
+                Offscreen targets are paired with frame slots, so the fence
+                wait above also guarantees the previous use of this target
+                (and its readback copy) is finished.
+            */
+            imageIndex = currentFrame;
+            if(!readbackBuffers.empty()) {
+                writeReadbackFrame(imageIndex);
+            }
+        } else {
+            VkResult acquireResult;
+            {
+                Profiler::Scope scope(profiler, "cpu_acquire_ms");
+                acquireResult = vkAcquireNextImageKHR(
+                    device,
+                    swapChain,
+                    UINT64_MAX,
+                    imageAvailableSemaphores[currentFrame],
+                    VK_NULL_HANDLE,
+                    &imageIndex
+                );
+            }
+            /*
+                OUT_OF_DATE means the swap chain can no longer be presented to,
+                so skip this frame. The fence is still signaled, as it is only
+                reset below, so the retry does not deadlock. SUBOPTIMAL still
+                acquired an image and its semaphore will signal, so render it
+                and recreate after presenting.
+            */
+            if(acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain();
+                return;
+            } else if(acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error("failed to acquire swap chain image!");
+            }
+        }
+
+        // Manually reset fence to unsignaled state now we know we will
+        // submit work that signals it
+        vkResetFences(
             device,
-            swapChain,
-            UINT64_MAX,
-            imageAvailableSemaphore,
-            VK_NULL_HANDLE,
-            &imageIndex
+            1,
+            &inFlightFences[currentFrame]
         );
 
+        // New chunk meshes go into this frame's upload batch, and evicted
+        // ranges come back once completedFrames has passed them
+        if(streamer) {
+            {
+                Profiler::Scope scope(profiler, "cpu_stream_ms");
+                CameraPose pose = streamCameraPose(frameNumber);
+                streamer->update(pose.position, pose.forward, frameNumber, completedFrames);
+                uploads->flush();
+            }
+            ChunkStreamerStats streamStats = streamer->stats();
+            profiler.record("stream_resident_chunks", streamStats.residentChunks);
+            profiler.record("stream_used_mib", streamStats.usedBytes / (1024.0 * 1024.0));
+        }
+
+        // Edited chunks are re-meshed in parallel, and their new meshes go
+        // into this frame's upload batch
+        if(config.voxelEdits > 0) {
+            Profiler::Scope scope(profiler, "cpu_remesh_ms");
+            editVoxels(frameNumber);
+            remeshDirtyChunks();
+            uploads->flush();
+        }
+
+        // Uploads submitted since the last frame become usable in this one
+        UploadAcquire uploadAcquire = uploads->acquire(frameNumber);
+
+        /*
+            Static scene: the same commands as the last time this slot drew
+            to this image, unless something was invalidated since. Frames
+            acquiring uploads are recorded afresh below, as their barriers
+            only belong to them. Cached buffers come from the cache's own
+            pool, so a frame that uses one resets and acquires nothing here.
+        */
+        bool useCache = commandCache && uploadAcquire.empty();
+
         // Now with the image index to the swap chain image, we can record
         // the command buffer. Reset to ensure it's recordable (it may be
         // in completed state)
-        vkResetCommandBuffer(
-            commandBuffer,
-            // We do not want to do anything special with the reset, so specify
-            // empty flags.
-            0
-        );
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        if(!useCache) {
+            Profiler::Scope scope(profiler, "cpu_reset_ms");
+            if(frameCommandPools) {
+                // The fence has signaled, so everything recorded from this
+                // slot's pool is done with: reset it all in one go
+                frameCommandPools->reset(currentFrame);
+                commandBuffer = frameCommandPools->acquire(currentFrame);
+            } else {
+                commandBuffer = commandBuffers[currentFrame];
+                vkResetCommandBuffer(
+                    commandBuffer,
+                    // We do not want to do anything special with the reset, so specify
+                    // empty flags.
+                    0
+                );
+            }
+        }
 
-        recordCommandBuffer(
-            commandBuffer,
-            imageIndex
-        );
+        {
+            Profiler::Scope scope(profiler, "cpu_record_ms");
+            if(useCache) {
+                VkCommandBuffer cached = commandCache->lookup(
+                    currentFrame,
+                    imageIndex,
+                    commandGeneration
+                );
+                if(cached == VK_NULL_HANDLE) {
+                    cached = commandCache->rerecord(currentFrame, imageIndex, commandGeneration);
+                    recordCommandBuffer(cached, imageIndex, uploadAcquire);
+                }
+                commandBuffer = cached;
+            } else {
+                recordCommandBuffer(
+                    commandBuffer,
+                    imageIndex,
+                    uploadAcquire
+                );
+            }
+        }
 
         // Now with recorded command buffer, we can send it here
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+        std::vector<VkSemaphore> waitSemaphores = uploadAcquire.waitSemaphores;
+        std::vector<VkPipelineStageFlags> waitStages = uploadAcquire.waitStages;
+        if(!config.headless) {
+            /*
+                Wait on writing colors to image until available.
+                Theoretically an implementation could already start executing
+                shaders without available image.
+            */
+            waitSemaphores.push_back(imageAvailableSemaphores[currentFrame]);
+            waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        }
         // Signal render finished when we finish rendering
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
-        /*
-            Wait on writing colors to image until available.
-            Theoretically an implementation could already start executing shaders
-            without available image.
-        */
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
         VkSubmitInfo submitInfo {
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = waitSemaphores,
-            .pWaitDstStageMask = waitStages,
+            .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+            .pWaitSemaphores = waitSemaphores.data(),
+            .pWaitDstStageMask = waitStages.data(),
 
             /*
                 Specify command buffer.
@@ -1789,15 +4535,37 @@ private:
             .pSignalSemaphores = signalSemaphores
         };
 
-        VkResult submitQueueResult = vkQueueSubmit(
-            graphicsQueue,
-            1,
-            &submitInfo,
-            inFlightFence
-        );
+        // Headless: nobody to present to
+        if(config.headless) {
+            submitInfo.signalSemaphoreCount = 0;
+        }
+
+        VkResult submitQueueResult;
+        {
+            Profiler::Scope scope(profiler, "cpu_submit_ms");
+            submitQueueResult = vkQueueSubmit(
+                graphicsQueue,
+                1,
+                &submitInfo,
+                inFlightFences[currentFrame]
+            );
+        }
         if(submitQueueResult != VK_SUCCESS) {
             throw std::runtime_error("failed to draw command buffer!");
         }
+        // Cached buffers write the queries again every time they run, so
+        // their results are read back like freshly recorded ones
+        gpuTimer->markSubmitted(currentFrame);
+        overdrawCounter->markSubmitted(currentFrame);
+
+        if(config.headless) {
+            if(!readbackBuffers.empty()) {
+                pendingReadbackFrame[imageIndex] = static_cast<int64_t>(frameNumber);
+            }
+            frameNumber++;
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+            return;
+        }
 
         VkSwapchainKHR swapChains[] = { swapChain };
 
@@ -1823,11 +4591,26 @@ private:
             .pResults = nullptr
         };
 
-        VkResult result = vkQueuePresentKHR(
-            graphicsQueue,
-            &presentInfo
-        );
-        if(result != VK_SUCCESS) {
+        VkResult result;
+        {
+            Profiler::Scope scope(profiler, "cpu_present_ms");
+            result = vkQueuePresentKHR(
+                graphicsQueue,
+                &presentInfo
+            );
+        }
+
+        frameNumber++;
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+        if(
+            result == VK_ERROR_OUT_OF_DATE_KHR ||
+            result == VK_SUBOPTIMAL_KHR ||
+            framebufferResized
+        ) {
+            framebufferResized = false;
+            recreateSwapChain();
+        } else if(result != VK_SUCCESS) {
             throw std::runtime_error("could not present");
         }
     }
@@ -1835,27 +4618,39 @@ private:
     void cleanup() {
         // MARK: Vulkan deinstantiation
         // Must clean up synchronization primitives
-        vkDestroySemaphore(
-            device,
-            imageAvailableSemaphore,
-            nullptr
-        );
-        vkDestroySemaphore(
-            device,
-            renderFinishedSemaphore,
-            nullptr
-        );
-        vkDestroyFence(
-            device,
-            inFlightFence,
-            nullptr
-        );
+        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vkDestroySemaphore(
+                device,
+                imageAvailableSemaphores[i],
+                nullptr
+            );
+            vkDestroySemaphore(
+                device,
+                renderFinishedSemaphores[i],
+                nullptr
+            );
+            vkDestroyFence(
+                device,
+                inFlightFences[i],
+                nullptr
+            );
+        }
 
+        secondaryRecorder.reset();
+        frameCommandPools.reset();
+        commandCache.reset();
         vkDestroyCommandPool(
             device,
             commandPool,
             nullptr
         );
+        destroyMeshes();
+        culler.reset();
+        streamer.reset();
+        materials.reset();
+        bindlessTable.reset();
+        // The device is idle, so every retired swap chain can go
+        destroyRetiredSwapChains(UINT64_MAX);
         // Destroy framebuffers after we are finished rendering
         for(VkFramebuffer frameBuffer : swapChainFrameBuffers) {
             vkDestroyFramebuffer(
@@ -1872,6 +4667,19 @@ private:
             nullptr
         );
 
+        // Persist compiled pipelines for the next run before dropping them
+        savePipelineCache();
+        vkDestroyPipelineCache(
+            device,
+            pipelineCache,
+            nullptr
+        );
+
+        for(VkPipeline variant : pipelineVariants) {
+            vkDestroyPipeline(device, variant, nullptr);
+        }
+        vkDestroyPipeline(device, depthPrepassPipeline, nullptr);
+
         // Clean up pipeline layout (uniforms)
         vkDestroyPipelineLayout(
             device, 
@@ -1885,6 +4693,11 @@ private:
             renderPass, 
             nullptr
         );
+        vkDestroyRenderPass(device, earlyRenderPass, nullptr);
+        vkDestroyRenderPass(device, lateRenderPass, nullptr);
+
+        vkDestroyImageView(device, depthImageView, nullptr);
+        allocator->destroyImage(depthImage, depthImageAllocation);
 
         // We are responsible for removing image views
         for(VkImageView imageView: swapChainImageViews) {
@@ -1894,12 +4707,29 @@ private:
                 nullptr
             );
         }
-        vkDestroySwapchainKHR(
-            device,
-            swapChain,
-            nullptr
-        );
+        if(config.headless) {
+            for(size_t i = 0; i < readbackBuffers.size(); i++) {
+                allocator->destroyBuffer(readbackBuffers[i], readbackAllocations[i]);
+            }
+            for(size_t i = 0; i < swapChainImages.size(); i++) {
+                allocator->destroyImage(swapChainImages[i], offscreenImageAllocations[i]);
+            }
+        } else {
+            vkDestroySwapchainKHR(
+                device,
+                swapChain,
+                nullptr
+            );
+        }
         
+        // Every resource is gone by now, return the blocks to the driver
+        jobs.reset();
+        gpuTimer.reset();
+        overdrawCounter.reset();
+        // Staging buffers go back to the allocator
+        uploads.reset();
+        allocator.reset();
+
         // queues implicitly cleaned up
         vkDestroyDevice(device, nullptr);
 
@@ -1912,26 +4742,199 @@ private:
         }
 
         // must destroy surface before instance
-        vkDestroySurfaceKHR(
-            instance, 
-            surface, 
-            nullptr
-        );
+        if(!config.headless) {
+            vkDestroySurfaceKHR(
+                instance, 
+                surface, 
+                nullptr
+            );
+        }
         
         vkDestroyInstance(
             instance,
             nullptr
         );
         // MARK: glfw deinstantiation
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        if(!config.headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 };
 
-int main() {
-    HelloTriangleApplication app;
+static uint32_t parseCount(const char* flag, const char* value) {
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(value, &end, 10);
+    if(*value == '\0' || *end != '\0' || parsed > UINT32_MAX) {
+        throw std::runtime_error(std::string("invalid value for ") + flag);
+    }
+    return static_cast<uint32_t>(parsed);
+}
+
+static PresentPolicy parsePresentPolicy(const std::string& value) {
+    if(value == "low-latency") {
+        return PresentPolicy::LowLatency;
+    } else if(value == "max-throughput") {
+        return PresentPolicy::MaxThroughput;
+    } else if(value == "vsync") {
+        return PresentPolicy::Vsync;
+    } else if(value == "immediate") {
+        return PresentPolicy::Immediate;
+    }
+    throw std::runtime_error(
+        "invalid value for --present (low-latency, max-throughput, vsync, immediate)"
+    );
+}
+
+static CommandReset parseCommandReset(const std::string& value) {
+    if(value == "pool") {
+        return CommandReset::Pool;
+    } else if(value == "buffer") {
+        return CommandReset::Buffer;
+    }
+    throw std::runtime_error("invalid value for --command-reset (pool, buffer)");
+}
+
+static CullMode parseCullMode(const std::string& value) {
+    if(value == "off") {
+        return CullMode::Off;
+    } else if(value == "cpu") {
+        return CullMode::Cpu;
+    } else if(value == "gpu") {
+        return CullMode::Gpu;
+    }
+    throw std::runtime_error("invalid value for --cull (off, cpu, gpu)");
+}
+
+static AppConfig parseArguments(int argc, char** argv) {
+    AppConfig config;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        // Every option other than the on/off switches takes a value
+        auto value = [&]() -> const char* {
+            if(i + 1 >= argc) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--headless") {
+            config.headless = true;
+        } else if(arg == "--occlusion") {
+            config.occlusionCulling = true;
+        } else if(arg == "--verify-cull") {
+            config.verifyCulling = true;
+        } else if(arg == "--depth-prepass") {
+            config.depthPrepass = true;
+        } else if(arg == "--frames") {
+            config.frameCount = parseCount(arg.c_str(), value());
+        } else if(arg == "--width") {
+            config.width = parseCount(arg.c_str(), value());
+        } else if(arg == "--height") {
+            config.height = parseCount(arg.c_str(), value());
+        } else if(arg == "--dump-frames") {
+            config.frameOutputDir = value();
+        } else if(arg == "--pipeline-cache") {
+            config.pipelineCachePath = value();
+        } else if(arg == "--pipeline-threads") {
+            config.pipelineThreads = parseCount(arg.c_str(), value());
+        } else if(arg == "--job-threads") {
+            config.jobThreads = parseCount(arg.c_str(), value());
+        } else if(arg == "--pipeline-variants") {
+            config.pipelineVariantCount = parseCount(arg.c_str(), value());
+        } else if(arg == "--present") {
+            config.presentPolicy = parsePresentPolicy(value());
+        } else if(arg == "--swap-images") {
+            config.swapChainImageCount = parseCount(arg.c_str(), value());
+        } else if(arg == "--profile-out") {
+            config.profileOutputPath = value();
+        } else if(arg == "--triangles") {
+            config.sceneTriangles = parseCount(arg.c_str(), value());
+        } else if(arg == "--draws") {
+            config.sceneDraws = parseCount(arg.c_str(), value());
+        } else if(arg == "--voxels") {
+            config.voxelGrid = parseCount(arg.c_str(), value());
+        } else if(arg == "--voxel-edits") {
+            config.voxelEdits = parseCount(arg.c_str(), value());
+        } else if(arg == "--stream") {
+            config.streamRadius = parseCount(arg.c_str(), value());
+        } else if(arg == "--stream-budget") {
+            config.streamBudgetMiB = parseCount(arg.c_str(), value());
+        } else if(arg == "--record-threads") {
+            config.recordThreads = parseCount(arg.c_str(), value());
+        } else if(arg == "--command-reset") {
+            config.commandReset = parseCommandReset(value());
+        } else if(arg == "--render-pass") {
+            config.forceRenderPass = true;
+        } else if(arg == "--no-bindless") {
+            config.noBindless = true;
+        } else if(arg == "--cached-commands") {
+            config.cachedCommands = true;
+        } else if(arg == "--cull") {
+            config.cullMode = parseCullMode(value());
+        } else if(arg == "--bench-out") {
+            config.benchOutputPath = value();
+        } else if(arg == "--bench-baseline") {
+            config.benchBaselinePath = value();
+        } else if(arg == "--bench-tolerance") {
+            // Given in percent
+            config.benchTolerance = parseCount(arg.c_str(), value()) / 100.0;
+        } else {
+            throw std::runtime_error("unknown argument " + arg);
+        }
+    }
+
+    if(config.width == 0 || config.height == 0) {
+        throw std::runtime_error("extent must be non-zero");
+    }
+    if(config.headless && config.frameCount == 0) {
+        // Nothing to close in headless mode, so a run needs an end
+        config.frameCount = 300;
+    }
+    if(config.sceneDraws == 0 || config.sceneDraws > config.sceneTriangles) {
+        throw std::runtime_error("--draws must be between 1 and --triangles");
+    }
+    if(config.streamRadius > 0 && config.voxelGrid > 0) {
+        throw std::runtime_error("--stream and --voxels are separate scenes");
+    }
+    if(config.voxelEdits > 0 && config.voxelGrid == 0) {
+        throw std::runtime_error("--voxel-edits requires --voxels");
+    }
+    if(config.streamRadius > 0 && config.streamBudgetMiB == 0) {
+        throw std::runtime_error("--stream-budget must be non-zero");
+    }
+    if(config.occlusionCulling && (config.streamRadius == 0 || config.cullMode != CullMode::Gpu)) {
+        throw std::runtime_error("--occlusion requires --stream and --cull gpu");
+    }
+    if(config.verifyCulling && (config.streamRadius == 0 || config.cullMode != CullMode::Gpu)) {
+        throw std::runtime_error("--verify-cull requires --stream and --cull gpu");
+    }
+    if(config.recordThreads > 0 && config.streamRadius > 0) {
+        // A handful of indirect draws, with compute in the middle
+        throw std::runtime_error("--record-threads does not apply to --stream");
+    }
+    if(config.cachedCommands && (config.streamRadius > 0 || config.recordThreads > 0)) {
+        // The streamed camera moves every frame, and secondaries come from
+        // pools reset every frame
+        throw std::runtime_error("--cached-commands does not apply to --stream or --record-threads");
+    }
+    if(config.depthPrepass && config.occlusionCulling) {
+        // Both are ways to skip hidden work, and the early/late split would
+        // need a pre-pass of its own in each half
+        throw std::runtime_error("--depth-prepass and --occlusion are exclusive");
+    }
+    if(!config.headless && !config.frameOutputDir.empty()) {
+        throw std::runtime_error("--dump-frames requires --headless");
+    }
+
+    return config;
+}
 
+int main(int argc, char** argv) {
     try {
+        HelloTriangleApplication app(parseArguments(argc, argv));
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
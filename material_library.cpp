@@ -0,0 +1,152 @@
+#include "material_library.hpp"
+
+#include <stdexcept>
+
+// Same for every run, so captured frames compare across runs
+static uint32_t texelHash(uint32_t x, uint32_t y, uint32_t block) {
+    uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ block * 0xcb1ab31fu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// Between 0 and 1
+static float texelNoise(uint32_t x, uint32_t y, uint32_t block) {
+    return static_cast<float>(texelHash(x, y, block) & 0xffff) / 65535.0f;
+}
+
+MaterialLibrary::MaterialLibrary(
+    VkDevice device,
+    GpuAllocator& allocator,
+    UploadScheduler& uploads,
+    BindlessTable& table
+) : device(device), allocator(allocator), uploads(uploads), table(table) {
+    // Indexed by block type, the colors shaders/voxel.vert falls back to
+    const glm::vec4 tints[] = {
+        glm::vec4(1.0f, 0.0f, 1.0f, 1.0f),
+        glm::vec4(0.5f, 0.5f, 0.5f, 1.0f),
+        glm::vec4(0.45f, 0.3f, 0.15f, 1.0f),
+        glm::vec4(0.3f, 0.65f, 0.2f, 1.0f)
+    };
+    for(BlockId block = BLOCK_AIR; block <= BLOCK_GRASS; block++) {
+        materials.push_back(GpuMaterial {
+            .tint = tints[block],
+            .texture = addTexture(generateTexels(block))
+        });
+    }
+
+    VkDeviceSize size = sizeof(GpuMaterial) * materials.size();
+    materialBufferHandle = allocator.createBuffer(
+        size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        materialAllocation
+    );
+    uploads.enqueue(
+        materialBufferHandle,
+        0,
+        materials.data(),
+        size,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+    );
+    materialBufferIndex = table.addBuffer(materialBufferHandle, 0, size);
+}
+
+MaterialLibrary::~MaterialLibrary() {
+    for(Texture& texture : textures) {
+        vkDestroyImageView(device, texture.view, nullptr);
+        allocator.destroyImage(texture.image, texture.allocation);
+    }
+    allocator.destroyBuffer(materialBufferHandle, materialAllocation);
+}
+
+/*
+    Grey detail in [0.75, 1], multiplied by the material's tint: blotches
+    for stone, speckles for dirt, and blades (columns) for grass.
+*/
+std::vector<uint8_t> MaterialLibrary::generateTexels(BlockId block) {
+    std::vector<uint8_t> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+    for(uint32_t y = 0; y < TEXTURE_SIZE; y++) {
+        for(uint32_t x = 0; x < TEXTURE_SIZE; x++) {
+            float detail;
+            switch(block) {
+                case BLOCK_STONE:
+                    detail = 0.7f * texelNoise(x / 4, y / 4, block)
+                        + 0.3f * texelNoise(x, y, block);
+                    break;
+                case BLOCK_DIRT:
+                    detail = texelNoise(x, y, block);
+                    break;
+                case BLOCK_GRASS:
+                    detail = 0.8f * texelNoise(x, 0, block)
+                        + 0.2f * texelNoise(x, y, block);
+                    break;
+                default:
+                    detail = 1.0f;
+                    break;
+            }
+            auto value = static_cast<uint8_t>(255.0f * (0.75f + 0.25f * detail));
+            uint8_t* texel = &texels[(x + y * TEXTURE_SIZE) * 4];
+            texel[0] = value;
+            texel[1] = value;
+            texel[2] = value;
+            texel[3] = 255;
+        }
+    }
+    return texels;
+}
+
+uint32_t MaterialLibrary::addTexture(const std::vector<uint8_t>& texels) {
+    Texture texture;
+    VkImageCreateInfo imageInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = { TEXTURE_SIZE, TEXTURE_SIZE, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    texture.image = allocator.createImage(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        texture.allocation
+    );
+
+    VkImageViewCreateInfo viewInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = texture.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = imageInfo.format,
+        .subresourceRange = VkImageSubresourceRange {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    if(vkCreateImageView(device, &viewInfo, nullptr, &texture.view) != VK_SUCCESS) {
+        allocator.destroyImage(texture.image, texture.allocation);
+        throw std::runtime_error("failed to create material texture view!");
+    }
+    textures.push_back(texture);
+
+    uploads.enqueueImage(
+        texture.image,
+        { TEXTURE_SIZE, TEXTURE_SIZE },
+        texels.data(),
+        texels.size(),
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+    );
+    return table.addImage(texture.view);
+}
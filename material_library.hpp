@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include <glm/vec4.hpp>
+
+#include "bindless_table.hpp"
+#include "chunk.hpp"
+#include "gpu_allocator.hpp"
+#include "upload_scheduler.hpp"
+
+// One entry of the material buffer, std430 as shaders/voxel.frag reads it
+struct GpuMaterial {
+    glm::vec4 tint;
+    // Index into the bindless textures
+    uint32_t texture;
+    uint32_t padding[3];
+};
+
+/*
+    Everything the voxel fragment shader needs to shade a block type, in a
+    BindlessTable: a small detail texture per block type, and one storage
+    buffer of GpuMaterials indexed by BlockId.
+
+    Adding a block type is adding an entry and a texture; the pipeline and
+    descriptor set stay the same, and draws never bind anything per
+    material.
+
+    The textures are generated here (deterministic noise per block type),
+    so no image files need to ship. They and the buffer go through the
+    upload scheduler; the frame that acquires its batch waits for them.
+*/
+class MaterialLibrary {
+public:
+    static constexpr uint32_t TEXTURE_SIZE = 16;
+
+    MaterialLibrary(
+        VkDevice device,
+        GpuAllocator& allocator,
+        UploadScheduler& uploads,
+        BindlessTable& table
+    );
+    // The device must be idle
+    ~MaterialLibrary();
+
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // Where the GpuMaterial buffer is in the table's buffers
+    uint32_t materialBuffer() const {
+        return materialBufferIndex;
+    }
+    uint32_t materialCount() const {
+        return static_cast<uint32_t>(materials.size());
+    }
+
+private:
+    struct Texture {
+        VkImage image = VK_NULL_HANDLE;
+        GpuAllocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    // RGBA8 texels, TEXTURE_SIZE squared
+    static std::vector<uint8_t> generateTexels(BlockId block);
+    // Returns its index in the table
+    uint32_t addTexture(const std::vector<uint8_t>& texels);
+
+    VkDevice device;
+    GpuAllocator& allocator;
+    UploadScheduler& uploads;
+    BindlessTable& table;
+
+    std::vector<Texture> textures;
+    std::vector<GpuMaterial> materials;
+    VkBuffer materialBufferHandle = VK_NULL_HANDLE;
+    GpuAllocation materialAllocation;
+    uint32_t materialBufferIndex = 0;
+};
@@ -0,0 +1,421 @@
+#include "mesher.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include "block_masks.hpp"
+
+// Block at pos, which may be one step outside the chunk along axis
+static BlockId blockAt(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    int pos[3],
+    int axis,
+    Face face
+) {
+    if(pos[axis] >= 0 && pos[axis] < CHUNK_SIZE) {
+        return chunk.get(pos[0], pos[1], pos[2]);
+    }
+
+    const Chunk* neighbor = neighbors.chunks[static_cast<int>(face)];
+    if(neighbor == nullptr) {
+        return BLOCK_AIR;
+    }
+    // Wrap to the touching layer of the neighbour
+    int wrapped[3] = { pos[0], pos[1], pos[2] };
+    wrapped[axis] = pos[axis] < 0 ? CHUNK_SIZE - 1 : 0;
+    return neighbor->get(wrapped[0], wrapped[1], wrapped[2]);
+}
+
+// Whether (x, y, z) is solid, for positions up to one step outside the chunk.
+// Diagonal neighbour chunks are not known and count as air.
+static bool isSolid(const Chunk& chunk, const ChunkNeighbors& neighbors, int x, int y, int z) {
+    if(y < 0 || y >= CHUNK_SIZE) {
+        return false;
+    }
+    bool outsideX = x < 0 || x >= CHUNK_SIZE;
+    bool outsideZ = z < 0 || z >= CHUNK_SIZE;
+    if(outsideX && outsideZ) {
+        return false;
+    }
+
+    const Chunk* source = &chunk;
+    if(outsideX) {
+        source = neighbors.chunks[static_cast<int>(x < 0 ? Face::NegX : Face::PosX)];
+        x = x < 0 ? CHUNK_SIZE - 1 : 0;
+    } else if(outsideZ) {
+        source = neighbors.chunks[static_cast<int>(z < 0 ? Face::NegZ : Face::PosZ)];
+        z = z < 0 ? CHUNK_SIZE - 1 : 0;
+    }
+    return source != nullptr && source->get(x, y, z) != BLOCK_AIR;
+}
+
+/*
+    Ambient occlusion of the four corners of a face, packed as in Quad::ao,
+    from the 3x3 cells around the air cell the face looks into, indexed
+    [du + 1][dv + 1]. Each corner is darkened by the blocks beside it in that
+    layer: the two edge neighbours and the diagonal one, and is fully dark
+    when both edges are solid.
+*/
+static uint8_t packAo(const int around[3][3]) {
+    static const int steps[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+    uint8_t ao = 0;
+    for(int k = 0; k < 4; k++) {
+        int du = steps[k][0];
+        int dv = steps[k][1];
+        int side1 = around[du + 1][1];
+        int side2 = around[1][dv + 1];
+        int value = side1 && side2 ? 0 : 3 - side1 - side2 - around[du + 1][dv + 1];
+        ao |= static_cast<uint8_t>(value << (2 * k));
+    }
+    return ao;
+}
+
+static uint8_t faceAo(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    const int front[3],
+    int u,
+    int v
+) {
+    int around[3][3] = {};
+    for(int du = -1; du <= 1; du++) {
+        for(int dv = -1; dv <= 1; dv++) {
+            int pos[3] = { front[0], front[1], front[2] };
+            pos[u] += du;
+            pos[v] += dv;
+            around[du + 1][dv + 1] = isSolid(chunk, neighbors, pos[0], pos[1], pos[2]);
+        }
+    }
+    return packAo(around);
+}
+
+void greedyMesh(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads
+) {
+    greedyMeshMasks(chunk, neighbors, quads, defaultSimdLevel());
+}
+
+void greedyMeshScalar(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads
+) {
+    // Each visible face in the current slice as block | ao << 8, 0 where none
+    uint16_t mask[CHUNK_SIZE * CHUNK_SIZE];
+
+    for(int f = 0; f < 6; f++) {
+        Face face = static_cast<Face>(f);
+        int d = f / 2;
+        int step = f % 2 == 0 ? 1 : -1;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        for(int slice = 0; slice < CHUNK_SIZE; slice++) {
+            bool any = false;
+            for(int j = 0; j < CHUNK_SIZE; j++) {
+                for(int i = 0; i < CHUNK_SIZE; i++) {
+                    int pos[3];
+                    pos[d] = slice;
+                    pos[u] = i;
+                    pos[v] = j;
+                    BlockId block = chunk.get(pos[0], pos[1], pos[2]);
+
+                    uint16_t visible = 0;
+                    if(block != BLOCK_AIR) {
+                        pos[d] += step;
+                        if(blockAt(chunk, neighbors, pos, d, face) == BLOCK_AIR) {
+                            visible = block | faceAo(chunk, neighbors, pos, u, v) << 8;
+                            any = true;
+                        }
+                    }
+                    mask[i + j * CHUNK_SIZE] = visible;
+                }
+            }
+            if(!any) {
+                continue;
+            }
+
+            for(int j = 0; j < CHUNK_SIZE; j++) {
+                for(int i = 0; i < CHUNK_SIZE;) {
+                    uint16_t key = mask[i + j * CHUNK_SIZE];
+                    if(key == 0) {
+                        i++;
+                        continue;
+                    }
+
+                    // Grow along u while the faces match
+                    int width = 1;
+                    while(
+                        i + width < CHUNK_SIZE &&
+                        mask[i + width + j * CHUNK_SIZE] == key
+                    ) {
+                        width++;
+                    }
+
+                    // Then along v while every face of the next row matches
+                    int height = 1;
+                    for(; j + height < CHUNK_SIZE; height++) {
+                        const uint16_t* row = &mask[i + (j + height) * CHUNK_SIZE];
+                        bool matches = true;
+                        for(int k = 0; k < width; k++) {
+                            if(row[k] != key) {
+                                matches = false;
+                                break;
+                            }
+                        }
+                        if(!matches) {
+                            break;
+                        }
+                    }
+
+                    // Consume the merged faces
+                    for(int h = 0; h < height; h++) {
+                        for(int k = 0; k < width; k++) {
+                            mask[i + k + (j + h) * CHUNK_SIZE] = 0;
+                        }
+                    }
+
+                    int pos[3];
+                    pos[d] = slice;
+                    pos[u] = i;
+                    pos[v] = j;
+                    quads.push_back(Quad {
+                        .x = static_cast<uint8_t>(pos[0]),
+                        .y = static_cast<uint8_t>(pos[1]),
+                        .z = static_cast<uint8_t>(pos[2]),
+                        .width = static_cast<uint8_t>(width),
+                        .height = static_cast<uint8_t>(height),
+                        .face = face,
+                        .block = static_cast<BlockId>(key & 0xff),
+                        .ao = static_cast<uint8_t>(key >> 8)
+                    });
+
+                    i += width;
+                }
+            }
+        }
+    }
+}
+
+/*
+    The face masks hold rows along x, but greedy merging walks each slice
+    along u within rows along v, like greedyMeshScalar, so it finds the same
+    quads in the same order. Z faces already have that shape (u = x, v = y);
+    x and y faces are transposed by scattering their set bits, which costs
+    one step per visible face rather than one per block.
+*/
+void greedyMeshMasks(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads,
+    SimdLevel level
+) {
+    SolidMasks solid;
+    FaceMasks faces;
+    buildSolidMasks(chunk, neighbors, solid, level);
+    computeFaceMasks(solid, faces, level);
+
+    // [slice][v], bit u: visible faces still to be merged
+    uint32_t slices[CHUNK_SIZE][CHUNK_SIZE];
+
+    for(int f = 0; f < 6; f++) {
+        Face face = static_cast<Face>(f);
+        int d = f / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        const uint64_t (*rows)[CHUNK_SIZE] = faces.rows[f];
+        if(d == 2) {
+            for(int z = 0; z < CHUNK_SIZE; z++) {
+                for(int y = 0; y < CHUNK_SIZE; y++) {
+                    slices[z][y] = static_cast<uint32_t>(rows[y][z]);
+                }
+            }
+        } else {
+            std::memset(slices, 0, sizeof(slices));
+            for(int y = 0; y < CHUNK_SIZE; y++) {
+                for(int z = 0; z < CHUNK_SIZE; z++) {
+                    for(uint64_t bits = rows[y][z]; bits != 0; bits &= bits - 1) {
+                        int x = __builtin_ctzll(bits);
+                        if(d == 0) {
+                            // u = y, v = z
+                            slices[x][z] |= 1u << y;
+                        } else {
+                            // u = z, v = x
+                            slices[y][x] |= 1u << z;
+                        }
+                    }
+                }
+            }
+        }
+
+        /*
+            Occlusion reads the solid masks, whose border makes every lookup
+            one step outside the chunk valid. A step along x moves one bit,
+            along z one row and along y one plane of rows.
+        */
+        const uint64_t* solidRows = &solid.rows[0][0];
+        static const int rowSteps[3] = { 0, CHUNK_SIZE + 2, 1 };
+        static const int bitSteps[3] = { 1, 0, 0 };
+        int step = f % 2 == 0 ? 1 : -1;
+        auto aoAt = [&](const int front[3]) {
+            int row = (front[1] + 1) * (CHUNK_SIZE + 2) + front[2] + 1;
+            int bit = front[0] + 1;
+            int around[3][3];
+            for(int du = -1; du <= 1; du++) {
+                for(int dv = -1; dv <= 1; dv++) {
+                    uint64_t bits = solidRows[row + du * rowSteps[u] + dv * rowSteps[v]];
+                    around[du + 1][dv + 1] = bits >> (bit + du * bitSteps[u] + dv * bitSteps[v]) & 1;
+                }
+            }
+            return packAo(around);
+        };
+
+        for(int slice = 0; slice < CHUNK_SIZE; slice++) {
+            uint32_t* grid = slices[slice];
+
+            // As in greedyMeshScalar: block | ao << 8, worked out once for
+            // each visible face and left stale elsewhere
+            uint16_t keys[CHUNK_SIZE][CHUNK_SIZE];
+            for(int j = 0; j < CHUNK_SIZE; j++) {
+                for(uint32_t bits = grid[j]; bits != 0; bits &= bits - 1) {
+                    int i = __builtin_ctz(bits);
+                    int pos[3];
+                    pos[d] = slice;
+                    pos[u] = i;
+                    pos[v] = j;
+                    BlockId block = chunk.get(pos[0], pos[1], pos[2]);
+                    pos[d] += step;
+                    keys[j][i] = static_cast<uint16_t>(block | aoAt(pos) << 8);
+                }
+            }
+            auto keyAtCell = [&](int i, int j) {
+                return keys[j][i];
+            };
+
+            for(int j = 0; j < CHUNK_SIZE; j++) {
+                while(grid[j] != 0) {
+                    int i = __builtin_ctz(grid[j]);
+                    uint16_t key = keyAtCell(i, j);
+
+                    // Grow along u while there are faces with the same key
+                    int width = 1;
+                    while(
+                        i + width < CHUNK_SIZE &&
+                        (grid[j] >> (i + width) & 1) &&
+                        keyAtCell(i + width, j) == key
+                    ) {
+                        width++;
+                    }
+                    uint32_t run = static_cast<uint32_t>(((1ULL << width) - 1) << i);
+
+                    // Then along v while the next row has the whole run
+                    int height = 1;
+                    for(; j + height < CHUNK_SIZE; height++) {
+                        if((grid[j + height] & run) != run) {
+                            break;
+                        }
+                        bool matches = true;
+                        for(int k = 0; k < width; k++) {
+                            if(keyAtCell(i + k, j + height) != key) {
+                                matches = false;
+                                break;
+                            }
+                        }
+                        if(!matches) {
+                            break;
+                        }
+                    }
+
+                    for(int h = 0; h < height; h++) {
+                        grid[j + h] &= ~run;
+                    }
+
+                    int pos[3];
+                    pos[d] = slice;
+                    pos[u] = i;
+                    pos[v] = j;
+                    quads.push_back(Quad {
+                        .x = static_cast<uint8_t>(pos[0]),
+                        .y = static_cast<uint8_t>(pos[1]),
+                        .z = static_cast<uint8_t>(pos[2]),
+                        .width = static_cast<uint8_t>(width),
+                        .height = static_cast<uint8_t>(height),
+                        .face = face,
+                        .block = static_cast<BlockId>(key & 0xff),
+                        .ao = static_cast<uint8_t>(key >> 8)
+                    });
+                }
+            }
+        }
+    }
+}
+
+uint32_t countVisibleFaces(const Chunk& chunk, const ChunkNeighbors& neighbors) {
+    uint32_t count = 0;
+    for(int y = 0; y < CHUNK_SIZE; y++) {
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            for(int x = 0; x < CHUNK_SIZE; x++) {
+                if(chunk.get(x, y, z) == BLOCK_AIR) {
+                    continue;
+                }
+                for(int f = 0; f < 6; f++) {
+                    int d = f / 2;
+                    int pos[3] = { x, y, z };
+                    pos[d] += f % 2 == 0 ? 1 : -1;
+                    if(blockAt(chunk, neighbors, pos, d, static_cast<Face>(f)) == BLOCK_AIR) {
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+std::array<QuadCorner, 4> quadCorners(const Quad& quad) {
+    int f = static_cast<int>(quad.face);
+    int d = f / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    // Positive faces sit on the far side of their block
+    int base[3] = { quad.x, quad.y, quad.z };
+    if(f % 2 == 0) {
+        base[d] += 1;
+    }
+
+    // p0 p1 p2 p3 runs counter-clockwise seen from +d, as u x v = d
+    std::array<QuadCorner, 4> corners;
+    for(int c = 0; c < 4; c++) {
+        int corner[3] = { base[0], base[1], base[2] };
+        if(c == 1 || c == 2) {
+            corner[u] += quad.width;
+        }
+        if(c == 2 || c == 3) {
+            corner[v] += quad.height;
+        }
+        corners[c] = QuadCorner {
+            .x = static_cast<uint8_t>(corner[0]),
+            .y = static_cast<uint8_t>(corner[1]),
+            .z = static_cast<uint8_t>(corner[2]),
+            .ao = static_cast<uint8_t>(quad.ao >> (2 * c) & 3)
+        };
+    }
+
+    // Clockwise from outside: reverse for faces seen from +d
+    if(f % 2 == 0) {
+        std::swap(corners[1], corners[3]);
+    }
+    return corners;
+}
+
+std::array<uint8_t, 6> quadIndices(const std::array<QuadCorner, 4>& corners) {
+    if(corners[0].ao + corners[2].ao < corners[1].ao + corners[3].ao) {
+        return { 1, 2, 3, 3, 0, 1 };
+    }
+    return { 0, 1, 2, 2, 3, 0 };
+}
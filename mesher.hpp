@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "chunk.hpp"
+
+// Face directions; the value is also the normal index stored per vertex
+enum class Face : uint8_t {
+    PosX,
+    NegX,
+    PosY,
+    NegY,
+    PosZ,
+    NegZ
+};
+
+// The chunks on each side, indexed by Face. Missing neighbours count as air.
+struct ChunkNeighbors {
+    std::array<const Chunk*, 6> chunks{};
+};
+
+/*
+    A rectangle of coplanar faces of the same block type, merged into one.
+
+    For a face pointing along axis d, the quad spans axis u = (d + 1) % 3 for
+    `width` blocks and axis v = (d + 2) % 3 for `height` blocks, starting at
+    block (x, y, z).
+
+    ao holds the ambient occlusion of the corners, 2 bits each from 0 (fully
+    occluded) to 3 (open), corner k at bits 2k: (u, v) = (0, 0), (width, 0),
+    (width, height), (0, height). Only faces with the same block and the same
+    four corner values are merged, so shading never stretches across a quad.
+*/
+struct Quad {
+    uint8_t x;
+    uint8_t y;
+    uint8_t z;
+    uint8_t width;
+    uint8_t height;
+    Face face;
+    BlockId block;
+    uint8_t ao;
+};
+
+// A quad corner in chunk coordinates (0 to CHUNK_SIZE inclusive)
+struct QuadCorner {
+    uint8_t x;
+    uint8_t y;
+    uint8_t z;
+    // 0 (fully occluded) to 3 (open)
+    uint8_t ao;
+};
+
+/*
+    Greedy meshing: for each face direction and slice, mark the block faces
+    that border air, then repeatedly take the first unmerged face and grow it
+    as far as possible along u and then v. Flat terrain collapses from one
+    quad per block face to a handful per slice.
+
+    Appends to quads, which can be reused between chunks to avoid
+    reallocating.
+
+    Finds visible faces with bit masks (see block_masks.hpp), with the
+    kernels of defaultSimdLevel(). Most of the gain over greedyMeshScalar
+    is the masks and the bit by bit merge walk, not the SIMD.
+*/
+void greedyMesh(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads
+);
+
+// Reference version checking one neighbour block per face. Gives exactly the
+// quads greedyMesh does, in the same order.
+void greedyMeshScalar(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    std::vector<Quad>& quads
+);
+
+// Faces a naive one quad per face mesher would emit. Greedy quads cover
+// exactly these.
+uint32_t countVisibleFaces(const Chunk& chunk, const ChunkNeighbors& neighbors);
+
+/*
+    Corners of a quad in order around it, wound clockwise seen from outside,
+    matching VK_FRONT_FACE_CLOCKWISE.
+*/
+std::array<QuadCorner, 4> quadCorners(const Quad& quad);
+
+/*
+    Two triangles for the corners, split along the diagonal whose corners are
+    more open. Splitting through a dark corner would smear its occlusion over
+    half the quad; this keeps it to the one triangle that touches it.
+*/
+std::array<uint8_t, 6> quadIndices(const std::array<QuadCorner, 4>& corners);
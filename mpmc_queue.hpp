@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+    Bounded multi-producer multi-consumer queue without locks (Dmitry
+    Vyukov's design).
+
+    Every cell carries a sequence number saying whose turn it is: equal to
+    the position when free for the producer at that position, position + 1
+    once written and ready for the consumer. Producers and consumers each
+    claim a position with one compare-exchange on their own counter, so they
+    only contend with their own kind, and never wait on each other unless
+    the queue is full or empty.
+
+    tryPush/tryPop fail instead of blocking. A value is only moved from when
+    tryPush succeeds.
+*/
+template<typename T>
+class MpmcQueue {
+public:
+    // Rounded up to a power of two
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while(size < capacity) {
+            size *= 2;
+        }
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for(size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool tryPush(T& value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while(true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if(difference == 0) {
+                // Free for us, if no other producer claims it first
+                if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(difference < 0) {
+                // Still holds the value from one lap ago: full
+                return false;
+            } else {
+                // Another producer got here first
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        while(true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if(difference == 0) {
+                if(dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    // Free the cell for the producer one lap ahead
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(difference < 0) {
+                // Not written yet: empty
+                return false;
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // On separate cache lines so producers and consumers do not false share
+    alignas(64) std::atomic<size_t> enqueuePosition{0};
+    alignas(64) std::atomic<size_t> dequeuePosition{0};
+};
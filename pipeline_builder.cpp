@@ -0,0 +1,139 @@
+#include "pipeline_builder.hpp"
+
+#include <stdexcept>
+
+PipelineBuilder::PipelineBuilder(
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    unsigned threadCount
+) : device(device), pipelineCache(pipelineCache) {
+    if(threadCount == 0) {
+        threadCount = 1;
+    }
+    for(unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&PipelineBuilder::workerLoop, this);
+    }
+}
+
+PipelineBuilder::~PipelineBuilder() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<VkPipeline> PipelineBuilder::submit(GraphicsPipelineDesc desc) {
+    // The task owns the description so the pointers built from it in
+    // build() stay valid for the whole compile.
+    std::packaged_task<VkPipeline()> task(
+        [this, desc = std::move(desc)]() {
+            return build(desc);
+        }
+    );
+    std::future<VkPipeline> result = task.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(std::move(task));
+    }
+    queueCondition.notify_one();
+
+    return result;
+}
+
+void PipelineBuilder::workerLoop() {
+    while(true) {
+        std::packaged_task<VkPipeline()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]() {
+                return stopping || !queue.empty();
+            });
+            // Drain the queue before exiting so no future is left unset
+            if(queue.empty()) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        // Exceptions are captured into the future by packaged_task
+        task();
+    }
+}
+
+VkPipeline PipelineBuilder::build(const GraphicsPipelineDesc& desc) {
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size()),
+        .pVertexBindingDescriptions = desc.vertexBindings.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size()),
+        .pVertexAttributeDescriptions = desc.vertexAttributes.data()
+    };
+
+    // Viewport and scissor are dynamic, so only the counts matter here
+    VkPipelineViewportStateCreateInfo viewportState {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = desc.colorBlending;
+    colorBlending.attachmentCount = static_cast<uint32_t>(desc.colorBlendAttachments.size());
+    colorBlending.pAttachments = desc.colorBlendAttachments.data();
+
+    VkPipelineDynamicStateCreateInfo dynamicState {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<uint32_t>(desc.dynamicStates.size()),
+        .pDynamicStates = desc.dynamicStates.data()
+    };
+
+    // Only read without a render pass (VK_KHR_dynamic_rendering)
+    VkPipelineRenderingCreateInfoKHR renderingInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount = static_cast<uint32_t>(desc.colorAttachmentFormats.size()),
+        .pColorAttachmentFormats = desc.colorAttachmentFormats.data(),
+        .depthAttachmentFormat = desc.depthAttachmentFormat,
+        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = desc.renderPass == VK_NULL_HANDLE ? &renderingInfo : nullptr,
+        .stageCount = static_cast<uint32_t>(desc.shaderStages.size()),
+        .pStages = desc.shaderStages.data(),
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &desc.inputAssembly,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &desc.rasterizer,
+        .pMultisampleState = &desc.multisampling,
+        .pDepthStencilState = desc.depthStencil ? &*desc.depthStencil : nullptr,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = desc.layout,
+        .renderPass = desc.renderPass,
+        .subpass = desc.subpass,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1
+    };
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(
+        device,
+        pipelineCache,
+        1,
+        &pipelineInfo,
+        nullptr,
+        &pipeline
+    );
+    if(result != VK_SUCCESS) {
+        throw std::runtime_error("Could not create graphics pipeline!");
+    }
+
+    return pipeline;
+}
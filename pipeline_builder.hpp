@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+    Everything a VkGraphicsPipelineCreateInfo points at, held by value.
+
+    The create info itself is a web of pointers into stack variables, which
+    cannot outlive the function that built them. A description owns its state
+    so it can be copied, tweaked into variants (cull mode, polygon mode, blend
+    state, shaders) and handed to another thread to compile.
+
+    Viewport and scissor are expected to be dynamic state, so only their
+    counts are baked into the pipeline.
+*/
+struct GraphicsPipelineDesc {
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    // No value means depth testing is disabled
+    std::optional<VkPipelineDepthStencilStateCreateInfo> depthStencil;
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    std::vector<VkDynamicState> dynamicStates;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    // Null with dynamic rendering, which names the attachment formats below
+    // instead
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+    std::vector<VkFormat> colorAttachmentFormats;
+    VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+};
+
+/*
+    Compiles graphics pipelines on a pool of worker threads.
+
+    vkCreateGraphicsPipelines is where the driver compiles SPIR-V to GPU code,
+    and is by far the slowest part of startup. It is safe to call from several
+    threads at once, including with a shared VkPipelineCache (caches are
+    internally synchronized unless created EXTERNALLY_SYNCHRONIZED), so many
+    pipelines can compile in parallel.
+
+    Shader modules referenced by a submitted description must stay alive
+    until its future is ready. Creation errors are rethrown from get().
+*/
+class PipelineBuilder {
+public:
+    PipelineBuilder(
+        VkDevice device,
+        VkPipelineCache pipelineCache,
+        unsigned threadCount
+    );
+    // Finishes queued work, then joins the workers
+    ~PipelineBuilder();
+
+    PipelineBuilder(const PipelineBuilder&) = delete;
+    PipelineBuilder& operator=(const PipelineBuilder&) = delete;
+
+    std::future<VkPipeline> submit(GraphicsPipelineDesc desc);
+
+    unsigned threadCount() const {
+        return static_cast<unsigned>(workers.size());
+    }
+
+private:
+    VkPipeline build(const GraphicsPipelineDesc& desc);
+    void workerLoop();
+
+    VkDevice device;
+    VkPipelineCache pipelineCache;
+
+    std::vector<std::thread> workers;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<std::packaged_task<VkPipeline()>> queue;
+    bool stopping = false;
+};
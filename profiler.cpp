@@ -0,0 +1,319 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+
+RollingStats::RollingStats(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {
+    samples.reserve(this->capacity);
+}
+
+void RollingStats::add(double value) {
+    if(samples.size() < capacity) {
+        samples.push_back(value);
+    } else {
+        samples[next] = value;
+        next = (next + 1) % capacity;
+    }
+    totalCount++;
+}
+
+double RollingStats::percentile(double p) const {
+    if(samples.empty()) {
+        return 0.0;
+    }
+
+    // Nearest rank: the smallest sample with at least p of samples <= it
+    std::vector<double> sorted = samples;
+    size_t rank = static_cast<size_t>(std::ceil(std::clamp(p, 0.0, 1.0) * sorted.size()));
+    size_t index = rank == 0 ? 0 : rank - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+double RollingStats::mean() const {
+    if(samples.empty()) {
+        return 0.0;
+    }
+    return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+double RollingStats::max() const {
+    if(samples.empty()) {
+        return 0.0;
+    }
+    return *std::max_element(samples.begin(), samples.end());
+}
+
+void Profiler::record(const std::string& name, double value) {
+    // A handful of series, so a linear scan beats hashing the name
+    for(Series& entry : series) {
+        if(entry.name == name) {
+            entry.stats.add(value);
+            return;
+        }
+    }
+    series.push_back(Series { name, RollingStats(window) });
+    series.back().stats.add(value);
+}
+
+const RollingStats* Profiler::find(const std::string& name) const {
+    for(const Series& entry : series) {
+        if(entry.name == name) {
+            return &entry.stats;
+        }
+    }
+    return nullptr;
+}
+
+void Profiler::writeCsv(std::ostream& out) const {
+    out << "name,samples,mean,p50,p95,p99,max\n";
+    for(const Series& entry : series) {
+        const RollingStats& stats = entry.stats;
+        out << entry.name << ','
+            << stats.total() << ','
+            << stats.mean() << ','
+            << stats.percentile(0.50) << ','
+            << stats.percentile(0.95) << ','
+            << stats.percentile(0.99) << ','
+            << stats.max() << '\n';
+    }
+}
+
+void Profiler::writeJson(std::ostream& out) const {
+    out << "{\n";
+    for(size_t i = 0; i < series.size(); i++) {
+        const RollingStats& stats = series[i].stats;
+        // Series names are identifiers chosen in code, nothing to escape
+        out << "  \"" << series[i].name << "\": {"
+            << "\"samples\": " << stats.total()
+            << ", \"mean\": " << stats.mean()
+            << ", \"p50\": " << stats.percentile(0.50)
+            << ", \"p95\": " << stats.percentile(0.95)
+            << ", \"p99\": " << stats.percentile(0.99)
+            << ", \"max\": " << stats.max()
+            << "}" << (i + 1 < series.size() ? "," : "") << "\n";
+    }
+    out << "}\n";
+}
+
+void Profiler::print(std::ostream& out) const {
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+
+    out << std::left << std::setw(24) << "series" << std::right
+        << std::setw(10) << "mean"
+        << std::setw(10) << "p50"
+        << std::setw(10) << "p95"
+        << std::setw(10) << "p99"
+        << std::setw(10) << "max" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for(const Series& entry : series) {
+        const RollingStats& stats = entry.stats;
+        out << std::left << std::setw(24) << entry.name << std::right
+            << std::setw(10) << stats.mean()
+            << std::setw(10) << stats.percentile(0.50)
+            << std::setw(10) << stats.percentile(0.95)
+            << std::setw(10) << stats.percentile(0.99)
+            << std::setw(10) << stats.max() << "\n";
+    }
+
+    out.copyfmt(flags);
+}
+
+void Profiler::writeFile(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if(!file) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if(json) {
+        writeJson(file);
+    } else {
+        writeCsv(file);
+    }
+}
+
+GpuFrameTimer::GpuFrameTimer(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t graphicsFamily,
+    uint32_t slotCount
+) : device(device), written(slotCount, false) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    uint32_t validBits = families[graphicsFamily].timestampValidBits;
+    if(validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+        return;
+    }
+    validMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        // begin and end per slot
+        .queryCount = slotCount * 2
+    };
+    if(vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+GpuFrameTimer::~GpuFrameTimer() {
+    if(queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+    }
+}
+
+void GpuFrameTimer::reset(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+}
+
+void GpuFrameTimer::begin(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    // Written once all earlier commands have started
+    vkCmdWriteTimestamp(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        queryPool,
+        slot * 2
+    );
+}
+
+void GpuFrameTimer::end(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    // Written once all earlier commands have finished
+    vkCmdWriteTimestamp(
+        commandBuffer,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        queryPool,
+        slot * 2 + 1
+    );
+}
+
+void GpuFrameTimer::markSubmitted(uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    written[slot] = true;
+}
+
+std::optional<double> GpuFrameTimer::collect(uint32_t slot) {
+    if(!supported() || !written[slot]) {
+        return std::nullopt;
+    }
+    written[slot] = false;
+
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(
+        device,
+        queryPool,
+        slot * 2,
+        2,
+        sizeof(timestamps),
+        timestamps,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+    if(result != VK_SUCCESS) {
+        return std::nullopt;
+    }
+
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & validMask;
+    return ticks * timestampPeriod / 1e6;
+}
+
+GpuOverdrawCounter::GpuOverdrawCounter(
+    VkDevice device,
+    bool supported,
+    uint32_t slotCount
+) : device(device), written(slotCount, false) {
+    if(!supported) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = slotCount,
+        .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+    };
+    if(vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline statistics query pool!");
+    }
+}
+
+GpuOverdrawCounter::~GpuOverdrawCounter() {
+    if(queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+    }
+}
+
+void GpuOverdrawCounter::reset(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, slot, 1);
+}
+
+void GpuOverdrawCounter::begin(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    vkCmdBeginQuery(commandBuffer, queryPool, slot, 0);
+}
+
+void GpuOverdrawCounter::end(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    vkCmdEndQuery(commandBuffer, queryPool, slot);
+}
+
+void GpuOverdrawCounter::markSubmitted(uint32_t slot) {
+    if(!supported()) {
+        return;
+    }
+    written[slot] = true;
+}
+
+std::optional<double> GpuOverdrawCounter::collect(uint32_t slot, uint64_t pixels) {
+    if(!supported() || !written[slot] || pixels == 0) {
+        return std::nullopt;
+    }
+    written[slot] = false;
+
+    uint64_t invocations;
+    VkResult result = vkGetQueryPoolResults(
+        device,
+        queryPool,
+        slot,
+        1,
+        sizeof(invocations),
+        &invocations,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+    if(result != VK_SUCCESS) {
+        return std::nullopt;
+    }
+    return static_cast<double>(invocations) / static_cast<double>(pixels);
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+    The last `capacity` samples of one measurement, for percentiles over a
+    recent window rather than the whole run (startup spikes would otherwise
+    dominate p99 forever).
+*/
+class RollingStats {
+public:
+    explicit RollingStats(size_t capacity = 1024);
+
+    void add(double value);
+
+    // Samples currently in the window
+    size_t size() const {
+        return samples.size();
+    }
+    // Samples ever added
+    uint64_t total() const {
+        return totalCount;
+    }
+
+    // p in [0, 1], nearest rank. 0 when empty.
+    double percentile(double p) const;
+    double mean() const;
+    double max() const;
+
+private:
+    size_t capacity;
+    std::vector<double> samples;
+    // Next slot to overwrite once the window is full
+    size_t next = 0;
+    uint64_t totalCount = 0;
+};
+
+/*
+    Named series of samples: CPU scope times, GPU times and counters.
+    Series are reported in the order they were first recorded.
+
+    Not thread safe; record from the thread that drives frames.
+*/
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Adds the time from construction to destruction to a series, in ms
+    class Scope {
+    public:
+        Scope(Profiler& profiler, const char* name)
+            : profiler(profiler), name(name), start(Clock::now()) {}
+        ~Scope() {
+            profiler.record(
+                name,
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count()
+            );
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& profiler;
+        const char* name;
+        Clock::time_point start;
+    };
+
+    explicit Profiler(size_t window = 1024) : window(window) {}
+
+    void record(const std::string& name, double value);
+    const RollingStats* find(const std::string& name) const;
+
+    // One row per series: name,samples,mean,p50,p95,p99,max
+    void writeCsv(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+    // Human readable table
+    void print(std::ostream& out) const;
+    // Picks the format from the extension (.json, otherwise CSV)
+    void writeFile(const std::string& path) const;
+
+private:
+    struct Series {
+        std::string name;
+        RollingStats stats;
+    };
+
+    size_t window;
+    std::vector<Series> series;
+};
+
+/*
+    GPU time of a span of each frame, from a pair of timestamp queries per
+    frame slot. Results are read back once the slot's fence has signaled, so
+    the read never stalls.
+
+    Timestamps are optional: when the graphics queue has no valid timestamp
+    bits every call is a no-op and collect() returns nothing.
+*/
+class GpuFrameTimer {
+public:
+    GpuFrameTimer(
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        uint32_t graphicsFamily,
+        uint32_t slotCount
+    );
+    ~GpuFrameTimer();
+
+    GpuFrameTimer(const GpuFrameTimer&) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+    bool supported() const {
+        return queryPool != VK_NULL_HANDLE;
+    }
+
+    // Outside a render pass: queries can only be reset there
+    void reset(VkCommandBuffer commandBuffer, uint32_t slot);
+    void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+    void end(VkCommandBuffer commandBuffer, uint32_t slot);
+    // A buffer holding the slot's queries was submitted, whether recorded
+    // this frame or cached, so collect() has results to read
+    void markSubmitted(uint32_t slot);
+
+    // Milliseconds between begin and end of the slot's last frame. Only call
+    // once that frame's fence has signaled.
+    std::optional<double> collect(uint32_t slot);
+
+private:
+    VkDevice device;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    // Nanoseconds per timestamp tick
+    double timestampPeriod = 0.0;
+    uint64_t validMask = 0;
+    std::vector<bool> written;
+};
+
+/*
+    Overdraw of each frame: fragment shader invocations, from a pipeline
+    statistics query per frame slot, over the pixels of the frame. 1.0 means
+    every pixel was shaded once. Results are read back once the slot's fence
+    has signaled, like GpuFrameTimer.
+
+    Needs the pipelineStatisticsQuery feature; without it every call is a
+    no-op and collect() returns nothing.
+*/
+class GpuOverdrawCounter {
+public:
+    GpuOverdrawCounter(VkDevice device, bool supported, uint32_t slotCount);
+    ~GpuOverdrawCounter();
+
+    GpuOverdrawCounter(const GpuOverdrawCounter&) = delete;
+    GpuOverdrawCounter& operator=(const GpuOverdrawCounter&) = delete;
+
+    bool supported() const {
+        return queryPool != VK_NULL_HANDLE;
+    }
+
+    // All outside a render pass; the count spans every pass in between
+    void reset(VkCommandBuffer commandBuffer, uint32_t slot);
+    void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+    void end(VkCommandBuffer commandBuffer, uint32_t slot);
+    // As GpuFrameTimer::markSubmitted()
+    void markSubmitted(uint32_t slot);
+
+    // Only call once the slot's last frame's fence has signaled
+    std::optional<double> collect(uint32_t slot, uint64_t pixels);
+
+private:
+    VkDevice device;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    std::vector<bool> written;
+};
@@ -0,0 +1,251 @@
+#include "region_file.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char REGION_MAGIC[4] = { 'V', 'X', 'R', 'G' };
+constexpr uint32_t REGION_VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t TABLE_SIZE = REGION_SIZE * REGION_SIZE * 8;
+
+// Palettes this small fit the index and a short length in one byte
+constexpr size_t SMALL_PALETTE = 16;
+
+static_assert(
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+    "region files are read and written in host order"
+);
+
+static void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+static uint32_t getU32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while(value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t getVarint(const uint8_t*& p, const uint8_t* end) {
+    uint32_t value = 0;
+    for(int shift = 0; shift < 32; shift += 7) {
+        if(p == end) {
+            break;
+        }
+        uint8_t byte = *p++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("truncated chunk payload");
+}
+
+void encodeChunk(const Chunk& chunk, std::vector<uint8_t>& out) {
+    const BlockId* blocks = chunk.data();
+
+    // Palette in order of first appearance
+    int16_t paletteIndex[256];
+    std::memset(paletteIndex, 0xff, sizeof(paletteIndex));
+    std::vector<BlockId> palette;
+    for(int i = 0; i < CHUNK_VOLUME; i++) {
+        if(paletteIndex[blocks[i]] < 0) {
+            paletteIndex[blocks[i]] = static_cast<int16_t>(palette.size());
+            palette.push_back(blocks[i]);
+        }
+    }
+    out.push_back(static_cast<uint8_t>(palette.size() - 1));
+    out.insert(out.end(), palette.begin(), palette.end());
+
+    bool small = palette.size() <= SMALL_PALETTE;
+    for(int i = 0; i < CHUNK_VOLUME;) {
+        BlockId block = blocks[i];
+        int start = i;
+        while(i < CHUNK_VOLUME && blocks[i] == block) {
+            i++;
+        }
+        uint32_t length = i - start;
+        uint8_t index = static_cast<uint8_t>(paletteIndex[block]);
+
+        if(small) {
+            if(length < 16) {
+                out.push_back(static_cast<uint8_t>(index << 4 | (length - 1)));
+            } else {
+                out.push_back(static_cast<uint8_t>(index << 4 | 15));
+                putVarint(out, length - 16);
+            }
+        } else {
+            out.push_back(index);
+            putVarint(out, length - 1);
+        }
+    }
+}
+
+void decodeChunk(const uint8_t* data, size_t size, Chunk& chunk) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    if(p == end) {
+        throw std::runtime_error("empty chunk payload");
+    }
+    size_t paletteSize = size_t(*p++) + 1;
+    if(static_cast<size_t>(end - p) < paletteSize) {
+        throw std::runtime_error("truncated chunk palette");
+    }
+    const BlockId* palette = p;
+    p += paletteSize;
+
+    bool small = paletteSize <= SMALL_PALETTE;
+    BlockId* blocks = chunk.data();
+    uint32_t filled = 0;
+    while(filled < CHUNK_VOLUME) {
+        if(p == end) {
+            throw std::runtime_error("truncated chunk payload");
+        }
+        uint32_t index;
+        uint32_t length;
+        if(small) {
+            index = *p >> 4;
+            length = (*p++ & 15) + 1;
+            if(length == 16) {
+                length += getVarint(p, end);
+            }
+        } else {
+            index = *p++;
+            length = getVarint(p, end) + 1;
+        }
+        if(index >= paletteSize || length > CHUNK_VOLUME - filled) {
+            throw std::runtime_error("corrupt chunk payload");
+        }
+        std::memset(blocks + filled, palette[index], length);
+        filled += length;
+    }
+    if(p != end) {
+        throw std::runtime_error("trailing bytes in chunk payload");
+    }
+}
+
+void writeRegionFile(const std::string& path, const std::vector<RegionChunk>& chunks) {
+    std::vector<uint8_t> header(REGION_MAGIC, REGION_MAGIC + 4);
+    putU32(header, REGION_VERSION);
+    putU32(header, REGION_SIZE);
+    putU32(header, 0);
+
+    std::vector<uint32_t> offsets(REGION_SIZE * REGION_SIZE, 0);
+    std::vector<uint32_t> sizes(REGION_SIZE * REGION_SIZE, 0);
+    std::vector<uint8_t> payloads;
+    for(const RegionChunk& chunk : chunks) {
+        if(chunk.x < 0 || chunk.x >= REGION_SIZE || chunk.z < 0 || chunk.z >= REGION_SIZE) {
+            throw std::runtime_error("chunk outside its region");
+        }
+        size_t start = payloads.size();
+        encodeChunk(*chunk.chunk, payloads);
+        offsets[chunk.x + chunk.z * REGION_SIZE] = static_cast<uint32_t>(HEADER_SIZE + TABLE_SIZE + start);
+        sizes[chunk.x + chunk.z * REGION_SIZE] = static_cast<uint32_t>(payloads.size() - start);
+    }
+    for(size_t i = 0; i < offsets.size(); i++) {
+        putU32(header, offsets[i]);
+        putU32(header, sizes[i]);
+    }
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(header.data()), header.size());
+        file.write(reinterpret_cast<const char*>(payloads.data()), payloads.size());
+        file.flush();
+        if(!file) {
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("failed to write region file " + path);
+        }
+    }
+    if(std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("failed to replace region file " + path);
+    }
+}
+
+std::string regionPath(const std::string& dir, int32_t regionX, int32_t regionZ) {
+    return dir + "/r." + std::to_string(regionX) + "." + std::to_string(regionZ) + ".vxr";
+}
+
+RegionFile::RegionFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw std::runtime_error("failed to open region file " + path);
+    }
+    struct stat status;
+    if(fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat region file " + path);
+    }
+    size = static_cast<size_t>(status.st_size);
+    if(size < HEADER_SIZE + TABLE_SIZE) {
+        close(fd);
+        throw std::runtime_error("region file too small: " + path);
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        throw std::runtime_error("failed to map region file " + path);
+    }
+    mapping = static_cast<const uint8_t*>(mapped);
+    // Chunks are looked up by position, not read front to back
+    madvise(mapped, size, MADV_RANDOM);
+
+    bool valid = std::memcmp(mapping, REGION_MAGIC, 4) == 0
+        && getU32(mapping + 4) == REGION_VERSION
+        && getU32(mapping + 8) == REGION_SIZE;
+    for(int i = 0; valid && i < REGION_SIZE * REGION_SIZE; i++) {
+        Entry e = entry(i % REGION_SIZE, i / REGION_SIZE);
+        valid = e.size == 0 || (e.offset >= HEADER_SIZE + TABLE_SIZE
+            && e.offset <= size && e.size <= size - e.offset);
+    }
+    if(!valid) {
+        munmap(const_cast<uint8_t*>(mapping), size);
+        throw std::runtime_error("invalid region file " + path);
+    }
+}
+
+RegionFile::~RegionFile() {
+    munmap(const_cast<uint8_t*>(mapping), size);
+}
+
+RegionFile::Entry RegionFile::entry(int x, int z) const {
+    if(x < 0 || x >= REGION_SIZE || z < 0 || z >= REGION_SIZE) {
+        throw std::runtime_error("chunk outside its region");
+    }
+    const uint8_t* p = mapping + HEADER_SIZE + 8 * (x + z * REGION_SIZE);
+    return Entry { getU32(p), getU32(p + 4) };
+}
+
+bool RegionFile::contains(int x, int z) const {
+    return entry(x, z).size != 0;
+}
+
+bool RegionFile::load(int x, int z, Chunk& chunk) const {
+    Entry e = entry(x, z);
+    if(e.size == 0) {
+        return false;
+    }
+    decodeChunk(mapping + e.offset, e.size, chunk);
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chunk.hpp"
+
+// Chunks per side of a region; a region file holds up to REGION_SIZE^2
+constexpr int REGION_SIZE = 32;
+
+/*
+    Chunk payloads: a palette of the block types in the chunk, then the
+    blocks in Chunk order as runs of palette indices.
+
+    Layout:
+    - u8 palette size - 1, then that many BlockIds;
+    - runs until CHUNK_VOLUME blocks are covered. With up to 16 palette
+      entries a run is one byte, index << 4 | (length - 1), where a low
+      nibble of 15 means a varint of length - 16 follows. With more it is an
+      index byte and a varint of length - 1.
+
+    Terrain is mostly whole horizontal layers of one block, which collapse
+    to a few runs per layer.
+*/
+void encodeChunk(const Chunk& chunk, std::vector<uint8_t>& out);
+// Throws std::runtime_error if the payload is malformed
+void decodeChunk(const uint8_t* data, size_t size, Chunk& chunk);
+
+struct RegionChunk {
+    // Position within the region, 0 to REGION_SIZE - 1
+    int x;
+    int z;
+    const Chunk* chunk;
+};
+
+/*
+    Writes a whole region file, replacing any existing one only once the new
+    one is complete.
+
+    File layout, little endian:
+    - header: magic "VXRG", u32 version, u32 REGION_SIZE, u32 reserved;
+    - REGION_SIZE^2 entries of u32 offset and u32 size, indexed
+      x + z * REGION_SIZE; a size of 0 means the chunk is not stored;
+    - the chunk payloads.
+*/
+void writeRegionFile(const std::string& path, const std::vector<RegionChunk>& chunks);
+
+// Region containing a chunk, and the chunk's position within it
+inline int32_t regionCoord(int32_t chunkCoord) {
+    return chunkCoord >= 0 ? chunkCoord / REGION_SIZE : (chunkCoord + 1) / REGION_SIZE - 1;
+}
+inline int regionLocal(int32_t chunkCoord) {
+    return static_cast<int>(chunkCoord - regionCoord(chunkCoord) * REGION_SIZE);
+}
+// dir/r.X.Z.vxr
+std::string regionPath(const std::string& dir, int32_t regionX, int32_t regionZ);
+
+/*
+    A region file mapped read only into memory.
+
+    Opening validates the header and offset table. load() decodes straight
+    from the mapping into the chunk: there is no read into a buffer first,
+    and only the pages a chunk's payload sits in are touched, so loading one
+    chunk from a large region reads a few KiB, not the file.
+
+    Loads are const and safe to run from several threads at once.
+*/
+class RegionFile {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is not a
+    // valid region file
+    explicit RegionFile(const std::string& path);
+    ~RegionFile();
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile& operator=(const RegionFile&) = delete;
+
+    bool contains(int x, int z) const;
+    // False if the chunk is not stored; throws if its payload is malformed
+    bool load(int x, int z, Chunk& chunk) const;
+
+    size_t fileSize() const {
+        return size;
+    }
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    Entry entry(int x, int z) const;
+
+    const uint8_t* mapping = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,68 @@
+#include "secondary_recorder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+SecondaryRecorder::SecondaryRecorder(
+    VkDevice device,
+    uint32_t queueFamily,
+    uint32_t slotCount,
+    uint32_t rangeCount
+) : ranges(std::max(rangeCount, 1u)) {
+    for(uint32_t range = 0; range < ranges; range++) {
+        rangePools.push_back(std::make_unique<FrameCommandPools>(
+            device,
+            queueFamily,
+            slotCount,
+            VK_COMMAND_BUFFER_LEVEL_SECONDARY
+        ));
+    }
+}
+
+void SecondaryRecorder::beginFrame(uint32_t slot) {
+    for(std::unique_ptr<FrameCommandPools>& pools : rangePools) {
+        pools->reset(slot);
+    }
+}
+
+void SecondaryRecorder::record(
+    JobSystem& jobs,
+    uint32_t slot,
+    const VkCommandBufferInheritanceInfo& inheritance,
+    uint32_t count,
+    const std::function<void(VkCommandBuffer, uint32_t, uint32_t)>& recordRange,
+    std::vector<VkCommandBuffer>& commandBuffers
+) {
+    uint32_t rangeCount = std::min(ranges, count);
+    if(rangeCount == 0) {
+        return;
+    }
+    size_t first = commandBuffers.size();
+    commandBuffers.resize(first + rangeCount);
+
+    JobGroup group;
+    for(uint32_t range = 0; range < rangeCount; range++) {
+        uint32_t begin = static_cast<uint32_t>(uint64_t(count) * range / rangeCount);
+        uint32_t end = static_cast<uint32_t>(uint64_t(count) * (range + 1) / rangeCount);
+        jobs.submit(group, [&, range, begin, end]() {
+            VkCommandBuffer commandBuffer = rangePools[range]->acquire(slot);
+            VkCommandBufferBeginInfo beginInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                // Entirely inside the render pass (or dynamic rendering)
+                // the inheritance names
+                .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT
+                    | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = &inheritance
+            };
+            if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+            recordRange(commandBuffer, begin, end);
+            if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            commandBuffers[first + range] = commandBuffer;
+        });
+    }
+    jobs.wait(group);
+}
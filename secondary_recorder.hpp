@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "frame_command_pools.hpp"
+#include "job_system.hpp"
+
+/*
+    Records the draws of a render pass on several threads, into secondary
+    command buffers the primary one runs with vkCmdExecuteCommands.
+
+    A command pool and everything allocated from it may only be used by one
+    thread at a time, so every range of draws recorded in parallel gets a
+    pool of its own, per frame slot. Only the job recording that range ever
+    touches its pool, so none of them needs a lock. The pools are reset
+    whole by beginFrame(), see FrameCommandPools.
+*/
+class SecondaryRecorder {
+public:
+    // Draws are split in up to rangeCount parallel ranges
+    SecondaryRecorder(
+        VkDevice device,
+        uint32_t queueFamily,
+        uint32_t slotCount,
+        uint32_t rangeCount
+    );
+
+    SecondaryRecorder(const SecondaryRecorder&) = delete;
+    SecondaryRecorder& operator=(const SecondaryRecorder&) = delete;
+
+    // Resets the slot's pools; the slot's last frame must be done
+    void beginFrame(uint32_t slot);
+
+    /*
+        Splits [0, count) into contiguous ranges, and records each on the job
+        system as recordRange(commandBuffer, begin, end) into a secondary
+        buffer continuing inheritance's subpass. Appends the buffers to
+        commandBuffers in range order, so executing them keeps draw order.
+        Returns once all are recorded; rethrows the first error.
+    */
+    void record(
+        JobSystem& jobs,
+        uint32_t slot,
+        const VkCommandBufferInheritanceInfo& inheritance,
+        uint32_t count,
+        const std::function<void(VkCommandBuffer, uint32_t, uint32_t)>& recordRange,
+        std::vector<VkCommandBuffer>& commandBuffers
+    );
+
+    uint32_t rangeCount() const {
+        return ranges;
+    }
+
+private:
+    uint32_t ranges;
+    // One set of per-slot pools per range
+    std::vector<std::unique_ptr<FrameCommandPools>> rangePools;
+};
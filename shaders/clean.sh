@@ -1 +1 @@
-rm frag.spv vert.spv
+rm frag.spv vert.spv voxel_vert.spv voxel_stream_vert.spv voxel_frag.spv cull_comp.spv hiz_comp.spv
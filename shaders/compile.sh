@@ -1,2 +1,7 @@
 glslc shader.vert -o vert.spv
 glslc shader.frag -o frag.spv
+glslc voxel.vert -o voxel_vert.spv
+glslc -DINSTANCE_ORIGIN voxel.vert -o voxel_stream_vert.spv
+glslc voxel.frag -o voxel_frag.spv
+glslc cull.comp -o cull_comp.spv
+glslc hiz.comp -o hiz_comp.spv
@@ -1,20 +1,19 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// Camera transform, pushed once per command buffer
+layout(push_constant) uniform PushConstants {
+    mat4 mvp;
+} pc;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(location = 0) out vec3 fragColor;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// The depth pre-pass and the color pass must compute the same depth
+invariant gl_Position;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    gl_Position = pc.mvp * vec4(inPosition, 1.0);
+    fragColor = inColor;
 }
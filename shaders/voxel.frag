@@ -0,0 +1,36 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Outputs of voxel.vert
+layout(location = 1) flat in uint fragMaterial;
+layout(location = 2) in vec2 fragUv;
+layout(location = 3) in float fragShade;
+
+layout(location = 0) out vec4 outColor;
+
+// GpuMaterial in material_library.hpp
+struct Material {
+    vec4 tint;
+    uint texture;
+};
+
+// The bindless set, see BindlessTable
+layout(set = 0, binding = 0) readonly buffer Materials {
+    Material materials[];
+} buffers[];
+layout(set = 0, binding = 1) uniform texture2D textures[];
+layout(set = 0, binding = 2) uniform sampler blockSampler;
+
+// MaterialLibrary::materialBuffer()
+layout(constant_id = 0) const uint MATERIAL_BUFFER = 0;
+
+void main() {
+    Material material = buffers[MATERIAL_BUFFER].materials[fragMaterial];
+    // A triangle's material is the same for all its fragments, but may
+    // differ between triangles of a draw
+    vec4 texel = texture(
+        sampler2D(textures[nonuniformEXT(material.texture)], blockSampler),
+        fragUv
+    );
+    outColor = vec4(texel.rgb * material.tint.rgb * fragShade, 1.0);
+}
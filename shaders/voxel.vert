@@ -0,0 +1,62 @@
+#version 450
+
+// Camera transform, then the world position of the chunk being drawn
+layout(push_constant) uniform PushConstants {
+    mat4 mvp;
+    vec4 chunkOrigin;
+} pc;
+
+// See VoxelVertex in voxel_mesh.hpp for the packing
+layout(location = 0) in uint inPacked;
+layout(location = 1) in uint inMaterial;
+
+// Streamed chunks are drawn indirectly, where push constants cannot change
+// between draws. Compiled with INSTANCE_ORIGIN, the origin is a per-instance
+// attribute instead, read from the chunk's ChunkRecord through firstInstance.
+#ifdef INSTANCE_ORIGIN
+layout(location = 2) in vec4 inChunkOrigin;
+#define CHUNK_ORIGIN inChunkOrigin
+#else
+#define CHUNK_ORIGIN pc.chunkOrigin
+#endif
+
+layout(location = 0) out vec3 fragColor;
+// For shaders/voxel.frag, which looks the material up instead of using
+// fragColor: the block type, texture coordinates in blocks across the
+// face, and the face and ambient occlusion shading
+layout(location = 1) flat out uint fragMaterial;
+layout(location = 2) out vec2 fragUv;
+layout(location = 3) out float fragShade;
+
+// The depth pre-pass and the color pass must compute the same depth
+invariant gl_Position;
+
+// Indexed by block type: air (never meshed), stone, dirt, grass
+const vec3 materialColors[4] = vec3[](
+    vec3(1.0, 0.0, 1.0),
+    vec3(0.5, 0.5, 0.5),
+    vec3(0.45, 0.3, 0.15),
+    vec3(0.3, 0.65, 0.2)
+);
+
+// Indexed by face: +x, -x, +y, -y, +z, -z
+const float faceShade[6] = float[](0.8, 0.8, 1.0, 0.5, 0.65, 0.65);
+
+void main() {
+    vec3 position = vec3(
+        inPacked & 63u,
+        (inPacked >> 6) & 63u,
+        (inPacked >> 12) & 63u
+    );
+    uint face = (inPacked >> 18) & 7u;
+    uint ao = (inPacked >> 21) & 3u;
+
+    gl_Position = pc.mvp * vec4(CHUNK_ORIGIN.xyz + position, 1.0);
+    // Fully occluded corners keep 40% of their light
+    fragShade = faceShade[face] * (0.4 + 0.2 * float(ao));
+    fragColor = materialColors[min(inMaterial, 3u)] * fragShade;
+    fragMaterial = inMaterial;
+    // The two axes in the face's plane, so textures repeat once per block
+    // across a greedy quad
+    fragUv = face < 2u ? position.zy : face < 4u ? position.xz : position.xy;
+}
@@ -0,0 +1,297 @@
+#include "tlsf.hpp"
+
+#include <stdexcept>
+
+// Index of the most significant set bit, value must be non-zero
+static uint32_t highestBit(uint64_t value) {
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+}
+
+static uint32_t lowestBit(uint64_t value) {
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size) : totalSize(size) {
+    if(size == 0) {
+        throw std::runtime_error("tlsf allocator needs a non-empty range");
+    }
+
+    for(uint32_t fl = 0; fl < FL_COUNT; fl++) {
+        for(uint32_t sl = 0; sl < SL_COUNT; sl++) {
+            freeHeads[fl][sl] = NONE;
+        }
+    }
+
+    // The whole range starts out as a single free region
+    uint32_t node = newNode();
+    nodes[node] = Node { 0, size, NONE, NONE, NONE, NONE, NodeState::Free, 0 };
+    insertFree(node);
+}
+
+/*
+    Sizes below SL_COUNT get exact classes in first level 0. Above that the
+    first level is the power of two and the second level the next
+    SL_COUNT_LOG2 bits below it.
+*/
+void TlsfAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    if(size < SL_COUNT) {
+        fl = 0;
+        sl = static_cast<uint32_t>(size);
+        return;
+    }
+
+    uint32_t msb = highestBit(size);
+    fl = msb - SL_COUNT_LOG2 + 1;
+    sl = static_cast<uint32_t>(size >> (msb - SL_COUNT_LOG2)) & (SL_COUNT - 1);
+}
+
+uint32_t TlsfAllocator::newNode() {
+    if(!unusedNodes.empty()) {
+        uint32_t node = unusedNodes.back();
+        unusedNodes.pop_back();
+        return node;
+    }
+    nodes.push_back(Node { 0, 0, NONE, NONE, NONE, NONE, NodeState::Unused, 0 });
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TlsfAllocator::releaseNode(uint32_t node) {
+    nodes[node].state = NodeState::Unused;
+    unusedNodes.push_back(node);
+}
+
+void TlsfAllocator::insertFree(uint32_t node) {
+    uint32_t fl, sl;
+    mapping(nodes[node].size, fl, sl);
+
+    nodes[node].state = NodeState::Free;
+    nodes[node].prevFree = NONE;
+    nodes[node].nextFree = freeHeads[fl][sl];
+    if(freeHeads[fl][sl] != NONE) {
+        nodes[freeHeads[fl][sl]].prevFree = node;
+    }
+    freeHeads[fl][sl] = node;
+
+    flBitmap |= 1ull << fl;
+    slBitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFree(uint32_t node) {
+    uint32_t fl, sl;
+    mapping(nodes[node].size, fl, sl);
+
+    Node& n = nodes[node];
+    if(n.prevFree != NONE) {
+        nodes[n.prevFree].nextFree = n.nextFree;
+    } else {
+        freeHeads[fl][sl] = n.nextFree;
+    }
+    if(n.nextFree != NONE) {
+        nodes[n.nextFree].prevFree = n.prevFree;
+    }
+    n.state = NodeState::Used;
+
+    if(freeHeads[fl][sl] == NONE) {
+        slBitmap[fl] &= ~(1u << sl);
+        if(slBitmap[fl] == 0) {
+            flBitmap &= ~(1ull << fl);
+        }
+    }
+}
+
+/*
+    Round the request up to the start of the next size class, so any region
+    in the class we land in is guaranteed to fit, then take the first
+    non-empty class at or above it.
+*/
+uint32_t TlsfAllocator::findFree(uint64_t size) {
+    if(size >= SL_COUNT) {
+        uint64_t round = (1ull << (highestBit(size) - SL_COUNT_LOG2)) - 1;
+        if(size > UINT64_MAX - round) {
+            return NONE;
+        }
+        size += round;
+    }
+
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+    if(fl >= FL_COUNT) {
+        return NONE;
+    }
+
+    uint32_t slMap = slBitmap[fl] & (~0u << sl);
+    if(slMap == 0) {
+        uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+        if(flMap == 0) {
+            return NONE;
+        }
+        fl = lowestBit(flMap);
+        slMap = slBitmap[fl];
+    }
+    sl = lowestBit(slMap);
+
+    return freeHeads[fl][sl];
+}
+
+/*
+    The rounded search above can miss a region that would fit exactly but
+    shares the request's size class (e.g. one region spanning the whole
+    range). As a last resort walk that one class looking for it.
+*/
+uint32_t TlsfAllocator::findFreeInClass(uint64_t size) {
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+    for(uint32_t n = freeHeads[fl][sl]; n != NONE; n = nodes[n].nextFree) {
+        if(nodes[n].size >= size) {
+            return n;
+        }
+    }
+    return NONE;
+}
+
+uint32_t TlsfAllocator::splitFront(uint32_t node, uint64_t size) {
+    uint32_t rest = newNode();
+    // nodes may have reallocated, so index rather than hold references
+    nodes[rest].offset = nodes[node].offset + size;
+    nodes[rest].size = nodes[node].size - size;
+    nodes[rest].prevPhysical = node;
+    nodes[rest].nextPhysical = nodes[node].nextPhysical;
+    nodes[rest].prevFree = NONE;
+    nodes[rest].nextFree = NONE;
+    nodes[rest].state = NodeState::Used;
+    if(nodes[node].nextPhysical != NONE) {
+        nodes[nodes[node].nextPhysical].prevPhysical = rest;
+    }
+    nodes[node].nextPhysical = rest;
+    nodes[node].size = size;
+    return rest;
+}
+
+std::optional<TlsfAllocator::Allocation> TlsfAllocator::allocate(
+    uint64_t size,
+    uint64_t alignment
+) {
+    if(size == 0) {
+        size = 1;
+    }
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("tlsf alignment must be a power of two");
+    }
+
+    // Over-ask by the worst case padding so the aligned start always fits
+    uint64_t padded = size + alignment - 1;
+    if(padded < size) {
+        return std::nullopt;
+    }
+
+    uint32_t node = findFree(padded);
+    if(node == NONE) {
+        node = findFreeInClass(padded);
+    }
+    if(node == NONE) {
+        return std::nullopt;
+    }
+    removeFree(node);
+
+    // Give the bytes before the aligned start back as their own free region.
+    // The physical neighbour before a free region is never free (free
+    // regions are always merged) so there is nothing to merge with.
+    uint64_t offset = nodes[node].offset;
+    uint64_t padding = ((offset + alignment - 1) & ~(alignment - 1)) - offset;
+    if(padding > 0) {
+        uint32_t aligned = splitFront(node, padding);
+        insertFree(node);
+        node = aligned;
+    }
+
+    if(nodes[node].size > size) {
+        uint32_t rest = splitFront(node, size);
+        uint32_t next = nodes[rest].nextPhysical;
+        // The remainder may now touch a free region after it
+        if(next != NONE && nodes[next].state == NodeState::Free) {
+            removeFree(next);
+            nodes[rest].size += nodes[next].size;
+            nodes[rest].nextPhysical = nodes[next].nextPhysical;
+            if(nodes[next].nextPhysical != NONE) {
+                nodes[nodes[next].nextPhysical].prevPhysical = rest;
+            }
+            releaseNode(next);
+        }
+        insertFree(rest);
+    }
+
+    nodes[node].state = NodeState::Used;
+    // Handles to earlier allocations in this node no longer match
+    nodes[node].generation++;
+    usedBytes += nodes[node].size;
+    allocationCount++;
+
+    return Allocation { nodes[node].offset, node, nodes[node].generation };
+}
+
+void TlsfAllocator::free(const Allocation& allocation) {
+    uint32_t node = allocation.node;
+    // A node freed and merged away is Unused; one freed and handed out
+    // again has moved on a generation
+    if(
+        node >= nodes.size()
+        || nodes[node].state != NodeState::Used
+        || nodes[node].generation != allocation.generation
+        || nodes[node].offset != allocation.offset
+    ) {
+        throw std::runtime_error("tlsf free of an invalid allocation");
+    }
+
+    usedBytes -= nodes[node].size;
+    allocationCount--;
+
+    // Merge with the previous region if it is free
+    uint32_t prev = nodes[node].prevPhysical;
+    if(prev != NONE && nodes[prev].state == NodeState::Free) {
+        removeFree(prev);
+        nodes[prev].size += nodes[node].size;
+        nodes[prev].nextPhysical = nodes[node].nextPhysical;
+        if(nodes[node].nextPhysical != NONE) {
+            nodes[nodes[node].nextPhysical].prevPhysical = prev;
+        }
+        releaseNode(node);
+        node = prev;
+    }
+
+    // And with the next one
+    uint32_t next = nodes[node].nextPhysical;
+    if(next != NONE && nodes[next].state == NodeState::Free) {
+        removeFree(next);
+        nodes[node].size += nodes[next].size;
+        nodes[node].nextPhysical = nodes[next].nextPhysical;
+        if(nodes[next].nextPhysical != NONE) {
+            nodes[nodes[next].nextPhysical].prevPhysical = node;
+        }
+        releaseNode(next);
+    }
+
+    insertFree(node);
+}
+
+TlsfAllocator::Stats TlsfAllocator::stats() const {
+    Stats stats;
+    stats.size = totalSize;
+    stats.usedBytes = usedBytes;
+    stats.allocationCount = allocationCount;
+
+    for(uint32_t fl = 0; fl < FL_COUNT; fl++) {
+        if(!(flBitmap & (1ull << fl))) {
+            continue;
+        }
+        for(uint32_t sl = 0; sl < SL_COUNT; sl++) {
+            for(uint32_t n = freeHeads[fl][sl]; n != NONE; n = nodes[n].nextFree) {
+                stats.freeRegionCount++;
+                if(nodes[n].size > stats.largestFreeRegion) {
+                    stats.largestFreeRegion = nodes[n].size;
+                }
+            }
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+    Two-Level Segregated Fit allocator over an abstract range [0, size).
+
+    It only hands out offsets, it never touches memory, so it can manage a
+    VkDeviceMemory block, a region of a large buffer or anything else that is
+    addressed by offset. Nothing here depends on Vulkan.
+
+    Free regions are kept in lists bucketed first by power of two (first
+    level) and then by 16 linear steps within that power (second level), with
+    a bitmap per level. Finding a fit is a couple of bit scans, and freeing
+    merges with physically adjacent free regions, so both are O(1) and
+    fragmentation stays low.
+*/
+class TlsfAllocator {
+public:
+    struct Allocation {
+        uint64_t offset = 0;
+        // Internal region handle, passed back to free()
+        uint32_t node = UINT32_MAX;
+        // Tells a live handle from a stale one whose node was reused
+        uint32_t generation = 0;
+    };
+
+    struct Stats {
+        uint64_t size = 0;
+        uint64_t usedBytes = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRegionCount = 0;
+        uint64_t largestFreeRegion = 0;
+    };
+
+    explicit TlsfAllocator(uint64_t size);
+
+    // alignment must be a power of two. Returns nothing if no free region
+    // is large enough.
+    std::optional<Allocation> allocate(uint64_t size, uint64_t alignment);
+    // Throws on an allocation that is not live, e.g. freed twice
+    void free(const Allocation& allocation);
+
+    bool empty() const { return allocationCount == 0; }
+    uint64_t size() const { return totalSize; }
+    Stats stats() const;
+
+private:
+    static constexpr uint32_t SL_COUNT_LOG2 = 4;
+    static constexpr uint32_t SL_COUNT = 1 << SL_COUNT_LOG2;
+    static constexpr uint32_t FL_COUNT = 64;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    enum class NodeState : uint8_t {
+        Used,
+        Free,
+        // Merged into a neighbour, waiting in unusedNodes
+        Unused
+    };
+
+    struct Node {
+        uint64_t offset;
+        uint64_t size;
+        // Neighbours by address, for merging on free
+        uint32_t prevPhysical;
+        uint32_t nextPhysical;
+        // Neighbours in the size class free list, only while free
+        uint32_t prevFree;
+        uint32_t nextFree;
+        NodeState state;
+        // Bumped each time the node is handed out
+        uint32_t generation;
+    };
+
+    static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+    uint32_t newNode();
+    void releaseNode(uint32_t node);
+    void insertFree(uint32_t node);
+    void removeFree(uint32_t node);
+    uint32_t findFree(uint64_t size);
+    uint32_t findFreeInClass(uint64_t size);
+    // Cut `size` bytes off the front of node, returning the remainder node
+    uint32_t splitFront(uint32_t node, uint64_t size);
+
+    uint64_t totalSize;
+    uint64_t usedBytes = 0;
+    uint32_t allocationCount = 0;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> unusedNodes;
+
+    uint64_t flBitmap = 0;
+    uint32_t slBitmap[FL_COUNT] = {};
+    uint32_t freeHeads[FL_COUNT][SL_COUNT];
+};
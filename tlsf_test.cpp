@@ -0,0 +1,157 @@
+/*
+    CPU-only checks for the TLSF sub-allocator; needs no Vulkan device.
+
+    Covers alignment, splitting and merging of regions, running out of space,
+    the stats counters, and rejecting frees of allocations that are not live.
+    Exits non-zero if any check fails.
+*/
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "tlsf.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if(!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static bool throws(const std::function<void()>& function) {
+    try {
+        function();
+    } catch(const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static TlsfAllocator::Allocation allocateOrFail(TlsfAllocator& tlsf, uint64_t size, uint64_t alignment) {
+    std::optional<TlsfAllocator::Allocation> allocation = tlsf.allocate(size, alignment);
+    if(!allocation) {
+        throw std::runtime_error("allocation unexpectedly failed");
+    }
+    return *allocation;
+}
+
+static void testAlignment() {
+    TlsfAllocator tlsf(1 << 20);
+    // Knock the free region off alignment first
+    allocateOrFail(tlsf, 3, 1);
+    for(uint64_t alignment = 1; alignment <= 4096; alignment *= 2) {
+        TlsfAllocator::Allocation allocation = allocateOrFail(tlsf, 100, alignment);
+        check(allocation.offset % alignment == 0, "offset is aligned");
+    }
+    check(throws([&]() { tlsf.allocate(16, 3); }), "non power of two alignment throws");
+    check(throws([&]() { tlsf.allocate(16, 0); }), "zero alignment throws");
+}
+
+static void testSplitAndMerge() {
+    TlsfAllocator tlsf(1024);
+    TlsfAllocator::Allocation a = allocateOrFail(tlsf, 256, 1);
+    TlsfAllocator::Allocation b = allocateOrFail(tlsf, 256, 1);
+    TlsfAllocator::Allocation c = allocateOrFail(tlsf, 256, 1);
+    check(a.offset == 0 && b.offset == 256 && c.offset == 512, "regions split off in order");
+    check(tlsf.stats().freeRegionCount == 1, "one free region after the splits");
+    check(tlsf.stats().largestFreeRegion == 256, "remainder is the tail");
+
+    // Freeing the middle leaves a hole; freeing its neighbours merges all
+    tlsf.free(b);
+    check(tlsf.stats().freeRegionCount == 2, "hole is its own free region");
+    tlsf.free(a);
+    check(tlsf.stats().freeRegionCount == 2, "merged with the next region");
+    check(tlsf.stats().largestFreeRegion == 512, "merged region spans both");
+    tlsf.free(c);
+    TlsfAllocator::Stats stats = tlsf.stats();
+    check(stats.freeRegionCount == 1, "everything merged back");
+    check(stats.largestFreeRegion == 1024, "whole range free again");
+    check(tlsf.empty(), "no allocations left");
+
+    // The whole range fits in one piece again
+    TlsfAllocator::Allocation whole = allocateOrFail(tlsf, 1024, 1);
+    check(whole.offset == 0, "whole range allocated from the start");
+}
+
+static void testOutOfSpace() {
+    TlsfAllocator tlsf(4096);
+    check(!tlsf.allocate(4097, 1), "larger than the range fails");
+    check(!tlsf.allocate(UINT64_MAX, 1), "huge size fails without overflow");
+
+    std::vector<TlsfAllocator::Allocation> allocations;
+    for(int i = 0; i < 16; i++) {
+        allocations.push_back(allocateOrFail(tlsf, 256, 1));
+    }
+    check(!tlsf.allocate(1, 1), "full allocator fails");
+
+    // Two separate holes do not make room for one region of both sizes
+    tlsf.free(allocations[3]);
+    tlsf.free(allocations[5]);
+    check(!tlsf.allocate(512, 1), "fragmented space fails");
+    tlsf.free(allocations[4]);
+    check(tlsf.allocate(768, 1).has_value(), "merged holes fit");
+}
+
+static void testStats() {
+    TlsfAllocator tlsf(1 << 16);
+    TlsfAllocator::Stats stats = tlsf.stats();
+    check(stats.size == 1 << 16, "size reported");
+    check(stats.usedBytes == 0 && stats.allocationCount == 0, "starts empty");
+
+    TlsfAllocator::Allocation a = allocateOrFail(tlsf, 100, 1);
+    TlsfAllocator::Allocation b = allocateOrFail(tlsf, 200, 1);
+    stats = tlsf.stats();
+    check(stats.usedBytes == 300, "used bytes counted");
+    check(stats.allocationCount == 2, "allocations counted");
+    check(stats.largestFreeRegion == (1 << 16) - 300, "largest free region");
+
+    tlsf.free(a);
+    stats = tlsf.stats();
+    check(stats.usedBytes == 200 && stats.allocationCount == 1, "free uncounted");
+    tlsf.free(b);
+    check(tlsf.stats().usedBytes == 0 && tlsf.empty(), "back to empty");
+}
+
+static void testInvalidFree() {
+    TlsfAllocator tlsf(1024);
+    TlsfAllocator::Allocation a = allocateOrFail(tlsf, 128, 1);
+    TlsfAllocator::Allocation b = allocateOrFail(tlsf, 128, 1);
+
+    // b merges with the free tail, then a merges into b's region
+    tlsf.free(b);
+    check(throws([&]() { tlsf.free(b); }), "double free of a free region throws");
+    tlsf.free(a);
+    check(throws([&]() { tlsf.free(b); }), "double free of a merged region throws");
+
+    // Handed out again at the same offset, the old handle is stale
+    TlsfAllocator::Allocation c = allocateOrFail(tlsf, 128, 1);
+    check(c.offset == a.offset, "region reused");
+    check(throws([&]() { tlsf.free(a); }), "free of a stale handle throws");
+    check(tlsf.stats().allocationCount == 1, "stale frees left the counters alone");
+
+    TlsfAllocator::Allocation bogus;
+    check(throws([&]() { tlsf.free(bogus); }), "free of a default handle throws");
+    tlsf.free(c);
+    check(tlsf.empty(), "live handle still frees");
+}
+
+int main() {
+    testAlignment();
+    testSplitAndMerge();
+    testOutOfSpace();
+    testStats();
+    testInvalidFree();
+
+    if(failures > 0) {
+        std::cout << failures << " tlsf checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "tlsf checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,515 @@
+#include "upload_scheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void UploadAcquire::record(VkCommandBuffer commandBuffer) const {
+    if(barriers.empty() && imageBarriers.empty()) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        // Source stage matches the semaphore wait stage, which chains the
+        // acquire after the release on the transfer queue
+        dstStageMask,
+        dstStageMask,
+        0,
+        0,
+        nullptr,
+        static_cast<uint32_t>(barriers.size()),
+        barriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()),
+        imageBarriers.data()
+    );
+}
+
+// Every image upload covers the same subresource
+static const VkImageSubresourceRange IMAGE_UPLOAD_RANGE {
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+};
+
+UploadScheduler::UploadScheduler(
+    VkDevice device,
+    GpuAllocator& allocator,
+    VkQueue transferQueue,
+    uint32_t transferFamily,
+    uint32_t graphicsFamily,
+    VkDeviceSize stagingRingSize
+) : device(device),
+    allocator(allocator),
+    transferQueue(transferQueue),
+    transferFamily(transferFamily),
+    graphicsFamily(graphicsFamily),
+    stagingRingSize(stagingRingSize) {
+    VkCommandPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        // Batch command buffers are re-recorded when recycled
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+            | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = transferFamily
+    };
+    if(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transfer command pool!");
+    }
+
+    stagingRing = allocator.createBuffer(
+        stagingRingSize,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        stagingRingAllocation
+    );
+}
+
+UploadScheduler::~UploadScheduler() {
+    for(Batch& batch : inFlight) {
+        vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        releaseStaging(batch);
+        freeBatches.push_back(std::move(batch));
+    }
+    for(Copy& copy : pending) {
+        if(copy.staging.dedicated) {
+            allocator.destroyBuffer(copy.staging.buffer, copy.staging.allocation);
+        }
+    }
+    allocator.destroyBuffer(stagingRing, stagingRingAllocation);
+
+    for(Batch& batch : freeBatches) {
+        vkDestroyFence(device, batch.fence, nullptr);
+        vkDestroySemaphore(device, batch.semaphore, nullptr);
+    }
+    // frees the command buffers
+    vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+uint64_t UploadScheduler::enqueue(
+    VkBuffer dst,
+    VkDeviceSize dstOffset,
+    const void* data,
+    VkDeviceSize size,
+    VkAccessFlags dstAccess,
+    VkPipelineStageFlags dstStage
+) {
+    Copy copy {
+        .dst = dst,
+        .dstOffset = dstOffset,
+        .size = size,
+        .dstAccess = dstAccess,
+        .dstStage = dstStage,
+        .staging = {},
+        .image = VK_NULL_HANDLE,
+        .imageExtent = {}
+    };
+    return stage(copy, data);
+}
+
+uint64_t UploadScheduler::enqueueImage(
+    VkImage dst,
+    VkExtent2D extent,
+    const void* data,
+    VkDeviceSize size,
+    VkAccessFlags dstAccess,
+    VkPipelineStageFlags dstStage
+) {
+    Copy copy {
+        .dst = VK_NULL_HANDLE,
+        .dstOffset = 0,
+        .size = size,
+        .dstAccess = dstAccess,
+        .dstStage = dstStage,
+        .staging = {},
+        .image = dst,
+        .imageExtent = extent
+    };
+    return stage(copy, data);
+}
+
+uint64_t UploadScheduler::stage(Copy copy, const void* data) {
+    VkDeviceSize size = copy.size;
+    {
+        /*
+            Ring space is handed back per batch, so the copy into the ring
+            must be pending before the lock is dropped: otherwise a flush on
+            another thread could submit (and later retire) ring space past
+            ours while we were still writing it.
+        */
+        std::lock_guard<std::mutex> lock(mutex);
+        VkDeviceSize offset;
+        if(reserveRing(size, offset)) {
+            copy.staging.buffer = stagingRing;
+            copy.staging.offset = offset;
+            copy.staging.dedicated = false;
+            std::memcpy(
+                static_cast<char*>(stagingRingAllocation.mapped) + offset,
+                data,
+                static_cast<size_t>(size)
+            );
+            pending.push_back(copy);
+            return nextBatch;
+        }
+    }
+
+    // Stage outside the lock; the allocator has its own
+    copy.staging.buffer = allocator.createBuffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        copy.staging.allocation
+    );
+    copy.staging.offset = 0;
+    copy.staging.dedicated = true;
+    std::memcpy(copy.staging.allocation.mapped, data, static_cast<size_t>(size));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    dedicatedStagingCount++;
+    pending.push_back(copy);
+    return nextBatch;
+}
+
+bool UploadScheduler::reserveRing(VkDeviceSize size, VkDeviceSize& offset) {
+    // 16 bytes keeps every copy source suitably aligned for any format
+    VkDeviceSize aligned = (size + 15) & ~VkDeviceSize(15);
+    uint64_t head = ringHead;
+    VkDeviceSize position = head % stagingRingSize;
+    // A copy never wraps: skip the end of the ring if it does not fit there
+    if(position + aligned > stagingRingSize) {
+        head += stagingRingSize - position;
+        position = 0;
+    }
+    if(head + aligned - ringTail > stagingRingSize) {
+        return false;
+    }
+
+    ringHead = head + aligned;
+    ringPeakBytes = std::max<VkDeviceSize>(ringPeakBytes, ringHead - ringTail);
+    offset = position;
+    return true;
+}
+
+UploadScheduler::Batch UploadScheduler::takeFreeBatch() {
+    if(!freeBatches.empty()) {
+        Batch batch = std::move(freeBatches.back());
+        freeBatches.pop_back();
+        vkResetFences(device, 1, &batch.fence);
+        vkResetCommandBuffer(batch.commandBuffer, 0);
+        batch.acquired = false;
+        return batch;
+    }
+
+    Batch batch;
+    VkCommandBufferAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    if(vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate transfer command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    VkSemaphoreCreateInfo semaphoreInfo {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+    };
+    if(
+        vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS
+    ) {
+        throw std::runtime_error("failed to create upload sync objects!");
+    }
+    return batch;
+}
+
+void UploadScheduler::recordBatch(const Batch& batch) {
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    if(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin transfer command buffer!");
+    }
+
+    // Images start out in whatever layout; ready them for the copy
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    for(const Copy& copy : batch.copies) {
+        if(copy.image == VK_NULL_HANDLE) {
+            continue;
+        }
+        imageBarriers.push_back(VkImageMemoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = copy.image,
+            .subresourceRange = IMAGE_UPLOAD_RANGE
+        });
+    }
+    if(!imageBarriers.empty()) {
+        vkCmdPipelineBarrier(
+            batch.commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            static_cast<uint32_t>(imageBarriers.size()),
+            imageBarriers.data()
+        );
+        imageBarriers.clear();
+    }
+
+    std::vector<VkBufferMemoryBarrier> releases;
+    for(const Copy& copy : batch.copies) {
+        if(copy.image != VK_NULL_HANDLE) {
+            VkBufferImageCopy region {
+                .bufferOffset = copy.staging.offset,
+                // Tightly packed
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+                },
+                .imageOffset = { 0, 0, 0 },
+                .imageExtent = { copy.imageExtent.width, copy.imageExtent.height, 1 }
+            };
+            vkCmdCopyBufferToImage(
+                batch.commandBuffer,
+                copy.staging.buffer,
+                copy.image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &region
+            );
+
+            /*
+                Into the layout it is sampled in. With one family the
+                semaphore wait makes this visible to the graphics queue;
+                otherwise it is also the release half of the ownership
+                transfer, and acquire() repeats the same layout change.
+            */
+            bool release = !sharesGraphicsFamily();
+            imageBarriers.push_back(VkImageMemoryBarrier {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = 0,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .srcQueueFamilyIndex = release ? transferFamily : VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = release ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED,
+                .image = copy.image,
+                .subresourceRange = IMAGE_UPLOAD_RANGE
+            });
+            continue;
+        }
+
+        VkBufferCopy region {
+            .srcOffset = copy.staging.offset,
+            .dstOffset = copy.dstOffset,
+            .size = copy.size
+        };
+        vkCmdCopyBuffer(
+            batch.commandBuffer,
+            copy.staging.buffer,
+            copy.dst,
+            1,
+            &region
+        );
+
+        if(!sharesGraphicsFamily()) {
+            releases.push_back(VkBufferMemoryBarrier {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                // Ignored for a release; the acquire carries the dst access
+                .dstAccessMask = 0,
+                .srcQueueFamilyIndex = transferFamily,
+                .dstQueueFamilyIndex = graphicsFamily,
+                .buffer = copy.dst,
+                .offset = copy.dstOffset,
+                .size = copy.size
+            });
+        }
+    }
+
+    if(!releases.empty() || !imageBarriers.empty()) {
+        vkCmdPipelineBarrier(
+            batch.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0,
+            nullptr,
+            static_cast<uint32_t>(releases.size()),
+            releases.data(),
+            static_cast<uint32_t>(imageBarriers.size()),
+            imageBarriers.data()
+        );
+    }
+
+    if(vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record transfer command buffer!");
+    }
+}
+
+void UploadScheduler::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(pending.empty()) {
+        return;
+    }
+
+    Batch batch = takeFreeBatch();
+    batch.number = nextBatch++;
+    batch.copies = std::move(pending);
+    pending.clear();
+
+    recordBatch(batch);
+    ringMarks.emplace_back(batch.number, ringHead);
+
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch.commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &batch.semaphore
+    };
+    if(vkQueueSubmit(transferQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit upload batch!");
+    }
+
+    inFlight.push_back(std::move(batch));
+}
+
+UploadAcquire UploadScheduler::acquire(uint64_t frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    UploadAcquire result;
+    for(Batch& batch : inFlight) {
+        if(batch.acquired) {
+            continue;
+        }
+        batch.acquired = true;
+        batch.acquireFrame = frame;
+
+        VkPipelineStageFlags batchStages = 0;
+        for(const Copy& copy : batch.copies) {
+            batchStages |= copy.dstStage;
+
+            // Same family: the semaphore wait alone makes the copy visible
+            if(sharesGraphicsFamily()) {
+                continue;
+            }
+            if(copy.image != VK_NULL_HANDLE) {
+                result.imageBarriers.push_back(VkImageMemoryBarrier {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .srcAccessMask = 0,
+                    .dstAccessMask = copy.dstAccess,
+                    // Must match the release in recordBatch()
+                    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    .srcQueueFamilyIndex = transferFamily,
+                    .dstQueueFamilyIndex = graphicsFamily,
+                    .image = copy.image,
+                    .subresourceRange = IMAGE_UPLOAD_RANGE
+                });
+                result.dstStageMask |= copy.dstStage;
+                continue;
+            }
+            result.barriers.push_back(VkBufferMemoryBarrier {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                // Ignored for an acquire
+                .srcAccessMask = 0,
+                .dstAccessMask = copy.dstAccess,
+                .srcQueueFamilyIndex = transferFamily,
+                .dstQueueFamilyIndex = graphicsFamily,
+                .buffer = copy.dst,
+                .offset = copy.dstOffset,
+                .size = copy.size
+            });
+            result.dstStageMask |= copy.dstStage;
+        }
+
+        result.waitSemaphores.push_back(batch.semaphore);
+        result.waitStages.push_back(batchStages);
+    }
+
+    return result;
+}
+
+void UploadScheduler::releaseStaging(Batch& batch) {
+    for(Copy& copy : batch.copies) {
+        if(copy.staging.dedicated) {
+            allocator.destroyBuffer(copy.staging.buffer, copy.staging.allocation);
+        }
+    }
+    batch.copies.clear();
+}
+
+void UploadScheduler::collect(uint64_t completedFrames) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    bool inOrder = true;
+    for(auto it = inFlight.begin(); it != inFlight.end();) {
+        bool copied = vkGetFenceStatus(device, it->fence) == VK_SUCCESS;
+        if(copied && inOrder) {
+            lastCompletedBatch = it->number;
+        } else if(!copied) {
+            inOrder = false;
+        }
+
+        // The semaphore may only be signaled again once its wait has run
+        if(copied && it->acquired && it->acquireFrame < completedFrames) {
+            releaseStaging(*it);
+            freeBatches.push_back(std::move(*it));
+            it = inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if(inFlight.empty()) {
+        lastCompletedBatch = nextBatch - 1;
+    }
+
+    // Batches can retire out of order; ring space only frees from the tail
+    uint64_t oldestInFlight = inFlight.empty() ? nextBatch : inFlight.front().number;
+    while(!ringMarks.empty() && ringMarks.front().first < oldestInFlight) {
+        ringTail = ringMarks.front().second;
+        ringMarks.pop_front();
+    }
+}
+
+UploadStats UploadScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return UploadStats {
+        .stagingRingSize = stagingRingSize,
+        .stagingRingPeakBytes = ringPeakBytes,
+        .dedicatedStagingCount = dedicatedStagingCount
+    };
+}
+
+void UploadScheduler::printStats(std::ostream& out) const {
+    UploadStats s = stats();
+    out << "staging ring: peak " << s.stagingRingPeakBytes / 1024 << " of "
+        << s.stagingRingSize / 1024 << " KiB, "
+        << s.dedicatedStagingCount << " uploads staged outside it" << std::endl;
+}
+
+uint64_t UploadScheduler::completedBatch() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastCompletedBatch;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_allocator.hpp"
+
+/*
+    What the graphics queue has to do before it may read buffers uploaded by
+    the scheduler: wait on the semaphores, and record the barriers (queue
+    family acquire operations) in the frame's command buffer.
+*/
+struct UploadAcquire {
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    std::vector<VkBufferMemoryBarrier> barriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags dstStageMask = 0;
+
+    bool empty() const {
+        return waitSemaphores.empty();
+    }
+
+    void record(VkCommandBuffer commandBuffer) const;
+};
+
+struct UploadStats {
+    VkDeviceSize stagingRingSize = 0;
+    // Most of the ring ever in use at once
+    VkDeviceSize stagingRingPeakBytes = 0;
+    // Copies that did not fit in the ring and got a staging buffer of their own
+    uint64_t dedicatedStagingCount = 0;
+};
+
+/*
+    Streams staging copies to device local buffers on the transfer queue.
+
+    Uploads are staged immediately and collected into a batch; flush() records
+    the batch into one command buffer and submits it.
+
+    Staging memory is one persistently mapped ring buffer. Uploads take space
+    at the head and batches give it back at the tail as they retire, in
+    submission order, so streaming reuses the same memory forever instead of
+    creating a staging buffer per copy. An upload the ring has no room for
+    falls back to a staging buffer of its own rather than waiting. Dedicated transfer
+    queues (DMA engines) run alongside rendering, so geometry can stream in
+    without the graphics queue stalling on copies.
+
+    Resources are created with exclusive sharing, so when the transfer family
+    differs from the graphics family each buffer's ownership must move across:
+    the batch records a release barrier after its copies, and the graphics
+    queue records the matching acquire barrier (see acquire()).
+
+    Each batch signals a fence, for the host to know when staging memory can
+    be recycled, and a binary semaphore, for the graphics submit to wait on.
+    API 1.0 has no timeline semaphores, so a batch is only recycled once its
+    fence has signaled and the frame that waited on its semaphore is done.
+
+    Thread safe. flush() submits to the transfer queue, which is the graphics
+    queue when the device has no separate transfer family; queue access is
+    externally synchronized, so call flush() from the thread that submits
+    frames.
+*/
+class UploadScheduler {
+public:
+    UploadScheduler(
+        VkDevice device,
+        GpuAllocator& allocator,
+        VkQueue transferQueue,
+        uint32_t transferFamily,
+        uint32_t graphicsFamily,
+        VkDeviceSize stagingRingSize = 16 * 1024 * 1024
+    );
+    // Waits for all submitted batches
+    ~UploadScheduler();
+
+    UploadScheduler(const UploadScheduler&) = delete;
+    UploadScheduler& operator=(const UploadScheduler&) = delete;
+
+    /*
+        Copy size bytes from data into dst at dstOffset. dstAccess and
+        dstStage describe how the graphics queue will read the buffer, e.g.
+        VERTEX_ATTRIBUTE_READ at VERTEX_INPUT. Returns the batch number, to
+        compare with completedBatch().
+    */
+    uint64_t enqueue(
+        VkBuffer dst,
+        VkDeviceSize dstOffset,
+        const void* data,
+        VkDeviceSize size,
+        VkAccessFlags dstAccess,
+        VkPipelineStageFlags dstStage
+    );
+
+    /*
+        Copy tightly packed texels into the first mip level and layer of a
+        color image, which must not be in use. The image goes from whatever
+        it held to SHADER_READ_ONLY_OPTIMAL, ready to sample once acquired.
+    */
+    uint64_t enqueueImage(
+        VkImage dst,
+        VkExtent2D extent,
+        const void* data,
+        VkDeviceSize size,
+        VkAccessFlags dstAccess,
+        VkPipelineStageFlags dstStage
+    );
+
+    // Submit the uploads enqueued so far, if any
+    void flush();
+
+    /*
+        Hand every submitted but not yet acquired batch to the graphics frame
+        numbered frame. The caller must wait on the returned semaphores and
+        record the barriers before using the buffers.
+    */
+    UploadAcquire acquire(uint64_t frame);
+
+    /*
+        Recycle batches whose copies are done and whose acquiring frame has
+        finished, i.e. is numbered below completedFrames. Never blocks.
+    */
+    void collect(uint64_t completedFrames);
+
+    // Every batch numbered up to this one has finished copying
+    uint64_t completedBatch() const;
+
+    bool sharesGraphicsFamily() const {
+        return transferFamily == graphicsFamily;
+    }
+
+    UploadStats stats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Staging {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        // Only set for copies that did not fit in the ring
+        GpuAllocation allocation;
+        bool dedicated;
+    };
+
+    struct Copy {
+        VkBuffer dst;
+        VkDeviceSize dstOffset;
+        VkDeviceSize size;
+        VkAccessFlags dstAccess;
+        VkPipelineStageFlags dstStage;
+        Staging staging;
+        // Image uploads only, in place of dst
+        VkImage image;
+        VkExtent2D imageExtent;
+    };
+
+    struct Batch {
+        uint64_t number = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        std::vector<Copy> copies;
+
+        bool acquired = false;
+        uint64_t acquireFrame = 0;
+    };
+
+    // Copies data to staging memory and queues the copy for the next flush
+    uint64_t stage(Copy copy, const void* data);
+    // Space for size bytes in the ring; false when it is too full
+    bool reserveRing(VkDeviceSize size, VkDeviceSize& offset);
+    Batch takeFreeBatch();
+    void recordBatch(const Batch& batch);
+    void releaseStaging(Batch& batch);
+
+    VkDevice device;
+    GpuAllocator& allocator;
+    VkQueue transferQueue;
+    uint32_t transferFamily;
+    uint32_t graphicsFamily;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    VkBuffer stagingRing = VK_NULL_HANDLE;
+    GpuAllocation stagingRingAllocation;
+    VkDeviceSize stagingRingSize;
+    // Running byte counts; positions in the ring are these modulo its size
+    uint64_t ringHead = 0;
+    uint64_t ringTail = 0;
+    // Where the ring head was when each submitted batch was flushed. Once
+    // every batch up to one has retired, the tail can move up to its mark.
+    std::deque<std::pair<uint64_t, uint64_t>> ringMarks;
+    VkDeviceSize ringPeakBytes = 0;
+    uint64_t dedicatedStagingCount = 0;
+
+    mutable std::mutex mutex;
+    // Uploads waiting for flush()
+    std::vector<Copy> pending;
+    uint64_t nextBatch = 1;
+    // Submitted batches, oldest first
+    std::deque<Batch> inFlight;
+    // Recycled batches keep their command buffer, fence and semaphore
+    std::vector<Batch> freeBatches;
+    uint64_t lastCompletedBatch = 0;
+};
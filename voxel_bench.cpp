@@ -0,0 +1,593 @@
+/*
+    CPU-only microbenchmark for chunk meshing; needs no Vulkan device.
+
+    Meshes a grid of chunks repeatedly and reports chunks meshed per second,
+    and for the bit mask mesher at each SIMD level, the time its two mask
+    kernels take on their own.
+    Before timing, every chunk's quads are checked to cover exactly the faces
+    a naive mesher would emit, so a faster mesher cannot pass by being wrong,
+    and the bit mask mesher at every SIMD level this CPU has must produce the
+    same quads as the scalar reference, on the scenes and on random chunks.
+
+    Then the same work is spread over the job system with 1, 2, 4, ... threads
+    to measure how meshing throughput scales with cores.
+
+    Last, a region of chunks is written to a region file and loaded back
+    through the memory mapping, from a cold and then a warm page cache.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "block_masks.hpp"
+#include "chunk.hpp"
+#include "job_system.hpp"
+#include "mesher.hpp"
+#include "mpmc_queue.hpp"
+#include "region_file.hpp"
+
+struct Scene {
+    std::string name;
+    // gridSize x gridSize chunks
+    int gridSize;
+    std::vector<Chunk> chunks;
+    std::vector<ChunkNeighbors> neighbors;
+};
+
+// Links each chunk to its horizontal neighbours inside the grid
+static void linkNeighbors(Scene& scene) {
+    int n = scene.gridSize;
+    scene.neighbors.assign(scene.chunks.size(), ChunkNeighbors{});
+    for(int cz = 0; cz < n; cz++) {
+        for(int cx = 0; cx < n; cx++) {
+            ChunkNeighbors& links = scene.neighbors[cx + cz * n];
+            auto at = [&](int x, int z) -> const Chunk* {
+                if(x < 0 || z < 0 || x >= n || z >= n) {
+                    return nullptr;
+                }
+                return &scene.chunks[x + z * n];
+            };
+            links.chunks[static_cast<int>(Face::PosX)] = at(cx + 1, cz);
+            links.chunks[static_cast<int>(Face::NegX)] = at(cx - 1, cz);
+            links.chunks[static_cast<int>(Face::PosZ)] = at(cx, cz + 1);
+            links.chunks[static_cast<int>(Face::NegZ)] = at(cx, cz - 1);
+        }
+    }
+}
+
+static Scene makeTerrainScene(int gridSize) {
+    Scene scene { "terrain", gridSize, {}, {} };
+    scene.chunks.resize(gridSize * gridSize);
+    for(int cz = 0; cz < gridSize; cz++) {
+        for(int cx = 0; cx < gridSize; cx++) {
+            generateTerrain(scene.chunks[cx + cz * gridSize], cx, cz, 1234);
+        }
+    }
+    linkNeighbors(scene);
+    return scene;
+}
+
+// Half the blocks solid at random: worst case, almost nothing merges
+static Scene makeNoiseScene(int gridSize) {
+    Scene scene { "noise", gridSize, {}, {} };
+    scene.chunks.resize(gridSize * gridSize);
+    uint32_t state = 42;
+    for(Chunk& chunk : scene.chunks) {
+        BlockId* blocks = chunk.data();
+        for(int i = 0; i < CHUNK_VOLUME; i++) {
+            state = state * 1664525u + 1013904223u;
+            blocks[i] = (state >> 24) & 1 ? BLOCK_STONE + ((state >> 16) & 1) : BLOCK_AIR;
+        }
+    }
+    linkNeighbors(scene);
+    return scene;
+}
+
+// Each visible face covered by exactly one quad of its block type
+static bool verifyQuads(
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    const std::vector<Quad>& quads
+) {
+    std::vector<uint8_t> covered(6 * CHUNK_VOLUME, 0);
+    uint64_t area = 0;
+    for(const Quad& quad : quads) {
+        int f = static_cast<int>(quad.face);
+        int d = f / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+        for(int h = 0; h < quad.height; h++) {
+            for(int w = 0; w < quad.width; w++) {
+                int pos[3] = { quad.x, quad.y, quad.z };
+                pos[u] += w;
+                pos[v] += h;
+                if(pos[u] >= CHUNK_SIZE || pos[v] >= CHUNK_SIZE) {
+                    return false;
+                }
+                if(chunk.get(pos[0], pos[1], pos[2]) != quad.block) {
+                    return false;
+                }
+                uint8_t& cell = covered[f * CHUNK_VOLUME + Chunk::index(pos[0], pos[1], pos[2])];
+                if(cell) {
+                    return false;
+                }
+                cell = 1;
+                area++;
+            }
+        }
+    }
+
+    // Covered faces are distinct, so if they are all visible and there are
+    // as many as visible faces, every visible face is covered
+    if(area != countVisibleFaces(chunk, neighbors)) {
+        return false;
+    }
+    for(int f = 0; f < 6; f++) {
+        int d = f / 2;
+        for(int i = 0; i < CHUNK_VOLUME; i++) {
+            if(!covered[f * CHUNK_VOLUME + i]) {
+                continue;
+            }
+            int pos[3] = {
+                i % CHUNK_SIZE,
+                i / (CHUNK_SIZE * CHUNK_SIZE),
+                (i / CHUNK_SIZE) % CHUNK_SIZE
+            };
+            pos[d] += f % 2 == 0 ? 1 : -1;
+            bool inside = pos[d] >= 0 && pos[d] < CHUNK_SIZE;
+            if(inside && chunk.get(pos[0], pos[1], pos[2]) != BLOCK_AIR) {
+                return false;
+            }
+            if(!inside) {
+                const Chunk* neighbor = neighbors.chunks[f];
+                pos[d] = pos[d] < 0 ? CHUNK_SIZE - 1 : 0;
+                if(neighbor && neighbor->get(pos[0], pos[1], pos[2]) != BLOCK_AIR) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool sameQuads(const std::vector<Quad>& a, const std::vector<Quad>& b) {
+    if(a.size() != b.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < a.size(); i++) {
+        if(std::memcmp(&a[i], &b[i], sizeof(Quad)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Kernel levels this CPU can run, scalar first
+static std::vector<SimdLevel> supportedLevels() {
+    std::vector<SimdLevel> levels;
+    for(SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 }) {
+        if(level <= detectSimdLevel()) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+// Every mask kernel level must reproduce the reference mesher exactly
+static void verifyLevels(
+    const std::string& name,
+    const Chunk& chunk,
+    const ChunkNeighbors& neighbors,
+    const std::vector<Quad>& reference
+) {
+    std::vector<Quad> quads;
+    for(SimdLevel level : supportedLevels()) {
+        quads.clear();
+        greedyMeshMasks(chunk, neighbors, quads, level);
+        if(!sameQuads(quads, reference)) {
+            throw std::runtime_error(
+                name + ": " + simdLevelName(level) + " mesh differs from the reference"
+            );
+        }
+    }
+}
+
+/*
+    Random chunks of every density from nearly empty to nearly full, with
+    random neighbours on some sides, checked against the reference mesher.
+*/
+static void verifyRandomChunks(int count) {
+    uint32_t state = 7;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    };
+
+    std::vector<Chunk> chunks(5);
+    std::vector<Quad> reference;
+    for(int n = 0; n < count; n++) {
+        // Chunk 0 is meshed, 1 to 4 are its x and z neighbours
+        uint32_t density = next() % 257;
+        for(Chunk& chunk : chunks) {
+            BlockId* blocks = chunk.data();
+            for(int i = 0; i < CHUNK_VOLUME; i++) {
+                blocks[i] = (next() & 0xff) < density ? 1 + next() % 3 : BLOCK_AIR;
+            }
+        }
+        ChunkNeighbors neighbors;
+        Face sides[] = { Face::PosX, Face::NegX, Face::PosZ, Face::NegZ };
+        for(int s = 0; s < 4; s++) {
+            if(next() % 4 != 0) {
+                neighbors.chunks[static_cast<int>(sides[s])] = &chunks[1 + s];
+            }
+        }
+
+        reference.clear();
+        greedyMeshScalar(chunks[0], neighbors, reference);
+        if(!verifyQuads(chunks[0], neighbors, reference)) {
+            throw std::runtime_error("random: mesh does not match visible faces");
+        }
+        verifyLevels("random", chunks[0], neighbors, reference);
+    }
+    std::cout << "random: " << count << " chunks match the reference mesher on";
+    for(SimdLevel level : supportedLevels()) {
+        std::cout << " " << simdLevelName(level);
+    }
+    std::cout << std::endl;
+}
+
+// Chunks per second meshing the whole scene `rounds` times
+template<typename Mesher>
+static double timeMesher(const Scene& scene, int rounds, uint64_t expectedQuads, Mesher mesh) {
+    std::vector<Quad> quads;
+    auto start = std::chrono::steady_clock::now();
+    // Keeps the work observable so it is not optimized away
+    uint64_t checksum = 0;
+    for(int round = 0; round < rounds; round++) {
+        for(size_t i = 0; i < scene.chunks.size(); i++) {
+            quads.clear();
+            mesh(scene.chunks[i], scene.neighbors[i], quads);
+            checksum += quads.size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    if(checksum != expectedQuads * rounds) {
+        throw std::runtime_error(scene.name + ": unstable mesher output");
+    }
+    return static_cast<double>(rounds) * scene.chunks.size() / seconds;
+}
+
+// Microseconds per chunk of each mask kernel on its own
+struct KernelTimes {
+    double solidUs;
+    double facesUs;
+    // Sum of every face mask, the same at every level
+    uint64_t checksum;
+};
+
+/*
+    buildSolidMasks and computeFaceMasks alone, without the greedy walk that
+    follows them in greedyMeshMasks, so the gain of each SIMD level shows
+    apart from the merging and quad output every level shares.
+*/
+static KernelTimes timeKernels(const Scene& scene, int rounds, SimdLevel level) {
+    static SolidMasks solid;
+    static FaceMasks faces;
+    double solidSeconds = 0.0;
+    double facesSeconds = 0.0;
+    // Keeps the work observable, so it is not optimized away, and checked
+    uint64_t checksum = 0;
+    for(int round = 0; round < rounds; round++) {
+        for(size_t i = 0; i < scene.chunks.size(); i++) {
+            auto start = std::chrono::steady_clock::now();
+            buildSolidMasks(scene.chunks[i], scene.neighbors[i], solid, level);
+            auto built = std::chrono::steady_clock::now();
+            computeFaceMasks(solid, faces, level);
+            auto done = std::chrono::steady_clock::now();
+            solidSeconds += std::chrono::duration<double>(built - start).count();
+            facesSeconds += std::chrono::duration<double>(done - built).count();
+            const uint64_t* rows = &faces.rows[0][0][0];
+            for(size_t row = 0; row < sizeof(faces.rows) / sizeof(uint64_t); row++) {
+                checksum += rows[row] * (row + 1);
+            }
+        }
+    }
+    double chunkCount = static_cast<double>(rounds) * scene.chunks.size();
+    return KernelTimes {
+        1e6 * solidSeconds / chunkCount,
+        1e6 * facesSeconds / chunkCount,
+        checksum
+    };
+}
+
+static void runScene(const Scene& scene, int rounds) {
+    std::vector<Quad> quads;
+
+    uint64_t totalQuads = 0;
+    uint64_t totalFaces = 0;
+    for(size_t i = 0; i < scene.chunks.size(); i++) {
+        quads.clear();
+        greedyMeshScalar(scene.chunks[i], scene.neighbors[i], quads);
+        if(!verifyQuads(scene.chunks[i], scene.neighbors[i], quads)) {
+            throw std::runtime_error(scene.name + ": mesh does not match visible faces");
+        }
+        verifyLevels(scene.name, scene.chunks[i], scene.neighbors[i], quads);
+        totalQuads += quads.size();
+        totalFaces += countVisibleFaces(scene.chunks[i], scene.neighbors[i]);
+    }
+
+    double chunkCount = static_cast<double>(scene.chunks.size());
+    std::cout << std::fixed << std::setprecision(1)
+              << scene.name << ": " << totalQuads / chunkCount << " quads/chunk from "
+              << totalFaces / chunkCount << " faces" << std::endl;
+
+    double reference = timeMesher(scene, rounds, totalQuads, greedyMeshScalar);
+    std::cout << "  reference: " << reference << " chunks/s ("
+              << 1e6 / reference << "us/chunk)" << std::endl;
+
+    /*
+        The levels differ only in the kernels, a small part of each mesh, so
+        clock drift between back to back runs can outweigh them. They take
+        turns over a few passes instead, and each keeps its best pass.
+    */
+    const int passes = 3;
+    int passRounds = std::max(1, rounds / passes);
+    std::vector<SimdLevel> levels = supportedLevels();
+    std::vector<double> best(levels.size(), 0.0);
+    std::vector<KernelTimes> kernels(levels.size(), KernelTimes { 1e30, 1e30, 0 });
+    for(int pass = 0; pass < passes; pass++) {
+        for(size_t l = 0; l < levels.size(); l++) {
+            SimdLevel level = levels[l];
+            double chunksPerSecond = timeMesher(scene, passRounds, totalQuads,
+                [level](const Chunk& chunk, const ChunkNeighbors& neighbors, std::vector<Quad>& out) {
+                    greedyMeshMasks(chunk, neighbors, out, level);
+                }
+            );
+            best[l] = std::max(best[l], chunksPerSecond);
+            KernelTimes times = timeKernels(scene, passRounds, level);
+            if(times.checksum != timeKernels(scene, 1, levels[0]).checksum * passRounds) {
+                throw std::runtime_error(
+                    scene.name + ": " + simdLevelName(level) + " face masks differ from scalar"
+                );
+            }
+            kernels[l].solidUs = std::min(kernels[l].solidUs, times.solidUs);
+            kernels[l].facesUs = std::min(kernels[l].facesUs, times.facesUs);
+        }
+    }
+    for(size_t l = 0; l < levels.size(); l++) {
+        std::cout << std::setprecision(1)
+                  << "  masks " << simdLevelName(levels[l]) << ": " << best[l]
+                  << " chunks/s (" << 1e6 / best[l] << "us/chunk), "
+                  << std::setprecision(2) << best[l] / reference << "x; kernels "
+                  << std::setprecision(1) << kernels[l].solidUs << "us solid + "
+                  << kernels[l].facesUs << "us faces"
+                  << std::endl;
+    }
+}
+
+/*
+    One job per chunk per round. Results come back through the same kind of
+    lock-free queue the renderer uploads from, drained by the main thread
+    between jobs it helps with.
+*/
+static double runParallel(const Scene& scene, int rounds, unsigned threads, uint64_t expectedQuads) {
+    // The main thread helps, so one worker fewer than threads
+    JobSystem jobs(threads - 1);
+    MpmcQueue<uint32_t> results(scene.chunks.size());
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t checksum = 0;
+    for(int round = 0; round < rounds; round++) {
+        JobGroup group;
+        for(size_t i = 0; i < scene.chunks.size(); i++) {
+            jobs.submit(group, [&scene, &results, i]() {
+                thread_local std::vector<Quad> quads;
+                quads.clear();
+                greedyMesh(scene.chunks[i], scene.neighbors[i], quads);
+                uint32_t count = static_cast<uint32_t>(quads.size());
+                // Sized for a whole round, so never full
+                results.tryPush(count);
+            });
+        }
+
+        uint32_t count;
+        while(!group.done()) {
+            if(results.tryPop(count)) {
+                checksum += count;
+            } else if(!jobs.runOne()) {
+                std::this_thread::yield();
+            }
+        }
+        jobs.wait(group);
+        while(results.tryPop(count)) {
+            checksum += count;
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    if(checksum != expectedQuads * rounds) {
+        throw std::runtime_error(scene.name + ": parallel meshing lost or changed chunks");
+    }
+    return static_cast<double>(rounds) * scene.chunks.size() / seconds;
+}
+
+static void runScaling(const Scene& scene, int rounds, unsigned maxThreads) {
+    std::vector<Quad> quads;
+    uint64_t expectedQuads = 0;
+    for(size_t i = 0; i < scene.chunks.size(); i++) {
+        quads.clear();
+        greedyMesh(scene.chunks[i], scene.neighbors[i], quads);
+        expectedQuads += quads.size();
+    }
+
+    double single = 0.0;
+    for(unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        double chunksPerSecond = runParallel(scene, rounds, threads, expectedQuads);
+        if(threads == 1) {
+            single = chunksPerSecond;
+        }
+        std::cout << std::fixed << std::setprecision(1)
+                  << scene.name << " x" << threads << " threads: "
+                  << chunksPerSecond << " chunks/s, "
+                  << std::setprecision(2) << chunksPerSecond / single << "x"
+                  << std::endl;
+        if(threads == maxThreads) {
+            break;
+        }
+    }
+}
+
+// Asks the kernel to forget the file's cached pages. False if it would not.
+static bool dropPageCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    // Dirty pages are not dropped, so write them back first
+    bool dropped = fdatasync(fd) == 0
+        && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+}
+
+// Chunks per second loading every chunk of the region, checked against chunks
+static double timeRegionLoad(const std::string& path, const std::vector<Chunk>& chunks) {
+    Chunk loaded;
+    auto start = std::chrono::steady_clock::now();
+    // Mapping is part of the cost, so the file is opened inside the timing
+    RegionFile region(path);
+    for(size_t i = 0; i < chunks.size(); i++) {
+        if(!region.load(i % REGION_SIZE, i / REGION_SIZE, loaded)) {
+            throw std::runtime_error(path + ": chunk missing from region");
+        }
+        if(std::memcmp(loaded.data(), chunks[i].data(), CHUNK_VOLUME) != 0) {
+            throw std::runtime_error(path + ": chunk changed on its way through the region");
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+    return chunks.size() / seconds;
+}
+
+static void runRegion(const std::string& name, const std::vector<Chunk>& chunks, const std::string& dir) {
+    std::string path = dir + "/voxel_bench_" + name + ".vxr";
+    std::vector<RegionChunk> stored;
+    for(size_t i = 0; i < chunks.size(); i++) {
+        stored.push_back({ static_cast<int>(i % REGION_SIZE), static_cast<int>(i / REGION_SIZE), &chunks[i] });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    writeRegionFile(path, stored);
+    double writeSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    size_t fileSize = RegionFile(path).fileSize();
+    double rawMiB = chunks.size() * CHUNK_VOLUME / (1024.0 * 1024.0);
+    std::cout << std::fixed << std::setprecision(1)
+              << name << " region: " << chunks.size() << " chunks in "
+              << fileSize / 1024.0 << " KiB, " << fileSize / static_cast<double>(chunks.size())
+              << " bytes/chunk (" << rawMiB * 1024.0 * 1024.0 / fileSize << "x smaller), written at "
+              << chunks.size() / writeSeconds << " chunks/s" << std::endl;
+
+    bool cold = dropPageCache(path);
+    double coldRate = timeRegionLoad(path, chunks);
+    // Best of a few, now every page is cached
+    double warmRate = 0.0;
+    for(int round = 0; round < 5; round++) {
+        warmRate = std::max(warmRate, timeRegionLoad(path, chunks));
+    }
+    std::cout << "  load " << (cold ? "cold" : "cold (page cache not dropped)") << ": "
+              << coldRate << " chunks/s (" << coldRate * CHUNK_VOLUME / (1024.0 * 1024.0)
+              << " MiB/s of blocks)" << std::endl;
+    std::cout << "  load warm: " << warmRate << " chunks/s ("
+              << warmRate * CHUNK_VOLUME / (1024.0 * 1024.0) << " MiB/s of blocks)" << std::endl;
+    std::remove(path.c_str());
+}
+
+// A whole region of terrain, and how fast generating it is, to compare
+static void runTerrainRegion(const std::string& dir) {
+    std::vector<Chunk> chunks(REGION_SIZE * REGION_SIZE);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < chunks.size(); i++) {
+        generateTerrain(chunks[i], i % REGION_SIZE, i / REGION_SIZE, 1234);
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+    std::cout << std::fixed << std::setprecision(1)
+              << "terrain generation: " << chunks.size() / seconds << " chunks/s" << std::endl;
+    runRegion("terrain", chunks, dir);
+}
+
+static int parseCount(const char* flag, const char* value) {
+    char* end = nullptr;
+    long parsed = std::strtol(value, &end, 10);
+    if(*value == '\0' || *end != '\0' || parsed <= 0 || parsed > 1 << 20) {
+        throw std::runtime_error(std::string("invalid value for ") + flag);
+    }
+    return static_cast<int>(parsed);
+}
+
+int main(int argc, char** argv) {
+    try {
+        // Chunks per side of the grid, and times each chunk is meshed
+        int gridSize = 8;
+        int rounds = 20;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        // Region files are written here and removed after
+        std::string regionDir = ".";
+        for(int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if(i + 1 >= argc) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            if(arg == "--grid") {
+                gridSize = parseCount(argv[i], argv[i + 1]);
+            } else if(arg == "--rounds") {
+                rounds = parseCount(argv[i], argv[i + 1]);
+            } else if(arg == "--threads") {
+                threads = parseCount(argv[i], argv[i + 1]);
+            } else if(arg == "--region-dir") {
+                regionDir = argv[i + 1];
+            } else {
+                throw std::runtime_error("unknown argument " + arg);
+            }
+            i++;
+        }
+
+        Scene terrain = makeTerrainScene(gridSize);
+        Scene noise = makeNoiseScene(gridSize);
+        verifyRandomChunks(200);
+        runScene(terrain, rounds);
+        runScene(noise, rounds);
+        runScaling(terrain, rounds, threads);
+        runScaling(noise, rounds, threads);
+        runTerrainRegion(regionDir);
+        if(noise.chunks.size() <= REGION_SIZE * REGION_SIZE) {
+            runRegion("noise", noise.chunks, regionDir);
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
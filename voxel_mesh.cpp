@@ -0,0 +1,14 @@
+#include "voxel_mesh.hpp"
+
+void appendChunkQuads(const std::vector<Quad>& quads, VoxelMeshData& mesh) {
+    for(const Quad& quad : quads) {
+        uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+        std::array<QuadCorner, 4> corners = quadCorners(quad);
+        for(const QuadCorner& corner : corners) {
+            mesh.vertices.push_back(VoxelVertex::pack(corner, quad.face, quad.block));
+        }
+        for(uint8_t index : quadIndices(corners)) {
+            mesh.indices.push_back(first + index);
+        }
+    }
+}
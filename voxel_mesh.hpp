@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include <glm/vec3.hpp>
+
+#include "mesher.hpp"
+
+/*
+    Voxel vertex packed into 8 bytes, a third of the 24 byte Vertex the
+    flat scenes use. Decoded by shaders/voxel.vert.
+
+    packed: chunk-local position x, y, z (6 bits each, 0 to CHUNK_SIZE
+    inclusive) from bit 0, then the Face (3 bits) at bit 18 and ambient
+    occlusion (2 bits) at bit 21. The chunk's world position comes from a
+    push constant per draw, or for streamed chunks from the per-instance
+    ChunkRecord. material: the block type, which picks the colour.
+*/
+struct VoxelVertex {
+    uint32_t packed;
+    uint32_t material;
+
+    static VoxelVertex pack(const QuadCorner& corner, Face face, uint32_t material) {
+        return VoxelVertex {
+            .packed = uint32_t(corner.x)
+                | uint32_t(corner.y) << 6
+                | uint32_t(corner.z) << 12
+                | uint32_t(face) << 18
+                | uint32_t(corner.ao) << 21,
+            .material = material
+        };
+    }
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        return VkVertexInputBindingDescription {
+            .binding = 0,
+            .stride = sizeof(VoxelVertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        };
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+        return {{
+            // layout(location = 0) in uint inPacked
+            {
+                .location = 0,
+                .binding = 0,
+                .format = VK_FORMAT_R32_UINT,
+                .offset = offsetof(VoxelVertex, packed)
+            },
+            // layout(location = 1) in uint inMaterial
+            {
+                .location = 1,
+                .binding = 0,
+                .format = VK_FORMAT_R32_UINT,
+                .offset = offsetof(VoxelVertex, material)
+            }
+        }};
+    }
+};
+static_assert(sizeof(VoxelVertex) == 8, "voxel vertices are packed to 8 bytes");
+
+// One chunk's geometry, in chunk-local coordinates
+struct VoxelMeshData {
+    std::vector<VoxelVertex> vertices;
+    std::vector<uint32_t> indices;
+    glm::vec3 origin;
+};
+
+// Packed vertices for greedy meshed quads; colours and shading are worked
+// out in voxel.vert
+void appendChunkQuads(const std::vector<Quad>& quads, VoxelMeshData& mesh);